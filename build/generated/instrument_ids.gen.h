@@ -0,0 +1,27 @@
+// generated by tools/oi_gen_ids.py from data/instrument_ids.txt, edit that instead
+
+#define OI_INSTRUMENT_ID_COUNT 8
+#define OI_INSTRUMENT_ID_BUCKETS 4
+#define OI_INSTRUMENT_ID_SLOTS 16
+#define OI_INSTRUMENT_ID_EMPTY 0xFFFF
+
+// sorted by VID/PID
+static const OIInstrumentId instrument_ids[OI_INSTRUMENT_ID_COUNT] = {
+    { 0x12BA, 0x074B, OI_Driver_GHL_HID, 0x0000, 0x0000, "PS3/Wii U GHL dongle" },
+    { 0x1430, 0x070B, OI_Driver_GHL_XInput, 0x0000, 0x0000, "Xbox 360 GHL dongle" },
+    { 0x1430, 0x079B, OI_Driver_GHL_XOne, 0x0000, 0x0000, "Xbox One GHL dongle" },
+    { 0x1BAD, 0x0004, OI_Driver_WiiRB, 0x12BA, 0x0200, "Rock Band Wii guitar" },
+    { 0x1BAD, 0x0005, OI_Driver_WiiRB, 0x12BA, 0x0210, "Rock Band Wii drums" },
+    { 0x1BAD, 0x3010, OI_Driver_WiiRB, 0x12BA, 0x0200, "Rock Band 2 Wii guitar" },
+    { 0x1BAD, 0x3110, OI_Driver_WiiRB, 0x12BA, 0x0210, "Rock Band 2 Wii drums" },
+    { 0x1BAD, 0x3138, OI_Driver_WiiRB, 0x12BA, 0x0210, "Rock Band Wii MIDI Pro Adapter (drums)" },
+};
+
+static const uint16_t instrument_id_displacements[OI_INSTRUMENT_ID_BUCKETS] = {
+    1, 3, 1, 0,
+};
+
+static const uint16_t instrument_id_slots[OI_INSTRUMENT_ID_SLOTS] = {
+    0x0005, 0x0006, 0xFFFF, 0xFFFF, 0x0004, 0x0007, 0xFFFF, 0x0000,
+    0x0003, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0x0001, 0x0002, 0xFFFF,
+};
@@ -0,0 +1,34 @@
+/*
+    Common.h - OrbisInstrumentalizer host build
+    Stand-in for the GoldHEN plugin SDK header, for building the hooks on Linux.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+struct proc_info {
+    int pid;
+    char name[32];
+    char path[1024];
+    char titleid[16];
+    char contentid[64];
+    char version[8];
+    uint64_t base_address;
+};
+
+int sys_sdk_proc_info(struct proc_info *info);
+int sys_dynlib_load_prx(const char *name, int *handle);
+int sys_dynlib_dlsym(int handle, const char *symbol, void *address);
+void klog(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// nothing actually gets detoured on the host, tests call the _hook functions themselves
+// and HOOK_CONTINUE goes straight to whatever the original function pointer is
+#define HOOK_INIT(function) static bool function##_hooked = false
+#define HOOK(function) function##_hooked = true
+#define UNHOOK(function) function##_hooked = false
+#define HOOK_CONTINUE(function, type, ...) ((type)function)(__VA_ARGS__)
@@ -0,0 +1,83 @@
+/*
+    OIHostMock.h - OrbisInstrumentalizer host build
+    Controls for the mock sceUsbd/scePad/GoldHEN stand-ins, used to script devices and report streams.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <orbis/libkernel.h>
+#include "OrbisUsbd.h"
+#include "OrbisPadTypes.h"
+
+#define OI_HOST_MOCK_WIRELESS_SLOTS 4
+
+typedef struct _OIHostMockDeviceInfo {
+    uint16_t vendorId;
+    uint16_t productId;
+    uint8_t deviceClass; // used for bDeviceClass, bDeviceSubClass and bDeviceProtocol
+    uint8_t interfaceClass;
+    uint8_t interfaceSubClass;
+    uint8_t xinputSubtype; // non-zero adds an XInput descriptor with this subtype to each interface
+    uint8_t numInterfaces; // 0 is treated as 1
+    // for 360 wireless adapters, the subtype of the controller on each slot or 0 for none. given out whenever
+    // the adapter's asked what's on a slot
+    uint8_t wirelessSubtypes[OI_HOST_MOCK_WIRELESS_SLOTS];
+} OIHostMockDeviceInfo;
+
+typedef struct _OIHostMockStats {
+    int devicesOpen; // handles from sceUsbdOpen that haven't been closed
+    int transfersAllocated; // transfers from sceUsbdAllocTransfer that haven't been freed
+    int transfersInFlight;
+    uint64_t transfersCompleted;
+    uint64_t reportsDelivered;
+    uint64_t reportsDropped; // queued reports thrown away because no transfer was waiting in time
+    uint64_t reportsSent; // interrupt OUT transfers the device has taken
+    uint64_t controlTransfers;
+    uint64_t deviceListCalls;
+    int deviceListsOpen; // lists from sceUsbdGetDeviceList that haven't been freed
+    uint64_t descriptorReads;
+} OIHostMockStats;
+
+// plugs in a device, it shows up in the next sceUsbdGetDeviceList
+libusb_device *OIHostMockAddDevice(const OIHostMockDeviceInfo *info);
+// unplugs a device, its transfers complete with LIBUSB_TRANSFER_NO_DEVICE
+void OIHostMockRemoveDevice(libusb_device *device);
+// queues an interrupt IN report, handed to the next transfer submitted on that endpoint
+void OIHostMockQueueReport(libusb_device *device, uint8_t endpoint, const uint8_t *report, int length);
+// reports stay queued until a transfer is there to take them unless this is set,
+// then anything arriving with no transfer left to take it is dropped like it would be on the wire
+void OIHostMockSetDropUnclaimedReports(bool drop);
+// how long sceUsbdControlTransfer takes to come back, like a slow device, 0 by default
+void OIHostMockSetControlDelay(uint32_t usec);
+int OIHostMockPendingReports(libusb_device *device, uint8_t endpoint);
+// completes the oldest transfer waiting on that endpoint with report straight away, running its callback
+// on the calling thread, for replaying reports faster than an event thread would pick them up
+bool OIHostMockCompleteTransfer(libusb_device *device, uint8_t endpoint, const uint8_t *report, int length);
+// copies the oldest interrupt OUT transfer sent to that endpoint and forgets it, returns its length or -1 if there isn't one
+int OIHostMockTakeSentReport(libusb_device *device, uint8_t endpoint, uint8_t *data, int max_length);
+// copies the data stage of the last control transfer sent to the device, returns its length
+int OIHostMockLastControlTransfer(libusb_device *device, uint8_t *setup, uint8_t *data, int max_length);
+void OIHostMockGetStats(OIHostMockStats *stats);
+// removes every device and clears the stats, any handles or transfers still held by the plugin are leaked
+void OIHostMockReset();
+
+// process info returned by sys_sdk_proc_info, its base_address is a zeroed mapping the size of a game's executable
+// that tools can write code into for the plugin to find at a known offset
+void OIHostMockSetProcInfo(const char *titleid, const char *version);
+// module info returned by sceKernelGetModuleInfo for the game's executable (handle 0),
+// there isn't one until this is called
+void OIHostMockSetModuleInfo(const OrbisKernelModuleInfo *info);
+// files the plugin opens under /data/GoldHEN/plugins/ are opened in directory instead, NULL goes back to the real path
+void OIHostMockSetDataDirectory(const char *directory);
+// klog goes to stderr unless this is set
+void OIHostMockSetQuiet(bool quiet);
+// sceKernelReadTsc returns ticks (nanoseconds) instead of the real clock until it's set back to 0,
+// so anything timed off it comes out the same on every run
+void OIHostMockSetTsc(uint64_t ticks);
+
+// controller state returned by the mock scePadRead/scePadReadState for every handle
+void OIHostMockSetPadData(const OrbisPadData *data);
@@ -0,0 +1,11 @@
+/*
+    Sysmodule.h - OrbisInstrumentalizer host build
+    Stand-in for the OpenOrbis sysmodule header.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#define ORBIS_SYSMODULE_USBD 0x0003
+
+int sceSysmoduleLoadModule(int id);
@@ -0,0 +1,80 @@
+/*
+    libkernel.h - OrbisInstrumentalizer host build
+    Stand-in for the parts of the OpenOrbis libkernel header the plugin uses, backed by pthreads and POSIX.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+typedef pthread_t OrbisPthread;
+typedef pthread_mutex_t OrbisPthreadMutex;
+typedef pthread_cond_t OrbisPthreadCond;
+
+int scePthreadCreate(OrbisPthread *thread, const void *attr, void *(*entry)(void *), void *arg, const char *name);
+void scePthreadExit(void *value);
+int scePthreadJoin(OrbisPthread thread, void **value);
+int scePthreadSetprio(OrbisPthread thread, int priority);
+
+int scePthreadMutexInit(OrbisPthreadMutex *mutex, const void *attr, const char *name);
+int scePthreadMutexDestroy(OrbisPthreadMutex *mutex);
+int scePthreadMutexLock(OrbisPthreadMutex *mutex);
+int scePthreadMutexUnlock(OrbisPthreadMutex *mutex);
+
+int scePthreadCondInit(OrbisPthreadCond *cond, const void *attr, const char *name);
+int scePthreadCondDestroy(OrbisPthreadCond *cond);
+int scePthreadCondWait(OrbisPthreadCond *cond, OrbisPthreadMutex *mutex);
+int scePthreadCondTimedwait(OrbisPthreadCond *cond, OrbisPthreadMutex *mutex, uint32_t usec);
+int scePthreadCondSignal(OrbisPthreadCond *cond);
+int scePthreadCondBroadcast(OrbisPthreadCond *cond);
+
+int sceKernelUsleep(uint32_t usec);
+uint64_t sceKernelGetProcessTime();
+uint64_t sceKernelReadTsc();
+uint64_t sceKernelGetTscFrequency();
+
+int sceKernelOpen(const char *path, int flags, int mode);
+ssize_t sceKernelRead(int fd, void *buf, size_t size);
+ssize_t sceKernelWrite(int fd, const void *buf, size_t size);
+off_t sceKernelLseek(int fd, off_t offset, int whence);
+int sceKernelClose(int fd);
+
+typedef struct {
+    void *address;
+    uint32_t size;
+    int32_t prot;
+} OrbisKernelModuleSegmentInfo;
+
+typedef struct {
+    uint64_t size;
+    char name[256];
+    OrbisKernelModuleSegmentInfo segmentInfo[4];
+    uint32_t segmentCount;
+    uint8_t fingerprint[20];
+} OrbisKernelModuleInfo;
+
+int sceKernelGetModuleInfo(int handle, OrbisKernelModuleInfo *info);
+
+typedef struct {
+    int type;
+    int reqId;
+    int priority;
+    int msgId;
+    int targetId;
+    int userId;
+    int unk1;
+    int unk2;
+    int appId;
+    int errorNum;
+    int unk3;
+    char useIconImageUri;
+    char message[1024];
+    char iconUri[1024];
+    char unk[1024];
+} OrbisNotificationRequest;
+
+int sceKernelSendNotificationRequest(int device, OrbisNotificationRequest *request, size_t size, int blocking);
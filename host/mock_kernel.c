@@ -0,0 +1,222 @@
+/*
+    mock_kernel.c - OrbisInstrumentalizer host build
+    libkernel, sysmodule and GoldHEN stand-ins on top of pthreads and POSIX.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include <orbis/Sysmodule.h>
+#include "OIHostMock.h"
+
+// how much of the game's executable is mapped at base_address, enough for everything the plugin knows an offset for
+#define MOCK_EXECUTABLE_SIZE 0x01400000
+
+// where the plugin keeps its settings, captures and caches on the console
+#define MOCK_PLUGIN_DATA_PATH "/data/GoldHEN/plugins/"
+
+static struct proc_info mock_proc_info = {
+    .pid = 1,
+    .name = "eboot.bin",
+    .titleid = "CUSA02410",
+    .version = "01.00",
+};
+static pthread_once_t mock_executable_once = PTHREAD_ONCE_INIT;
+static bool mock_quiet = false;
+static atomic_uint_fast64_t mock_tsc = 0;
+static OrbisKernelModuleInfo mock_module_info;
+static bool mock_module_info_set = false;
+static char mock_data_directory[256] = { 0 };
+
+void OIHostMockSetProcInfo(const char *titleid, const char *version) {
+    snprintf(mock_proc_info.titleid, sizeof(mock_proc_info.titleid), "%s", titleid);
+    snprintf(mock_proc_info.version, sizeof(mock_proc_info.version), "%s", version);
+}
+
+void OIHostMockSetModuleInfo(const OrbisKernelModuleInfo *info) {
+    mock_module_info = *info;
+    mock_module_info_set = true;
+}
+
+void OIHostMockSetDataDirectory(const char *directory) {
+    snprintf(mock_data_directory, sizeof(mock_data_directory), "%s", directory != NULL ? directory : "");
+}
+
+void OIHostMockSetQuiet(bool quiet) {
+    mock_quiet = quiet;
+}
+
+// zeroed until a tool plants something in it, pages that are never touched don't cost anything
+static void MapExecutable() {
+    void *executable = mmap(NULL, MOCK_EXECUTABLE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    mock_proc_info.base_address = executable != MAP_FAILED ? (uint64_t)executable : 0;
+}
+
+int sys_sdk_proc_info(struct proc_info *info) {
+    pthread_once(&mock_executable_once, MapExecutable);
+    *info = mock_proc_info;
+    return 0;
+}
+
+void klog(const char *format, ...) {
+    if (mock_quiet)
+        return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+int sceSysmoduleLoadModule(int id) {
+    return 0;
+}
+
+int scePthreadCreate(OrbisPthread *thread, const void *attr, void *(*entry)(void *), void *arg, const char *name) {
+    return pthread_create(thread, NULL, entry, arg);
+}
+
+void scePthreadExit(void *value) {
+    pthread_exit(value);
+}
+
+int scePthreadJoin(OrbisPthread thread, void **value) {
+    return pthread_join(thread, value);
+}
+
+int scePthreadSetprio(OrbisPthread thread, int priority) {
+    return 0;
+}
+
+int scePthreadMutexInit(OrbisPthreadMutex *mutex, const void *attr, const char *name) {
+    return pthread_mutex_init(mutex, NULL);
+}
+
+int scePthreadMutexDestroy(OrbisPthreadMutex *mutex) {
+    return pthread_mutex_destroy(mutex);
+}
+
+int scePthreadMutexLock(OrbisPthreadMutex *mutex) {
+    return pthread_mutex_lock(mutex);
+}
+
+int scePthreadMutexUnlock(OrbisPthreadMutex *mutex) {
+    return pthread_mutex_unlock(mutex);
+}
+
+int scePthreadCondInit(OrbisPthreadCond *cond, const void *attr, const char *name) {
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    int r = pthread_cond_init(cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    return r;
+}
+
+int scePthreadCondDestroy(OrbisPthreadCond *cond) {
+    return pthread_cond_destroy(cond);
+}
+
+int scePthreadCondWait(OrbisPthreadCond *cond, OrbisPthreadMutex *mutex) {
+    return pthread_cond_wait(cond, mutex);
+}
+
+int scePthreadCondTimedwait(OrbisPthreadCond *cond, OrbisPthreadMutex *mutex, uint32_t usec) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += usec / 1000000;
+    deadline.tv_nsec += (usec % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+int scePthreadCondSignal(OrbisPthreadCond *cond) {
+    return pthread_cond_signal(cond);
+}
+
+int scePthreadCondBroadcast(OrbisPthreadCond *cond) {
+    return pthread_cond_broadcast(cond);
+}
+
+int sceKernelUsleep(uint32_t usec) {
+    return usleep(usec);
+}
+
+static uint64_t MonotonicNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t sceKernelGetProcessTime() {
+    return MonotonicNanoseconds() / 1000;
+}
+
+void OIHostMockSetTsc(uint64_t ticks) {
+    atomic_store(&mock_tsc, ticks);
+}
+
+// the host "TSC" ticks in nanoseconds
+uint64_t sceKernelReadTsc() {
+    uint64_t pinned = atomic_load(&mock_tsc);
+    return pinned != 0 ? pinned : MonotonicNanoseconds();
+}
+
+uint64_t sceKernelGetTscFrequency() {
+    return 1000000000;
+}
+
+int sceKernelOpen(const char *path, int flags, int mode) {
+    char redirected[512];
+    size_t prefix = strlen(MOCK_PLUGIN_DATA_PATH);
+    if (mock_data_directory[0] != '\0' && strncmp(path, MOCK_PLUGIN_DATA_PATH, prefix) == 0) {
+        snprintf(redirected, sizeof(redirected), "%s/%s", mock_data_directory, path + prefix);
+        path = redirected;
+    }
+    int fd = open(path, flags, mode);
+    return fd < 0 ? -errno : fd;
+}
+
+ssize_t sceKernelRead(int fd, void *buf, size_t size) {
+    return read(fd, buf, size);
+}
+
+ssize_t sceKernelWrite(int fd, const void *buf, size_t size) {
+    return write(fd, buf, size);
+}
+
+off_t sceKernelLseek(int fd, off_t offset, int whence) {
+    return lseek(fd, offset, whence);
+}
+
+int sceKernelClose(int fd) {
+    return close(fd);
+}
+
+int sceKernelGetModuleInfo(int handle, OrbisKernelModuleInfo *info) {
+    if (handle != 0 || !mock_module_info_set)
+        return 0x80020002; // ENOENT
+    *info = mock_module_info;
+    info->size = sizeof(OrbisKernelModuleInfo);
+    return 0;
+}
+
+int sceKernelSendNotificationRequest(int device, OrbisNotificationRequest *request, size_t size, int blocking) {
+    klog("[notification] %s\n", request->message);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+    mock_pad.c - OrbisInstrumentalizer host build
+    Stand-in libScePad, handed to the plugin through sys_dynlib_dlsym along with the mock sceUsbd.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <GoldHEN/Common.h>
+#include "OrbisPadTypes.h"
+#include "OrbisUsbd.h"
+#include "OIHostMock.h"
+
+#define MOCK_PAD_PRX_HANDLE 0x1000
+#define MOCK_USBD_PRX_HANDLE 0x1001
+#define MOCK_PAD_FIRST_HANDLE 0x100
+
+static int next_pad_handle = MOCK_PAD_FIRST_HANDLE;
+static OrbisPadData mock_pad_data = { 0 };
+
+void OIHostMockSetPadData(const OrbisPadData *data) {
+    mock_pad_data = *data;
+}
+
+static int MockScePadOpenExt(int userID, int type, int index, OrbisPadExtParam *param) {
+    return next_pad_handle++;
+}
+
+static int MockScePadRead(int handle, OrbisPadData *data, int count) {
+    for (int i = 0; i < count; i++)
+        data[i] = mock_pad_data;
+    return count > 0 ? 1 : 0;
+}
+
+static int MockScePadReadState(int handle, OrbisPadData *data) {
+    *data = mock_pad_data;
+    return 0;
+}
+
+static int MockScePadGetControllerInformation(int handle, OrbisPadInformation *info) {
+    memset(info, 0, sizeof(OrbisPadInformation));
+    return 0;
+}
+
+static int MockScePadOutputReport(int handle, int type, uint8_t *report, int length) {
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    void *function;
+} mock_pad_symbols[] = {
+    { "scePadOpenExt", MockScePadOpenExt },
+    { "scePadRead", MockScePadRead },
+    { "scePadReadState", MockScePadReadState },
+    { "scePadGetControllerInformation", MockScePadGetControllerInformation },
+    { "scePadOutputReport", MockScePadOutputReport },
+};
+
+// the mock sceUsbd is linked in directly, this is only for code that looks up where it is
+static const struct {
+    const char *name;
+    void *function;
+} mock_usbd_symbols[] = {
+    { "sceUsbdOpen", sceUsbdOpen },
+    { "sceUsbdClose", sceUsbdClose },
+    { "sceUsbdGetConfigDescriptor", sceUsbdGetConfigDescriptor },
+    { "sceUsbdGetDeviceDescriptor", sceUsbdGetDeviceDescriptor },
+    { "sceUsbdFillInterruptTransfer", sceUsbdFillInterruptTransfer },
+    { "sceUsbdGetDeviceList", sceUsbdGetDeviceList },
+    { "sceUsbdFreeDeviceList", sceUsbdFreeDeviceList },
+    { "sceUsbdClaimInterface", sceUsbdClaimInterface },
+    { "sceUsbdReleaseInterface", sceUsbdReleaseInterface },
+};
+
+int sys_dynlib_load_prx(const char *name, int *handle) {
+    if (strcmp(name, "libScePad.sprx") == 0)
+        *handle = MOCK_PAD_PRX_HANDLE;
+    else if (strcmp(name, "libSceUsbd.sprx") == 0)
+        *handle = MOCK_USBD_PRX_HANDLE;
+    else
+        return -1;
+    return 0;
+}
+
+int sys_dynlib_dlsym(int handle, const char *symbol, void *address) {
+    if (handle == MOCK_PAD_PRX_HANDLE) {
+        for (size_t i = 0; i < sizeof(mock_pad_symbols) / sizeof(mock_pad_symbols[0]); i++) {
+            if (strcmp(mock_pad_symbols[i].name, symbol) == 0) {
+                *(void **)address = mock_pad_symbols[i].function;
+                return 0;
+            }
+        }
+    } else if (handle == MOCK_USBD_PRX_HANDLE) {
+        for (size_t i = 0; i < sizeof(mock_usbd_symbols) / sizeof(mock_usbd_symbols[0]); i++) {
+            if (strcmp(mock_usbd_symbols[i].name, symbol) == 0) {
+                *(void **)address = mock_usbd_symbols[i].function;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,693 @@
+/*
+    mock_usbd.c - OrbisInstrumentalizer host build
+    Stand-in sceUsbd with scripted devices and report streams.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "OrbisUsbd.h"
+#include "OIHostMock.h"
+#include "xinput.h"
+
+#define MOCK_MAX_DEVICES 128
+#define MOCK_MAX_TRANSFERS 256
+#define MOCK_MAX_REPORT_SIZE 64
+#define MOCK_ENDPOINT_COUNT 16
+#define MOCK_MAX_SENT_REPORTS 256
+#define MOCK_CONTROL_SETUP_SIZE 8
+#define MOCK_XINPUT_DESCRIPTOR_SIZE 17
+#define MOCK_WIRELESS_ANNOUNCE_SIZE 29
+
+#define LIBUSB_ERROR_NO_DEVICE -4
+#define LIBUSB_ERROR_NOT_FOUND -5
+#define LIBUSB_ERROR_BUSY -6
+#define LIBUSB_ERROR_TIMEOUT -7
+
+#define LIBUSB_TRANSFER_TYPE_CONTROL 0
+#define LIBUSB_TRANSFER_TYPE_INTERRUPT 3
+
+typedef struct _MockReport {
+    int length;
+    uint8_t data[MOCK_MAX_REPORT_SIZE];
+} MockReport;
+
+typedef struct _MockReportQueue {
+    MockReport *reports;
+    int head;
+    int count;
+    int capacity;
+} MockReportQueue;
+
+struct libusb_device {
+    bool present;
+    uint8_t busNumber;
+    uint8_t deviceAddress;
+    OIHostMockDeviceInfo info;
+    MockReportQueue queues[MOCK_ENDPOINT_COUNT];
+    MockReportQueue sent[MOCK_ENDPOINT_COUNT]; // interrupt OUT transfers, oldest first
+    uint8_t lastControlSetup[MOCK_CONTROL_SETUP_SIZE];
+    uint8_t lastControlData[MOCK_MAX_REPORT_SIZE];
+    int lastControlLength;
+    uint32_t claimedInterfaces; // by any handle
+};
+
+struct libusb_device_handle {
+    libusb_device *device;
+    uint32_t claimedInterfaces;
+};
+
+typedef struct _MockTransfer {
+    bool inFlight;
+    bool cancelled;
+    struct libusb_transfer transfer; // has to stay last, iso packet descriptors follow it
+} MockTransfer;
+
+static pthread_mutex_t mock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mock_cond;
+static pthread_once_t mock_once = PTHREAD_ONCE_INIT;
+
+static libusb_device *devices[MOCK_MAX_DEVICES];
+static int device_count = 0;
+static uint8_t next_address = 1;
+static MockTransfer *in_flight[MOCK_MAX_TRANSFERS];
+static int in_flight_count = 0;
+static bool drop_unclaimed = false;
+static uint32_t control_delay_usec = 0;
+static OIHostMockStats stats = { 0 };
+
+static void MockInit() {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mock_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void Lock() {
+    pthread_once(&mock_once, MockInit);
+    pthread_mutex_lock(&mock_mutex);
+}
+
+static void Unlock() {
+    pthread_mutex_unlock(&mock_mutex);
+}
+
+static MockTransfer *GetMockTransfer(struct libusb_transfer *transfer) {
+    return (MockTransfer *)((uint8_t *)transfer - offsetof(MockTransfer, transfer));
+}
+
+static int WaitingTransfers(libusb_device *device, uint8_t endpoint) {
+    int waiting = 0;
+    for (int i = 0; i < in_flight_count; i++) {
+        struct libusb_transfer *transfer = &in_flight[i]->transfer;
+        if (!in_flight[i]->cancelled && transfer->type == LIBUSB_TRANSFER_TYPE_INTERRUPT &&
+            transfer->dev_handle->device == device && transfer->endpoint == endpoint)
+            waiting++;
+    }
+    return waiting;
+}
+
+libusb_device *OIHostMockAddDevice(const OIHostMockDeviceInfo *info) {
+    Lock();
+    libusb_device *device = NULL;
+    if (device_count < MOCK_MAX_DEVICES) {
+        device = calloc(1, sizeof(libusb_device));
+        device->present = true;
+        device->busNumber = 1;
+        device->deviceAddress = next_address;
+        next_address = (next_address % 127) + 1;
+        device->info = *info;
+        if (device->info.numInterfaces == 0)
+            device->info.numInterfaces = 1;
+        devices[device_count++] = device;
+    }
+    pthread_cond_broadcast(&mock_cond);
+    Unlock();
+    return device;
+}
+
+#ifdef __SANITIZE_ADDRESS__
+// unplugged devices are never freed, see below, so leak checking in the sanitizer build would only ever find those
+const char *__asan_default_options() {
+    return "detect_leaks=0";
+}
+#endif
+
+// the struct itself is left alone, the plugin might still be holding on to it
+void OIHostMockRemoveDevice(libusb_device *device) {
+    Lock();
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i] == device) {
+            devices[i] = devices[--device_count];
+            break;
+        }
+    }
+    device->present = false;
+    for (int i = 0; i < MOCK_ENDPOINT_COUNT; i++) {
+        device->queues[i].count = 0;
+        device->sent[i].count = 0;
+    }
+    pthread_cond_broadcast(&mock_cond);
+    Unlock();
+}
+
+// called with the lock held
+static void PushReport(MockReportQueue *queue, const uint8_t *report, int length) {
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity > 0 ? queue->capacity * 2 : 64;
+        MockReport *reports = malloc(capacity * sizeof(MockReport));
+        for (int i = 0; i < queue->count; i++)
+            reports[i] = queue->reports[(queue->head + i) % queue->capacity];
+        free(queue->reports);
+        queue->reports = reports;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    MockReport *queued = &queue->reports[(queue->head + queue->count) % queue->capacity];
+    queued->length = length < MOCK_MAX_REPORT_SIZE ? length : MOCK_MAX_REPORT_SIZE;
+    memcpy(queued->data, report, queued->length);
+    queue->count++;
+}
+
+// called with the lock held, takes the oldest report queued on an IN endpoint and returns its length
+static int PopReport(MockReportQueue *queue, uint8_t *data, int max_length) {
+    MockReport *report = &queue->reports[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    int length = report->length < max_length ? report->length : max_length;
+    memcpy(data, report->data, length);
+    stats.reportsDelivered++;
+    return length;
+}
+
+// called with the lock held. a wireless adapter answers the question of what's on a slot with a link message,
+// then an announce from the controller if there is one
+static void AnswerWirelessInquiry(libusb_device *device, uint8_t endpoint, const uint8_t *data, int length) {
+    static const uint8_t inquiry[] = XINPUT_WIRELESS_INQUIRY;
+    int slot = (endpoint - 1) / 2;
+    if (length < (int)sizeof(inquiry) || memcmp(data, inquiry, sizeof(inquiry)) != 0 || slot >= OI_HOST_MOCK_WIRELESS_SLOTS)
+        return;
+    uint8_t subtype = device->info.wirelessSubtypes[slot];
+    MockReportQueue *queue = &device->queues[(0x81 + slot * 2) % MOCK_ENDPOINT_COUNT];
+    const uint8_t link[] = { XINPUT_WIRELESS_LINK, subtype != 0 ? XINPUT_WIRELESS_LINK_CONTROLLER : 0x00 };
+    PushReport(queue, link, sizeof(link));
+    if (subtype != 0) {
+        uint8_t announce[MOCK_WIRELESS_ANNOUNCE_SIZE] = { 0x00, XINPUT_WIRELESS_ANNOUNCE, 0x00, 0xF0, 0xF0, 0xCC };
+        announce[XINPUT_WIRELESS_ANNOUNCE_SUBTYPE] = subtype;
+        PushReport(queue, announce, sizeof(announce));
+    }
+    pthread_cond_broadcast(&mock_cond);
+}
+
+// called with the lock held, the device takes whatever's sent to it straight away, only the latest are kept for looking at
+static void SendReport(libusb_device *device, uint8_t endpoint, const uint8_t *data, int length) {
+    MockReportQueue *sent = &device->sent[endpoint % MOCK_ENDPOINT_COUNT];
+    if (sent->count == MOCK_MAX_SENT_REPORTS) {
+        sent->head = (sent->head + 1) % sent->capacity;
+        sent->count--;
+    }
+    PushReport(sent, data, length);
+    stats.reportsSent++;
+    AnswerWirelessInquiry(device, endpoint, data, length);
+}
+
+void OIHostMockQueueReport(libusb_device *device, uint8_t endpoint, const uint8_t *report, int length) {
+    Lock();
+    MockReportQueue *queue = &device->queues[endpoint % MOCK_ENDPOINT_COUNT];
+    // each waiting transfer takes one report, one already spoken for by a queued report isn't waiting
+    if (!device->present || (drop_unclaimed && queue->count >= WaitingTransfers(device, endpoint))) {
+        stats.reportsDropped++;
+        Unlock();
+        return;
+    }
+    PushReport(queue, report, length);
+    pthread_cond_broadcast(&mock_cond);
+    Unlock();
+}
+
+int OIHostMockTakeSentReport(libusb_device *device, uint8_t endpoint, uint8_t *data, int max_length) {
+    Lock();
+    MockReportQueue *queue = &device->sent[endpoint % MOCK_ENDPOINT_COUNT];
+    int length = -1;
+    if (queue->count > 0) {
+        MockReport *report = &queue->reports[queue->head];
+        length = report->length;
+        memcpy(data, report->data, length < max_length ? length : max_length);
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    Unlock();
+    return length;
+}
+
+void OIHostMockSetDropUnclaimedReports(bool drop) {
+    Lock();
+    drop_unclaimed = drop;
+    Unlock();
+}
+
+void OIHostMockSetControlDelay(uint32_t usec) {
+    Lock();
+    control_delay_usec = usec;
+    Unlock();
+}
+
+int OIHostMockPendingReports(libusb_device *device, uint8_t endpoint) {
+    Lock();
+    int count = device->queues[endpoint % MOCK_ENDPOINT_COUNT].count;
+    Unlock();
+    return count;
+}
+
+int OIHostMockLastControlTransfer(libusb_device *device, uint8_t *setup, uint8_t *data, int max_length) {
+    Lock();
+    int length = device->lastControlLength;
+    if (setup != NULL)
+        memcpy(setup, device->lastControlSetup, MOCK_CONTROL_SETUP_SIZE);
+    if (data != NULL)
+        memcpy(data, device->lastControlData, length < max_length ? length : max_length);
+    Unlock();
+    return length;
+}
+
+void OIHostMockGetStats(OIHostMockStats *out) {
+    Lock();
+    *out = stats;
+    out->transfersInFlight = in_flight_count;
+    Unlock();
+}
+
+void OIHostMockReset() {
+    Lock();
+    for (int i = 0; i < device_count; i++)
+        devices[i]->present = false;
+    device_count = 0;
+    in_flight_count = 0;
+    next_address = 1;
+    drop_unclaimed = false;
+    memset(&stats, 0, sizeof(stats));
+    Unlock();
+}
+
+int sceUsbdInit() {
+    return 0;
+}
+
+int sceUsbdExit() {
+    return 0;
+}
+
+int sceUsbdGetDeviceList(libusb_device ***list) {
+    Lock();
+    stats.deviceListCalls++;
+    stats.deviceListsOpen++;
+    *list = calloc(device_count + 1, sizeof(libusb_device *));
+    memcpy(*list, devices, device_count * sizeof(libusb_device *));
+    int count = device_count;
+    Unlock();
+    return count;
+}
+
+int sceUsbdFreeDeviceList(libusb_device **list) {
+    if (list == NULL)
+        return 0;
+    Lock();
+    stats.deviceListsOpen--;
+    Unlock();
+    free(list);
+    return 0;
+}
+
+uint8_t sceUsbdGetBusNumber(libusb_device *dev) {
+    return dev->busNumber;
+}
+
+uint8_t sceUsbdGetDeviceAddress(libusb_device *dev) {
+    return dev->deviceAddress;
+}
+
+int sceUsbdGetDeviceDescriptor(libusb_device *dev, struct libusb_device_descriptor *desc) {
+    Lock();
+    stats.descriptorReads++;
+    Unlock();
+    memset(desc, 0, sizeof(struct libusb_device_descriptor));
+    desc->bLength = 18;
+    desc->bDescriptorType = 0x01;
+    desc->bcdUSB = 0x0200;
+    desc->bDeviceClass = dev->info.deviceClass;
+    desc->bDeviceSubClass = dev->info.deviceClass;
+    desc->bDeviceProtocol = dev->info.deviceClass;
+    desc->bMaxPacketSize0 = 64;
+    desc->idVendor = dev->info.vendorId;
+    desc->idProduct = dev->info.productId;
+    desc->bNumConfigurations = 1;
+    return 0;
+}
+
+// everything is allocated in one block, so sceUsbdFreeConfigDescriptor is a single free
+int sceUsbdGetConfigDescriptor(libusb_device *dev, uint8_t config_index, struct libusb_config_descriptor **config) {
+    int num_interfaces = dev->info.numInterfaces;
+    size_t size = sizeof(struct libusb_config_descriptor) +
+        num_interfaces * (sizeof(struct libusb_interface) + sizeof(struct libusb_interface_descriptor) + MOCK_XINPUT_DESCRIPTOR_SIZE);
+    uint8_t *block = calloc(1, size);
+    struct libusb_config_descriptor *desc = (struct libusb_config_descriptor *)block;
+    struct libusb_interface *interfaces = (struct libusb_interface *)(desc + 1);
+    struct libusb_interface_descriptor *altsettings = (struct libusb_interface_descriptor *)(interfaces + num_interfaces);
+    uint8_t *extra = (uint8_t *)(altsettings + num_interfaces);
+
+    desc->bLength = 9;
+    desc->bDescriptorType = 0x02;
+    desc->bNumInterfaces = num_interfaces;
+    desc->bConfigurationValue = 1;
+    desc->interface = interfaces;
+    for (int i = 0; i < num_interfaces; i++) {
+        interfaces[i].altsetting = &altsettings[i];
+        interfaces[i].num_altsetting = 1;
+        altsettings[i].bLength = 9;
+        altsettings[i].bDescriptorType = 0x04;
+        altsettings[i].bInterfaceNumber = i;
+        altsettings[i].bNumEndpoints = 2;
+        altsettings[i].bInterfaceClass = dev->info.interfaceClass;
+        altsettings[i].bInterfaceSubClass = dev->info.interfaceSubClass;
+        if (dev->info.xinputSubtype != 0) {
+            uint8_t *xinput = extra + i * MOCK_XINPUT_DESCRIPTOR_SIZE;
+            xinput[0] = MOCK_XINPUT_DESCRIPTOR_SIZE;
+            xinput[1] = 0x21;
+            xinput[2] = 0x00;
+            xinput[3] = 0x01;
+            xinput[4] = dev->info.xinputSubtype;
+            altsettings[i].extra = xinput;
+            altsettings[i].extra_length = MOCK_XINPUT_DESCRIPTOR_SIZE;
+        }
+    }
+    *config = desc;
+    return 0;
+}
+
+int sceUsbdFreeConfigDescriptor(struct libusb_config_descriptor *config) {
+    free(config);
+    return 0;
+}
+
+int sceUsbdOpen(libusb_device *dev, libusb_device_handle **dev_handle) {
+    Lock();
+    if (!dev->present) {
+        Unlock();
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    *dev_handle = calloc(1, sizeof(libusb_device_handle));
+    (*dev_handle)->device = dev;
+    stats.devicesOpen++;
+    Unlock();
+    return 0;
+}
+
+void sceUsbdClose(libusb_device_handle *dev_handle) {
+    Lock();
+    dev_handle->device->claimedInterfaces &= ~dev_handle->claimedInterfaces;
+    stats.devicesOpen--;
+    Unlock();
+    free(dev_handle);
+}
+
+libusb_device *sceUsbdGetDevice(libusb_device_handle *dev_handle) {
+    return dev_handle->device;
+}
+
+int sceUsbdClaimInterface(libusb_device_handle *dev_handle, int interface_number) {
+    libusb_device *device = dev_handle->device;
+    int r = 0;
+    Lock();
+    if (!device->present)
+        r = LIBUSB_ERROR_NO_DEVICE;
+    else if (interface_number < 0 || interface_number >= device->info.numInterfaces)
+        r = LIBUSB_ERROR_NOT_FOUND;
+    else if (device->claimedInterfaces & (1 << interface_number))
+        r = LIBUSB_ERROR_BUSY;
+    else {
+        device->claimedInterfaces |= 1 << interface_number;
+        dev_handle->claimedInterfaces |= 1 << interface_number;
+    }
+    Unlock();
+    return r;
+}
+
+int sceUsbdReleaseInterface(libusb_device_handle *dev_handle, int interface_number) {
+    libusb_device *device = dev_handle->device;
+    int r = 0;
+    Lock();
+    if (interface_number < 0 || interface_number >= 32 || !(dev_handle->claimedInterfaces & (1 << interface_number))) {
+        r = LIBUSB_ERROR_NOT_FOUND;
+    } else {
+        device->claimedInterfaces &= ~(1 << interface_number);
+        dev_handle->claimedInterfaces &= ~(1 << interface_number);
+    }
+    Unlock();
+    return r;
+}
+
+static void RecordControlTransfer(libusb_device *device, const uint8_t *setup, const uint8_t *data, int length) {
+    memcpy(device->lastControlSetup, setup, MOCK_CONTROL_SETUP_SIZE);
+    device->lastControlLength = length < MOCK_MAX_REPORT_SIZE ? length : MOCK_MAX_REPORT_SIZE;
+    memcpy(device->lastControlData, data, device->lastControlLength);
+    stats.controlTransfers++;
+}
+
+int sceUsbdControlTransfer(libusb_device_handle *dev_handle, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout) {
+    uint8_t setup[MOCK_CONTROL_SETUP_SIZE];
+    sceUsbdFillControlSetup(setup, bmRequestType, bRequest, wValue, wIndex, wLength);
+    Lock();
+    if (!dev_handle->device->present) {
+        Unlock();
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    RecordControlTransfer(dev_handle->device, setup, data, wLength);
+    uint32_t delay = control_delay_usec;
+    Unlock();
+    if (delay > 0)
+        usleep(delay);
+    return wLength;
+}
+
+// the same queues the asynchronous transfers use, timeout is in milliseconds and 0 waits for as long as it takes
+int sceUsbdInterruptTransfer(libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout) {
+    libusb_device *device = dev_handle->device;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    int r = 0;
+    *transferred = 0;
+    Lock();
+    MockReportQueue *queue = &device->queues[endpoint % MOCK_ENDPOINT_COUNT];
+    while ((endpoint & 0x80) != 0 && device->present && queue->count == 0 && r == 0) {
+        if (timeout == 0)
+            pthread_cond_wait(&mock_cond, &mock_mutex);
+        else if (pthread_cond_timedwait(&mock_cond, &mock_mutex, &deadline) == ETIMEDOUT)
+            r = LIBUSB_ERROR_TIMEOUT;
+    }
+    if (!device->present) {
+        r = LIBUSB_ERROR_NO_DEVICE;
+    } else if ((endpoint & 0x80) == 0) {
+        SendReport(device, endpoint, data, length);
+        *transferred = length;
+    } else if (queue->count > 0) {
+        *transferred = PopReport(queue, data, length);
+        r = 0;
+    }
+    Unlock();
+    return r;
+}
+
+struct libusb_transfer *sceUsbdAllocTransfer(int iso_packets) {
+    MockTransfer *mock = calloc(1, sizeof(MockTransfer) + iso_packets * sizeof(struct libusb_iso_packet_descriptor));
+    mock->transfer.num_iso_packets = iso_packets;
+    Lock();
+    stats.transfersAllocated++;
+    Unlock();
+    return &mock->transfer;
+}
+
+void sceUsbdFreeTransfer(struct libusb_transfer *transfer) {
+    if (transfer == NULL)
+        return;
+    Lock();
+    stats.transfersAllocated--;
+    Unlock();
+    free(GetMockTransfer(transfer));
+}
+
+int sceUsbdSubmitTransfer(struct libusb_transfer *transfer) {
+    MockTransfer *mock = GetMockTransfer(transfer);
+    Lock();
+    int r = 0;
+    if (mock->inFlight)
+        r = LIBUSB_ERROR_BUSY;
+    else if (!transfer->dev_handle->device->present)
+        r = LIBUSB_ERROR_NO_DEVICE;
+    else if (in_flight_count >= MOCK_MAX_TRANSFERS)
+        r = LIBUSB_ERROR_BUSY;
+    if (r == 0) {
+        mock->inFlight = true;
+        mock->cancelled = false;
+        in_flight[in_flight_count++] = mock;
+        pthread_cond_broadcast(&mock_cond);
+    }
+    Unlock();
+    return r;
+}
+
+int sceUsbdCancelTransfer(struct libusb_transfer *transfer) {
+    MockTransfer *mock = GetMockTransfer(transfer);
+    Lock();
+    int r = LIBUSB_ERROR_NOT_FOUND;
+    if (mock->inFlight && !mock->cancelled) {
+        mock->cancelled = true;
+        pthread_cond_broadcast(&mock_cond);
+        r = 0;
+    }
+    Unlock();
+    return r;
+}
+
+void sceUsbdFillControlSetup(unsigned char *buffer, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+    buffer[0] = bmRequestType;
+    buffer[1] = bRequest;
+    buffer[2] = wValue & 0xFF;
+    buffer[3] = wValue >> 8;
+    buffer[4] = wIndex & 0xFF;
+    buffer[5] = wIndex >> 8;
+    buffer[6] = wLength & 0xFF;
+    buffer[7] = wLength >> 8;
+}
+
+void sceUsbdFillControlTransfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char *buffer, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout) {
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = 0;
+    transfer->type = LIBUSB_TRANSFER_TYPE_CONTROL;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = MOCK_CONTROL_SETUP_SIZE + (buffer[6] | (buffer[7] << 8));
+    transfer->callback = callback;
+    transfer->user_data = user_data;
+}
+
+void sceUsbdFillInterruptTransfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout) {
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = endpoint;
+    transfer->type = LIBUSB_TRANSFER_TYPE_INTERRUPT;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = length;
+    transfer->callback = callback;
+    transfer->user_data = user_data;
+}
+
+// works out how a transfer would finish right now, false if it's still waiting
+static bool CompleteTransfer(MockTransfer *mock) {
+    struct libusb_transfer *transfer = &mock->transfer;
+    libusb_device *device = transfer->dev_handle->device;
+    if (mock->cancelled) {
+        transfer->status = LIBUSB_TRANSFER_CANCELLED;
+        transfer->actual_length = 0;
+    } else if (!device->present) {
+        transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+        transfer->actual_length = 0;
+    } else if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL) {
+        RecordControlTransfer(device, transfer->buffer, transfer->buffer + MOCK_CONTROL_SETUP_SIZE, transfer->length - MOCK_CONTROL_SETUP_SIZE);
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = transfer->length - MOCK_CONTROL_SETUP_SIZE;
+    } else if ((transfer->endpoint & 0x80) == 0) {
+        SendReport(device, transfer->endpoint, transfer->buffer, transfer->length);
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = transfer->length;
+    } else {
+        MockReportQueue *queue = &device->queues[transfer->endpoint % MOCK_ENDPOINT_COUNT];
+        if (queue->count == 0)
+            return false;
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = PopReport(queue, transfer->buffer, transfer->length);
+    }
+    return true;
+}
+
+bool OIHostMockCompleteTransfer(libusb_device *device, uint8_t endpoint, const uint8_t *report, int length) {
+    MockTransfer *mock = NULL;
+    Lock();
+    for (int i = 0; i < in_flight_count; i++) {
+        struct libusb_transfer *transfer = &in_flight[i]->transfer;
+        if (!in_flight[i]->cancelled && transfer->type == LIBUSB_TRANSFER_TYPE_INTERRUPT &&
+            transfer->dev_handle->device == device && transfer->endpoint == endpoint) {
+            mock = in_flight[i];
+            memmove(&in_flight[i], &in_flight[i + 1], (in_flight_count - i - 1) * sizeof(MockTransfer *));
+            in_flight_count--;
+            break;
+        }
+    }
+    if (mock != NULL) {
+        struct libusb_transfer *transfer = &mock->transfer;
+        mock->inFlight = false;
+        transfer->actual_length = length < transfer->length ? length : transfer->length;
+        memcpy(transfer->buffer, report, transfer->actual_length);
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        stats.reportsDelivered++;
+        stats.transfersCompleted++;
+    }
+    Unlock();
+    if (mock == NULL)
+        return false;
+    mock->transfer.callback(&mock->transfer);
+    return true;
+}
+
+int sceUsbdHandleEventsTimeout(struct timeval *tv) {
+    MockTransfer *completed[MOCK_MAX_TRANSFERS];
+    int completed_count = 0;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (tv != NULL) {
+        deadline.tv_sec += tv->tv_sec;
+        deadline.tv_nsec += tv->tv_usec * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    Lock();
+    for (;;) {
+        // finish everything that can finish, in the order it was submitted
+        for (int i = 0; i < in_flight_count; i++) {
+            if (CompleteTransfer(in_flight[i])) {
+                in_flight[i]->inFlight = false;
+                completed[completed_count++] = in_flight[i];
+                memmove(&in_flight[i], &in_flight[i + 1], (in_flight_count - i - 1) * sizeof(MockTransfer *));
+                in_flight_count--;
+                i--;
+            }
+        }
+        if (completed_count > 0 || tv == NULL)
+            break;
+        if (pthread_cond_timedwait(&mock_cond, &mock_mutex, &deadline) == ETIMEDOUT)
+            break;
+    }
+    stats.transfersCompleted += completed_count;
+    Unlock();
+
+    for (int i = 0; i < completed_count; i++)
+        completed[i]->transfer.callback(&completed[i]->transfer);
+    return 0;
+}
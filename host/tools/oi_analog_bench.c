@@ -0,0 +1,123 @@
+/*
+    oi_analog_bench.c - OrbisInstrumentalizer host build
+    Times the whammy/tilt stage per report and checks it stays inside what a transfer callback can afford.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "OIAnalog.h"
+
+#define DEFAULT_REPORTS 10000000
+// the most a report's whammy and tilt together may take, well under the ~1ms between reports
+#define BUDGET_NS 250
+#define REPORT_INTERVAL_USEC 1000
+
+static const OIAnalogConfig whammy_config = {
+    .min_span = 16384, .deadzone = 2048, .filter = false
+};
+static const OIAnalogConfig tilt_config = {
+    .min_span = 16384, .deadzone = 2048, .filter = true,
+    .min_cutoff = 1000, .beta = 3000, .derivative_cutoff = 1000
+};
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool Check(bool ok, const char *what) {
+    if (!ok)
+        printf("FAIL: %s\n", what);
+    return ok;
+}
+
+// behaviour a guitar would notice, run before timing anything
+static bool CheckMapping() {
+    bool ok = true;
+    OIAnalogAxis axis;
+    OIAnalogInit(&axis, &whammy_config);
+    // a 360 whammy rests at the bottom of the stick and only goes part of the way up
+    ok &= Check(OIAnalogProcess(&axis, -32768, 0) == 0, "whammy at rest reads 0");
+    ok &= Check(OIAnalogProcess(&axis, -32768 + 200, 1000) == 0, "jitter at rest stays in the deadzone");
+    OIAnalogProcess(&axis, 12000, 2000);
+    ok &= Check(OIAnalogProcess(&axis, 12000, 3000) == 255, "the furthest the whammy's been reads 255");
+    ok &= Check(OIAnalogProcess(&axis, -32768, 4000) == 0, "released whammy reads 0 again");
+    uint8_t last = 0;
+    for (int32_t raw = -32768; raw <= 12000; raw += 64) {
+        uint8_t value = OIAnalogProcess(&axis, raw, 5000);
+        if (value < last) {
+            ok &= Check(false, "mapping only goes up");
+            break;
+        }
+        last = value;
+    }
+
+    // a tilt sensor's noise should get smoothed at rest, a real tilt shouldn't lag behind
+    OIAnalogInit(&axis, &tilt_config);
+    OIAnalogProcess(&axis, 0, 0);
+    OIAnalogProcess(&axis, 20000, 1000);
+    uint32_t state = 1;
+    int spread_min = 255, spread_max = 0;
+    uint64_t time = 2000;
+    for (int i = 0; i < 2000; i++, time += REPORT_INTERVAL_USEC) {
+        state = state * 1664525 + 1013904223;
+        int value = OIAnalogProcess(&axis, 10000 + (int32_t)(state >> 22) - 512, time);
+        if (i >= 1000) {
+            spread_min = value < spread_min ? value : spread_min;
+            spread_max = value > spread_max ? value : spread_max;
+        }
+    }
+    ok &= Check(spread_max - spread_min <= 2, "tilt noise at rest is smoothed out");
+    int reports = 0;
+    while (OIAnalogProcess(&axis, 20000, time) < 250 && reports < 100) {
+        reports++;
+        time += REPORT_INTERVAL_USEC;
+    }
+    ok &= Check(reports <= 20, "a full tilt gets through within 20 reports");
+    printf("tilt at rest wanders %i, full tilt takes %i reports\n", spread_max - spread_min, reports);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_REPORTS;
+    if (!CheckMapping())
+        return 1;
+
+    // made up ahead of time so the timing is only the stage itself
+    int16_t *whammy = malloc(count * sizeof(int16_t));
+    int16_t *tilt = malloc(count * sizeof(int16_t));
+    uint32_t state = 0x12345678;
+    for (int i = 0; i < count; i++) {
+        state = state * 1664525 + 1013904223;
+        whammy[i] = (int16_t)(state >> 16);
+        tilt[i] = (int16_t)((state >> 8) & 0x7FFF);
+    }
+
+    OIAnalogAxis whammy_axis, tilt_axis;
+    OIAnalogInit(&whammy_axis, &whammy_config);
+    OIAnalogInit(&tilt_axis, &tilt_config);
+    uint32_t sink = 0;
+    uint64_t start = NowNanoseconds();
+    for (int i = 0; i < count; i++) {
+        uint64_t time = (uint64_t)i * REPORT_INTERVAL_USEC;
+        sink += OIAnalogProcess(&whammy_axis, whammy[i], time);
+        sink += OIAnalogProcess(&tilt_axis, tilt[i], time);
+    }
+    uint64_t elapsed = NowNanoseconds() - start;
+    double per_report = (double)elapsed / count;
+    free(whammy);
+    free(tilt);
+
+    printf("%i reports, %.1f ns/report for whammy and tilt (budget %i ns, checksum %08x)\n", count, per_report, BUDGET_NS, sink);
+    if (per_report > BUDGET_NS) {
+        printf("FAIL: over budget\n");
+        return 1;
+    }
+    return 0;
+}
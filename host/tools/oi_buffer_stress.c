@@ -0,0 +1,178 @@
+/*
+    oi_buffer_stress.c - OrbisInstrumentalizer host build
+    Hammers OIReportBuffer and OIPadHistory from a writer and a reader thread with numbered reports,
+    and fails if the reader ever sees one half-written or out of order.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "OIReportBuffer.h"
+#include "OIPadHistory.h"
+
+#define DEFAULT_SECONDS 3
+#define MAX_REPORTED_FAILURES 8
+// the reader takes anywhere from 1 to this many states at once, like a game calling scePadRead
+#define MAX_BATCH OI_PAD_HISTORY_SIZE
+
+static atomic_bool writing;
+static atomic_ullong written;
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// every byte of a report depends on its number, so one put together from two writes can't match either
+static uint8_t StampByte(uint64_t sequence, int i) {
+    return (uint8_t)((sequence >> ((i % 8) * 8)) ^ (i * 0x9D));
+}
+
+static int StampLength(uint64_t sequence) {
+    return 8 + sequence % (OI_REPORT_MAX_SIZE - 8 + 1);
+}
+
+static OIPadState StampState(uint64_t sequence) {
+    OIPadState state = {
+        .buttons = (uint32_t)sequence,
+        .left_stick_y = (uint8_t)(sequence >> 32),
+        .right_stick_x = (uint8_t)(sequence * 3),
+        .right_stick_y = (uint8_t)~sequence,
+        .count = (uint8_t)(sequence * 7)
+    };
+    return state;
+}
+
+// On one core the two only take turns when the writer is preempted, which can be halfway through a write.
+// So only the reader ever yields, after every 1024 reads, and the writer never gives its place up at a tidy point.
+#define READS_PER_YIELD 1024
+
+// OIReportBuffer, the reader only ever wants the latest report
+
+static OIReportBuffer report_buffer;
+
+static void *ReportWriter(void *unused) {
+    uint8_t report[OI_REPORT_MAX_SIZE];
+    uint64_t sequence = 1;
+    while (atomic_load_explicit(&writing, memory_order_relaxed)) {
+        int length = StampLength(sequence);
+        for (int i = 0; i < length; i++)
+            report[i] = StampByte(sequence, i);
+        OIReportBufferWrite(&report_buffer, report, length, sequence);
+        sequence++;
+    }
+    atomic_store(&written, sequence - 1);
+    return NULL;
+}
+
+static bool CheckReportBuffer(int seconds) {
+    OIReportBufferInit(&report_buffer);
+    atomic_store(&writing, true);
+    pthread_t writer;
+    pthread_create(&writer, NULL, ReportWriter, NULL);
+
+    uint64_t reads = 0, fresh_reads = 0, last = 0;
+    int failures = 0;
+    uint64_t end = NowNanoseconds() + (uint64_t)seconds * 1000000000;
+    while (NowNanoseconds() < end) {
+        for (int n = 0; n < READS_PER_YIELD; n++, reads++) {
+            int length;
+            bool fresh;
+            uint64_t sequence;
+            const uint8_t *report = OIReportBufferRead(&report_buffer, &length, &fresh, &sequence);
+            if (sequence == 0) // nothing written yet
+                continue;
+            bool torn = length != StampLength(sequence);
+            for (int i = 0; i < length && !torn; i++)
+                torn = report[i] != StampByte(sequence, i);
+            if (torn && failures++ < MAX_REPORTED_FAILURES)
+                printf("FAIL: report %lu came back torn\n", sequence);
+            // a fresh report is always newer, otherwise it's the same one again
+            if ((fresh ? sequence <= last : sequence != last) && failures++ < MAX_REPORTED_FAILURES)
+                printf("FAIL: report %lu read after %lu, fresh %i\n", sequence, last, fresh);
+            fresh_reads += fresh;
+            last = sequence;
+        }
+        sched_yield();
+    }
+    atomic_store(&writing, false);
+    pthread_join(writer, NULL);
+    printf("OIReportBuffer: %lu reports written, %lu reads, %lu fresh: %s\n", (uint64_t)atomic_load(&written),
+        reads, fresh_reads, failures == 0 ? "ok" : "FAILED");
+    return failures == 0;
+}
+
+// OIPadHistory, the reader wants everything since its last read, oldest first
+
+static OIPadHistory pad_history;
+
+static void *HistoryWriter(void *unused) {
+    uint64_t sequence = 1;
+    while (atomic_load_explicit(&writing, memory_order_relaxed)) {
+        OIPadHistoryWrite(&pad_history, StampState(sequence), sequence);
+        sequence++;
+    }
+    atomic_store(&written, sequence - 1);
+    return NULL;
+}
+
+// checks a batch is whole states, each newer than the last, and returns how many there were
+static int CheckHistoryBatch(int max, uint64_t *last, int *failures) {
+    OIPadState states[MAX_BATCH];
+    uint64_t sequences[MAX_BATCH];
+    int read = OIPadHistoryRead(&pad_history, states, sequences, max);
+    for (int i = 0; i < read; i++) {
+        if (states[i].packed != StampState(sequences[i]).packed && (*failures)++ < MAX_REPORTED_FAILURES)
+            printf("FAIL: state %lu came back torn\n", sequences[i]);
+        if (sequences[i] <= *last && (*failures)++ < MAX_REPORTED_FAILURES)
+            printf("FAIL: state %lu read after %lu\n", sequences[i], *last);
+        *last = sequences[i];
+    }
+    return read;
+}
+
+static bool CheckPadHistory(int seconds) {
+    OIPadHistoryInit(&pad_history);
+    atomic_store(&writing, true);
+    pthread_t writer;
+    pthread_create(&writer, NULL, HistoryWriter, NULL);
+
+    uint64_t reads = 0, received = 0, last = 0;
+    int failures = 0;
+    uint64_t end = NowNanoseconds() + (uint64_t)seconds * 1000000000;
+    while (NowNanoseconds() < end) {
+        for (int n = 0; n < READS_PER_YIELD; n++, reads++)
+            received += CheckHistoryBatch(1 + rand() % MAX_BATCH, &last, &failures);
+        sched_yield();
+    }
+    atomic_store(&writing, false);
+    pthread_join(writer, NULL);
+    // whatever's left, so every state written is either read or counted as dropped
+    while (atomic_load(&pad_history.head) != pad_history.tail)
+        received += CheckHistoryBatch(MAX_BATCH, &last, &failures);
+
+    uint64_t total = atomic_load(&written);
+    // head wraps at 32 bits, the reader's count of what it missed does too
+    if ((uint32_t)(received + pad_history.dropped) != (uint32_t)total && failures++ < MAX_REPORTED_FAILURES)
+        printf("FAIL: %lu states written, but %lu read and %u dropped\n", total, received, pad_history.dropped);
+    printf("OIPadHistory: %lu states written, %lu reads, %lu states read, %u dropped: %s\n", total, reads, received,
+        pad_history.dropped, failures == 0 ? "ok" : "FAILED");
+    return failures == 0;
+}
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+    srand(2);
+    bool ok = CheckReportBuffer(seconds);
+    ok &= CheckPadHistory(seconds);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/*
+    oi_config_check.c - OrbisInstrumentalizer host build
+    Feeds the settings parser good, broken and random files, and checks what the drivers end up doing with them.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OIConfig.h"
+#include "OIDriver.h"
+#include "OrbisPadTypes.h"
+#include "xinput.h"
+
+#define DEFAULT_ITERATIONS 200000
+// every so often a fuzzed file goes all the way through loading and into the drivers' tables
+#define LOAD_EVERY 1000
+
+static const char good_config[] =
+    "; strum with the other hand\r\n"
+    "[GHL_PS3]\r\n"
+    "button.b1 = b2\r\n"
+    "  Button.GHTV = none   # never want that\n"
+    "whammy.invert = yes\n"
+    "tilt.deadzone = 20\n"
+    "tilt.scale = 150\n"
+    "\n"
+    "[xbox360_guitar]\n"
+    "button.up = down\n"
+    "button.up = left ; the later one wins\n"
+    "button.green = kick2\n"
+    "whammy.scale = 50";
+
+// each one has to be skipped whole, leaving the defaults alone
+typedef struct _MalformedCase {
+    const char *text;
+    int length; // 0 for strlen, so a case can have a NUL in it
+    int skipped;
+} MalformedCase;
+
+static const MalformedCase malformed_cases[] = {
+    { "button.b1 = b2", 0, 1 }, // before any section
+    { "[wiirb]\nbutton.b1 = b2", 0, 2 }, // Wii instruments don't have settings
+    { "[nonsense]\nwhammy.invert = yes\n[ghl_ps3", 0, 3 },
+    { "[ghl_ps3]x\nwhammy.invert = yes", 0, 2 },
+    { "[]\nwhammy.invert = yes", 0, 2 },
+    { "[ghl_ps3]\nbutton.b1", 0, 1 },
+    { "[ghl_ps3]\nbutton = b1", 0, 1 },
+    { "[ghl_ps3]\n= b1", 0, 1 },
+    { "[ghl_ps3]\nbutton.green = b1", 0, 1 },
+    { "[ghl_ps3]\nbutton.b1 = green", 0, 1 },
+    { "[ghl_ps3]\nbutton.b1 =", 0, 1 },
+    { "[ghl_ps3]\nstrum.invert = yes", 0, 1 },
+    { "[ghl_ps3]\nwhammy.speed = 3", 0, 1 },
+    { "[ghl_ps3]\nwhammy.deadzone = 255", 0, 1 },
+    { "[ghl_ps3]\nwhammy.deadzone = -1", 0, 1 },
+    { "[ghl_ps3]\nwhammy.deadzone = 0x10", 0, 1 },
+    { "[ghl_ps3]\nwhammy.scale = 401", 0, 1 },
+    { "[ghl_ps3]\nwhammy.scale = 99999999999999999999999", 0, 1 },
+    { "[ghl_ps3]\nwhammy.invert = maybe", 0, 1 },
+    { "[ghl_ps3]\nwhammy.invert = yes please", 0, 1 },
+    { "[xbox360_guitar]\nbutton.up = none", 0, 1 }, // the hat has to point somewhere
+    { "[xbox360_guitar]\nbutton.up = green", 0, 1 },
+    { "[xbox360_guitar]\nbutton.green = up", 0, 1 },
+    { "[ghl_ps3]\nwhammy.deadzone\0 = 3", 31, 1 },
+    { "[ghl_ps3]\n\xFF\xFE\x80=\x01.\x7F", 0, 1 },
+    { "", 0, 0 },
+    { "\n\n\r\n ; nothing but comments\n#\n", 0, 0 },
+};
+#define MALFORMED_CASE_COUNT (int)(sizeof(malformed_cases) / sizeof(malformed_cases[0]))
+
+static bool Check(bool ok, const char *name, const char *what) {
+    if (!ok)
+        printf("FAIL: %s %s\n", name, what);
+    return ok;
+}
+
+static bool IsDefaults(const OIConfig *config) {
+    OIConfig defaults;
+    OIConfigDefaults(&defaults);
+    return memcmp(config, &defaults, sizeof(OIConfig)) == 0;
+}
+
+static int Parse(OIConfig *config, const char *text) {
+    OIConfigDefaults(config);
+    return OIConfigParse(config, text, strlen(text));
+}
+
+static bool CheckGoodConfig() {
+    bool ok = true;
+    OIConfig config;
+    ok &= Check(Parse(&config, good_config) == 0, "good settings", "have nothing skipped");
+
+    const OIConfigDriver *ghl = &config.drivers[OI_Driver_GHL_HID];
+    ok &= Check(ghl->num_remaps == 2, "good settings", "remap two GHL buttons");
+    ok &= Check(ghl->remaps[0].button == OIDriverButtonIndex(OI_Driver_GHL_HID, "b1") &&
+        ghl->remaps[0].target == OIDriverButtonIndex(OI_Driver_GHL_HID, "b2"), "good settings", "remap b1 to b2");
+    ok &= Check(ghl->remaps[1].target == OI_CONFIG_REMAP_NONE, "good settings", "turn off GHTV");
+    ok &= Check(ghl->whammy.invert && ghl->whammy.scale == 100 && ghl->whammy.deadzone == 0, "good settings", "invert GHL whammy");
+    ok &= Check(ghl->tilt.deadzone == 20 && ghl->tilt.scale == 150 && !ghl->tilt.invert, "good settings", "adjust GHL tilt");
+
+    const OIConfigDriver *guitar = &config.drivers[OI_Driver_XInputGuitar];
+    ok &= Check(guitar->num_remaps == 2, "good settings", "remap up once and green once");
+    ok &= Check(guitar->remaps[0].target == OIDriverButtonIndex(OI_Driver_XInputGuitar, "left"), "good settings",
+        "let the later remap win");
+    ok &= Check(guitar->whammy.scale == 50, "good settings", "scale the guitar's whammy");
+    OIConfig defaults;
+    OIConfigDefaults(&defaults);
+    ok &= Check(memcmp(&config.drivers[OI_Driver_GHL_XInput], &defaults.drivers[OI_Driver_GHL_XInput], sizeof(OIConfigDriver)) == 0,
+        "good settings", "leave other drivers alone");
+    return ok;
+}
+
+static bool CheckMalformed() {
+    bool ok = true;
+    for (int i = 0; i < MALFORMED_CASE_COUNT; i++) {
+        const MalformedCase *test = &malformed_cases[i];
+        OIConfig config;
+        OIConfigDefaults(&config);
+        int length = test->length != 0 ? test->length : (int)strlen(test->text);
+        int skipped = OIConfigParse(&config, test->text, length);
+        char name[32];
+        snprintf(name, sizeof(name), "malformed case %i", i);
+        if (!Check(skipped == test->skipped, name, "skips the right number of lines"))
+            printf("      expected %i, got %i\n", test->skipped, skipped);
+        ok &= skipped == test->skipped;
+        ok &= Check(IsDefaults(&config), name, "leaves the defaults alone");
+    }
+
+    // a line too long to hold is skipped without taking the next one with it
+    char long_line[OI_CONFIG_MAX_LINE + 64];
+    int length = snprintf(long_line, sizeof(long_line), "[ghl_ps3]\nwhammy.invert = yes%*s\nwhammy.deadzone = 9",
+        OI_CONFIG_MAX_LINE, "");
+    OIConfig config;
+    OIConfigDefaults(&config);
+    ok &= Check(OIConfigParse(&config, long_line, length) == 1, "long line", "is skipped");
+    ok &= Check(!config.drivers[OI_Driver_GHL_HID].whammy.invert && config.drivers[OI_Driver_GHL_HID].whammy.deadzone == 9,
+        "long line", "doesn't stop the next line being read");
+    return ok;
+}
+
+// whatever the parser makes of a file, the drivers have to be able to use it
+static bool IsUsable(const OIConfig *config) {
+    for (int i = 0; i < OI_Driver_Count; i++) {
+        const OIConfigDriver *driver = &config->drivers[i];
+        if (driver->num_remaps < 0 || driver->num_remaps > OI_CONFIG_MAX_REMAPS)
+            return false;
+        for (int j = 0; j < driver->num_remaps; j++) {
+            if (!OIDriverCanRemap((OIDriverId)i, driver->remaps[j].button, driver->remaps[j].target))
+                return false;
+        }
+        if (driver->whammy.deadzone > 254 || driver->whammy.scale > OI_CONFIG_MAX_SCALE ||
+            driver->tilt.deadzone > 254 || driver->tilt.scale > OI_CONFIG_MAX_SCALE)
+            return false;
+    }
+    return true;
+}
+
+static bool WriteFile(const char *path, const char *text, int length) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+    bool ok = fwrite(text, 1, length, file) == (size_t)length;
+    return fclose(file) == 0 && ok;
+}
+
+static bool DecodeHeld(OIDriverId id, const uint8_t *report, int length, OIDriverInput *input) {
+    OIDriverState state;
+    OIDriverStart(&oi_drivers[id], &state);
+    bool decoded = oi_drivers[id].decode(&state, report, length, 0);
+    *input = state.input;
+    return decoded;
+}
+
+// the settings go from a file on disk into what a decoded report reads as
+static bool CheckLoaded(const char *path) {
+    bool ok = true;
+    ok &= Check(WriteFile(path, good_config, sizeof(good_config) - 1), path, "can be written");
+    ok &= Check(OIConfigLoad(path), path, "is loaded");
+    OIDriversInit();
+
+    OIDriverInput input;
+    // b1 held, whammy at rest, tilt just inside the deadzone
+    uint8_t hid_report[27] = { 0x02, 0x00, 0x08, 0x80, 0x80, 0x80, 0x00 };
+    hid_report[19] = 20;
+    ok &= Check(DecodeHeld(OI_Driver_GHL_HID, hid_report, sizeof(hid_report), &input), "GHL report", "is decoded");
+    ok &= Check((input.translated & (ORBIS_PAD_BUTTON_CROSS | ORBIS_PAD_BUTTON_CIRCLE)) == ORBIS_PAD_BUTTON_CIRCLE,
+        "remapped b1", "reads as b2");
+    ok &= Check(input.whammy == 255, "inverted whammy", "reads as fully pressed at rest");
+    ok &= Check(input.tilt == 0, "tilt deadzone", "reads as level");
+    hid_report[0] = 0x00;
+    hid_report[1] = 0x04;
+    hid_report[6] = 0xFF;
+    hid_report[19] = 200;
+    DecodeHeld(OI_Driver_GHL_HID, hid_report, sizeof(hid_report), &input);
+    ok &= Check((input.translated & ORBIS_PAD_BUTTON_L3) == 0, "GHTV", "does nothing");
+    ok &= Check(input.whammy == 0, "inverted whammy", "reads as at rest when pressed");
+    ok &= Check(input.tilt == 255, "scaled tilt", "tops out");
+
+    // up on the strum bar reads as left, the hat can't be in two places at once
+    uint8_t xinput_report[20] = { 0x00, 0x14, XINPUT_BUTTON_UP, 0x00 };
+    ok &= Check(DecodeHeld(OI_Driver_XInputGuitar, xinput_report, sizeof(xinput_report), &input), "guitar report", "is decoded");
+    ok &= Check((input.translated >> 16) == 0x06, "remapped up", "reads as left");
+    xinput_report[2] = XINPUT_BUTTON_RIGHT;
+    xinput_report[3] = XINPUT_BUTTON_A;
+    DecodeHeld(OI_Driver_XInputGuitar, xinput_report, sizeof(xinput_report), &input);
+    ok &= Check((input.translated >> 16) == 0x02, "right", "is left alone");
+    ok &= Check((input.translated & 0xFFFF) == (1 << 5), "remapped green", "reads as kick 2");
+
+    // a missing file gets the defaults back
+    unlink(path);
+    ok &= Check(!OIConfigLoad(path), path, "isn't there any more");
+    ok &= Check(IsDefaults(OIConfigGet()), "missing file", "leaves the defaults");
+    OIDriversInit();
+    hid_report[0] = 0x02;
+    hid_report[1] = 0x00;
+    DecodeHeld(OI_Driver_GHL_HID, hid_report, sizeof(hid_report), &input);
+    ok &= Check((input.translated & (ORBIS_PAD_BUTTON_CROSS | ORBIS_PAD_BUTTON_CIRCLE)) == ORBIS_PAD_BUTTON_CROSS,
+        "b1", "is back to itself");
+    return ok;
+}
+
+// only whole lines are read from a file that's too big
+static bool CheckOversized(const char *path) {
+    static char text[OI_CONFIG_MAX_SIZE + 256];
+    int length = snprintf(text, sizeof(text), "[ghl_ps3]\nwhammy.deadzone = 5\n");
+    while (length < OI_CONFIG_MAX_SIZE - 8)
+        length += snprintf(text + length, sizeof(text) - length, "; padding\n");
+    // straddles the end of what gets read, so half of it would read as a deadzone of 1
+    length += snprintf(text + length, sizeof(text) - length, "whammy.deadzone = 123\n");
+    bool ok = Check(WriteFile(path, text, length), path, "can be written");
+    ok &= Check(OIConfigLoad(path), path, "is loaded even though it's too big");
+    ok &= Check(OIConfigGet()->drivers[OI_Driver_GHL_HID].whammy.deadzone == 5, "oversized file", "stops at its last whole line");
+    unlink(path);
+    return ok;
+}
+
+// random bytes, and the good settings with bits of them scrambled
+static bool Fuzz(const char *path, int iterations) {
+    static const char alphabet[] = "[]=.;#\n\r \t0123456789abcxyz_-";
+    static char text[OI_CONFIG_MAX_SIZE];
+    bool ok = true;
+    srand(0x0C0FF16);
+    for (int i = 0; i < iterations && ok; i++) {
+        int length;
+        if (i & 1) {
+            length = rand() % 512;
+            for (int j = 0; j < length; j++)
+                text[j] = (i & 2) ? rand() : alphabet[rand() % (sizeof(alphabet) - 1)];
+        } else {
+            length = sizeof(good_config) - 1;
+            memcpy(text, good_config, length);
+            int mutations = 1 + rand() % 8;
+            for (int j = 0; j < mutations; j++)
+                text[rand() % length] = (j & 1) ? rand() : alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        OIConfig config;
+        OIConfigDefaults(&config);
+        int skipped = OIConfigParse(&config, text, length);
+        ok &= Check(skipped >= 0 && skipped <= length, "fuzzed settings", "skip a sensible number of lines");
+        ok &= Check(IsUsable(&config), "fuzzed settings", "only hold things the drivers can use");
+        if (i % LOAD_EVERY == 0) {
+            ok &= Check(WriteFile(path, text, length) && OIConfigLoad(path), "fuzzed settings", "load");
+            OIDriversInit();
+            OIDriverInput input;
+            uint8_t report[64] = { 0 };
+            for (int id = 0; id < OI_Driver_Count; id++) {
+                if (oi_drivers[id].decode != NULL)
+                    DecodeHeld((OIDriverId)id, report, oi_drivers[id].report_size, &input);
+            }
+        }
+    }
+    unlink(path);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    OIHostMockSetQuiet(true);
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/oi_config_check_%i.ini", (int)getpid());
+
+    bool ok = true;
+    ok &= CheckGoodConfig();
+    ok &= CheckMalformed();
+    ok &= CheckLoaded(path);
+    ok &= CheckOversized(path);
+    ok &= Fuzz(path, iterations);
+    printf("%i malformed cases, %i fuzzed files: %s\n", MALFORMED_CASE_COUNT, iterations, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
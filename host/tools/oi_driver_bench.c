@@ -0,0 +1,188 @@
+/*
+    oi_driver_bench.c - OrbisInstrumentalizer host build
+    Checks every driver picks up its own instrument and decodes a held fret, then times each one's decode per report
+    and the VID/PID lookup.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "OIDriver.h"
+#include "OIInstrumentIds.h"
+#include "OrbisPadTypes.h"
+#include "xinput.h"
+#include "gip.h"
+
+#define DEFAULT_REPORTS 10000000
+#define TIMING_RUNS 5
+// the most a report's decode may take, the same as the whammy/tilt stage is held to on its own
+#define BUDGET_NS 250
+#define REPORT_INTERVAL_USEC 1000
+// a lookup happens for every device on the bus whenever discovery runs, well off the report path
+#define LOOKUP_BUDGET_NS 50
+
+// what each driver's instrument looks like, and a report from it with the first fret held
+typedef struct _BenchInstrument {
+    OIDriverId id;
+    OIDriverDescriptor desc;
+    uint8_t report[64];
+    int length;
+    int whammy_offset; // the byte that's changed every report, so nothing gets to skip work
+    uint32_t expected; // in translated
+} BenchInstrument;
+
+#define HID_REPORT { 0x02, 0x00, 0x08, 0x80, 0xFF, 0x80, 0x80 }
+#define XINPUT_REPORT(a) { 0x00, 0x14, 0x00, a, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x7F, 0x00, 0x80, 0x00, 0x80 }
+
+static BenchInstrument instruments[] = {
+    { OI_Driver_GHL_HID, { .vendor_id = 0x12BA, .product_id = 0x074B },
+        HID_REPORT, 27, 6, ORBIS_PAD_BUTTON_CROSS },
+    { OI_Driver_GHL_XInput, { .vendor_id = 0x1430, .product_id = 0x070B },
+        XINPUT_REPORT(0x10), 20, 13, ORBIS_PAD_BUTTON_CROSS },
+    { OI_Driver_GHL_XOne, { .vendor_id = 0x1430, .product_id = 0x079B },
+        { GIP_CMD_GHL_INPUT, 0x00, 0x01, 27, 0x02, 0x00, 0x08, 0x80, 0xFF, 0x80, 0x80 }, 31, 10, ORBIS_PAD_BUTTON_CROSS },
+    { OI_Driver_XInputGuitar, { .device_class = 0xFF, .interface_subclass = 0x5D, .xinput = true, .xinput_subtype = XINPUT_SUBTYPE_GUITAR },
+        XINPUT_REPORT(XINPUT_BUTTON_A), 20, 11, 1 << 1 },
+    { OI_Driver_XInputDrums, { .device_class = 0xFF, .interface_subclass = 0x5D, .xinput = true, .xinput_subtype = XINPUT_SUBTYPE_DRUM_KIT },
+        XINPUT_REPORT(XINPUT_BUTTON_A), 20, 11, 1 << 1 },
+    { OI_Driver_XInputWireless, { .device_class = 0xFF, .interface_subclass = 0x5D, .xinput = true, .xinput_subtype = XINPUT_SUBTYPE_ARCADE_PAD },
+        { 0x00, 0x01, 0x00, 0xF0, 0x00, 0x14, 0x00, XINPUT_BUTTON_A, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x7F, 0x00, 0x80, 0x00, 0x80 }, 24, 15, 1 << 1 },
+};
+#define INSTRUMENT_COUNT (int)(sizeof(instruments) / sizeof(instruments[0]))
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool Check(bool ok, const char *name, const char *what) {
+    if (!ok)
+        printf("FAIL: %s %s\n", name, what);
+    return ok;
+}
+
+// each instrument only gets its own driver, on its own front-end
+static bool CheckInstrument(const BenchInstrument *instrument) {
+    const OIDriver *driver = &oi_drivers[instrument->id];
+    bool ok = true;
+    const OIDriver *identified = OIDriverIdentify(&instrument->desc, driver->front_end);
+    ok &= Check(identified == driver, driver->name, "is identified");
+    OIDriverFrontEnd other = driver->front_end == OI_FrontEnd_GHL ? OI_FrontEnd_RB4 : OI_FrontEnd_GHL;
+    ok &= Check(OIDriverIdentify(&instrument->desc, other) == NULL, driver->name, "is left alone by the other front-end");
+
+    OIDriverState state;
+    OIDriverStart(driver, &state);
+    bool decoded = driver->decode(&state, instrument->report, instrument->length, 0);
+    ok &= Check(decoded && (state.input.translated & instrument->expected) != 0, driver->name, "decodes a held fret");
+    ok &= Check(!driver->decode(&state, instrument->report, 3, 1000), driver->name, "ignores a report that's cut short");
+    ok &= Check((state.input.translated & instrument->expected) != 0, driver->name, "keeps its input through a short report");
+    return ok;
+}
+
+// every listed instrument finds itself and only itself, and Wii ones are shown to RB4 as what the list says
+static bool CheckInstrumentIds() {
+    bool ok = true;
+    for (int i = 0; i < OIInstrumentIdCount(); i++) {
+        const OIInstrumentId *id = OIInstrumentIdGet(i);
+        ok &= Check(OIInstrumentIdLookup(id->vendor_id, id->product_id) == id, id->name, "is found by its VID/PID");
+        ok &= Check(OIInstrumentIdLookup(id->vendor_id, id->product_id ^ 0x8000) == NULL, id->name, "isn't found by a PID it doesn't have");
+        if (i > 0) {
+            const OIInstrumentId *last = OIInstrumentIdGet(i - 1);
+            ok &= Check(((uint32_t)last->vendor_id << 16 | last->product_id) < ((uint32_t)id->vendor_id << 16 | id->product_id),
+                id->name, "is sorted after the one before it");
+        }
+
+        OIDriverDescriptor desc = { .vendor_id = id->vendor_id, .product_id = id->product_id };
+        const OIDriver *driver = &oi_drivers[id->driver];
+        ok &= Check(OIDriverIdentify(&desc, driver->front_end) == driver, id->name, "is identified as its driver");
+        if (id->present_vendor_id != 0) {
+            struct libusb_device_descriptor device_desc = { .idVendor = id->vendor_id, .idProduct = id->product_id };
+            OIDriverPresent(driver, &device_desc);
+            ok &= Check(device_desc.idVendor == id->present_vendor_id && device_desc.idProduct == id->present_product_id,
+                id->name, "is presented as what the list says");
+        }
+    }
+    // unlisted Wii instruments still get the vendor the game looks for
+    OIDriverDescriptor unlisted = { .vendor_id = 0x1BAD, .product_id = 0xFFFF };
+    const OIDriver *wii = OIDriverIdentify(&unlisted, OI_FrontEnd_RB4);
+    ok &= Check(wii == &oi_drivers[OI_Driver_WiiRB], "unlisted Wii instrument", "is identified by its vendor");
+    struct libusb_device_descriptor device_desc = { .idVendor = 0x1BAD, .idProduct = 0xFFFF };
+    OIDriverPresent(wii, &device_desc);
+    ok &= Check(device_desc.idVendor == 0x12BA && device_desc.idProduct == 0xFFFF, "unlisted Wii instrument", "keeps its PID");
+    return ok;
+}
+
+// half the lookups are for listed instruments, the rest for whatever else is plugged in
+static double TimeLookups(int count) {
+    uint32_t found = 0;
+    double best = 0;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        uint64_t start = NowNanoseconds();
+        for (int i = 0; i < count; i++) {
+            const OIInstrumentId *id = OIInstrumentIdGet(i % OIInstrumentIdCount());
+            uint16_t product_id = (i & 1) ? id->product_id : (uint16_t)i;
+            found += OIInstrumentIdLookup(id->vendor_id, product_id) != NULL;
+        }
+        double per_lookup = (double)(NowNanoseconds() - start) / count;
+        if (run == 0 || per_lookup < best)
+            best = per_lookup;
+    }
+    // keeps the loop from being thrown away
+    if (found == 0)
+        printf("\n");
+    return best;
+}
+
+// best of a few runs, straight through the driver's decode
+static double TimeDecode(BenchInstrument *instrument, int count) {
+    const OIDriver *driver = &oi_drivers[instrument->id];
+    OIDriverState state;
+    OIDriverStart(driver, &state);
+    uint32_t sink = 0;
+    double best = 0;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        uint64_t start = NowNanoseconds();
+        for (int i = 0; i < count; i++) {
+            instrument->report[instrument->whammy_offset] = i & 0x7F;
+            driver->decode(&state, instrument->report, instrument->length, (uint64_t)i * REPORT_INTERVAL_USEC);
+            sink += state.input.whammy;
+        }
+        double per_report = (double)(NowNanoseconds() - start) / count;
+        if (run == 0 || per_report < best)
+            best = per_report;
+    }
+    // keeps the loop from being thrown away
+    if (sink == 0xFFFFFFFF)
+        printf("\n");
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_REPORTS;
+    OIDriversInit();
+
+    bool ok = true;
+    for (int i = 0; i < INSTRUMENT_COUNT; i++)
+        ok &= CheckInstrument(&instruments[i]);
+    ok &= CheckInstrumentIds();
+    if (!ok)
+        return 1;
+
+    for (int i = 0; i < INSTRUMENT_COUNT; i++) {
+        const OIDriver *driver = &oi_drivers[instruments[i].id];
+        double ns = TimeDecode(&instruments[i], count);
+        printf("%-28s %.1f ns/report\n", driver->name, ns);
+        ok &= Check(ns <= BUDGET_NS, driver->name, "decodes inside the budget");
+    }
+    printf("%i reports per driver, budget %i ns/report\n", count, BUDGET_NS);
+    double lookup_ns = TimeLookups(count);
+    printf("%i listed instruments, %.1f ns/lookup (budget %i ns)\n", OIInstrumentIdCount(), lookup_ns, LOOKUP_BUDGET_NS);
+    ok &= Check(lookup_ns <= LOOKUP_BUDGET_NS, "VID/PID lookup", "is inside the budget");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+/*
+    oi_drum_check.c - OrbisInstrumentalizer host build
+    Hits a 360 drum kit's pads through the RB4 hooks, or replays a kit capture, and checks the PS3 drum report
+    the game gets for every one.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "OIHostMock.h"
+#include "OICapture.h"
+#include "xinput.h"
+
+void InitUsbdHooks();
+void DestroyUsbdHooks();
+int TsceUsbdOpen_hook(libusb_device *device, libusb_device_handle **dev_handle);
+void TsceUsbdFillInterruptTransfer_hook(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout);
+
+// the PS3 drum report the game reads
+#define PS3_REPORT_LENGTH 27
+#define PS3_HAT_OFFSET 2
+#define PS3_WHAMMY_OFFSET 5
+#define PS3_VELOCITY_OFFSET 11 // yellow, red, green, blue
+#define PS3_ACCEL_X_OFFSET 19
+#define PS3_HAT_NEUTRAL 0x08
+
+#define BIT(i) (1 << i)
+#define PS3_BLUE BIT(0)
+#define PS3_GREEN BIT(1)
+#define PS3_RED BIT(2)
+#define PS3_YELLOW BIT(3)
+#define PS3_KICK BIT(4)
+#define PS3_KICK_2 BIT(5)
+#define PS3_PAD BIT(10)
+#define PS3_CYMBAL BIT(11)
+
+// a kit report, the 360 cymbals press the dpad as well as their colour
+typedef struct _DrumHit {
+    const char *name;
+    uint8_t buttons1; // dpad, start, back and the stick clicks
+    uint8_t buttons2; // the face buttons and bumpers
+    int16_t red, yellow, blue, green; // left x, left y, right x, right y
+    uint16_t expected_buttons;
+    uint8_t expected_hat;
+    uint8_t expected_velocity[4]; // yellow, red, green, blue
+} DrumHit;
+
+static const DrumHit hits[] = {
+    { "nothing hit", 0, 0, 0, 0, 0, 0, 0, PS3_HAT_NEUTRAL, { 0, 0, 0, 0 } },
+    { "red pad, hard", XINPUT_BUTTON_R3, XINPUT_BUTTON_B, 32767, 0, 0, 0,
+        PS3_RED | PS3_PAD, PS3_HAT_NEUTRAL, { 0, 255, 0, 0 } },
+    { "yellow cymbal, half", XINPUT_BUTTON_UP, XINPUT_BUTTON_Y | XINPUT_BUTTON_RB, 0, -16384, 0, 0,
+        PS3_YELLOW | PS3_CYMBAL, 0x00, { 128, 0, 0, 0 } },
+    { "blue cymbal and kick", XINPUT_BUTTON_DOWN, XINPUT_BUTTON_X | XINPUT_BUTTON_RB | XINPUT_BUTTON_LB, 0, 0, 8192, 0,
+        PS3_BLUE | PS3_CYMBAL | PS3_KICK, 0x04, { 0, 0, 0, 64 } },
+    { "green pad, soft, second kick", XINPUT_BUTTON_R3 | XINPUT_BUTTON_L3, XINPUT_BUTTON_A, 0, 0, 0, -128,
+        PS3_GREEN | PS3_PAD | PS3_KICK_2, PS3_HAT_NEUTRAL, { 0, 0, 1, 0 } },
+    { "every pad at once", XINPUT_BUTTON_R3, XINPUT_BUTTON_A | XINPUT_BUTTON_B | XINPUT_BUTTON_X | XINPUT_BUTTON_Y,
+        1000, -2000, 3000, -32768,
+        PS3_GREEN | PS3_RED | PS3_BLUE | PS3_YELLOW | PS3_PAD, PS3_HAT_NEUTRAL, { 15, 7, 255, 23 } },
+    { "let go", 0, 0, 0, 0, 0, 0, 0, PS3_HAT_NEUTRAL, { 0, 0, 0, 0 } },
+};
+#define HIT_COUNT (int)(sizeof(hits) / sizeof(hits[0]))
+
+static libusb_device *kit;
+static struct libusb_transfer *transfer;
+static uint8_t buffer[OI_CAPTURE_MAX_REPORT_SIZE];
+static uint8_t game_report[PS3_REPORT_LENGTH];
+static int game_reads = 0;
+
+static void GameInterruptCallback(struct libusb_transfer *completed) {
+    if (completed->status == LIBUSB_TRANSFER_COMPLETED) {
+        memcpy(game_report, completed->buffer, PS3_REPORT_LENGTH);
+        game_reads++;
+    }
+}
+
+static bool SetUpKit() {
+    OIHostMockDeviceInfo info = {
+        .vendorId = 0x045E, .productId = 0x028E, .deviceClass = 0xFF,
+        .interfaceClass = 0xFF, .interfaceSubClass = 0x5D, .xinputSubtype = XINPUT_SUBTYPE_DRUM_KIT
+    };
+    kit = OIHostMockAddDevice(&info);
+    libusb_device_handle *handle = NULL;
+    if (TsceUsbdOpen_hook(kit, &handle) != 0)
+        return false;
+    transfer = sceUsbdAllocTransfer(0);
+    TsceUsbdFillInterruptTransfer_hook(transfer, handle, 0x81, buffer, PS3_REPORT_LENGTH, GameInterruptCallback, NULL, 0);
+    return true;
+}
+
+// what the game reads back for one report from the kit
+static bool Deliver(const uint8_t *report, int length) {
+    int reads = game_reads;
+    memset(buffer, 0, sizeof(buffer));
+    memcpy(buffer, report, length < PS3_REPORT_LENGTH ? length : PS3_REPORT_LENGTH);
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+    transfer->actual_length = length;
+    transfer->callback(transfer);
+    return game_reads == reads + 1;
+}
+
+static bool CheckReport(const char *name, uint16_t buttons, uint8_t hat, const uint8_t *velocity) {
+    bool ok = true;
+    uint16_t got_buttons = game_report[0] | game_report[1] << 8;
+    if (got_buttons != buttons || game_report[PS3_HAT_OFFSET] != hat) {
+        printf("FAIL: %s reads as buttons %04x hat %i, expected %04x hat %i\n", name, got_buttons, game_report[PS3_HAT_OFFSET], buttons, hat);
+        ok = false;
+    }
+    if (memcmp(game_report + PS3_VELOCITY_OFFSET, velocity, 4) != 0) {
+        const uint8_t *got = game_report + PS3_VELOCITY_OFFSET;
+        printf("FAIL: %s has velocities %i %i %i %i, expected %i %i %i %i\n", name,
+            got[0], got[1], got[2], got[3], velocity[0], velocity[1], velocity[2], velocity[3]);
+        ok = false;
+    }
+    // the sticks are velocities, there's no whammy or tilt on a kit
+    if (game_report[PS3_WHAMMY_OFFSET] != 0 || game_report[PS3_ACCEL_X_OFFSET] != 0) {
+        printf("FAIL: %s has whammy or tilt\n", name);
+        ok = false;
+    }
+    return ok;
+}
+
+static bool CheckHits() {
+    bool ok = true;
+    for (int i = 0; i < HIT_COUNT; i++) {
+        const DrumHit *hit = &hits[i];
+        xinput_report_controls report = {
+            .header = { .message_type = 0x00, .message_size = sizeof(xinput_report_controls) },
+            .buttons1 = hit->buttons1, .buttons2 = hit->buttons2,
+            .left_stick_x = hit->red, .left_stick_y = hit->yellow, .right_stick_x = hit->blue, .right_stick_y = hit->green
+        };
+        if (!Deliver((const uint8_t *)&report, sizeof(report))) {
+            printf("FAIL: %s never reached the game\n", hit->name);
+            ok = false;
+            continue;
+        }
+        ok &= CheckReport(hit->name, hit->expected_buttons, hit->expected_hat, hit->expected_velocity);
+    }
+    return ok;
+}
+
+// the same conversion worked out independently, for reports the hits above don't cover
+static uint8_t ExpectedVelocity(int16_t axis) {
+    int magnitude = abs((int)axis) / 128;
+    return magnitude > 255 ? 255 : magnitude;
+}
+
+static uint16_t ExpectedButtons(const xinput_report_controls *controls) {
+    uint16_t expected = 0;
+    expected |= (controls->buttons2 & XINPUT_BUTTON_X) ? PS3_BLUE : 0;
+    expected |= (controls->buttons2 & XINPUT_BUTTON_A) ? PS3_GREEN : 0;
+    expected |= (controls->buttons2 & XINPUT_BUTTON_B) ? PS3_RED : 0;
+    expected |= (controls->buttons2 & XINPUT_BUTTON_Y) ? PS3_YELLOW : 0;
+    expected |= (controls->buttons2 & XINPUT_BUTTON_LB) ? PS3_KICK : 0;
+    expected |= (controls->buttons2 & XINPUT_BUTTON_RB) ? PS3_CYMBAL : 0;
+    expected |= (controls->buttons1 & XINPUT_BUTTON_L3) ? PS3_KICK_2 : 0;
+    expected |= (controls->buttons1 & XINPUT_BUTTON_R3) ? PS3_PAD : 0;
+    expected |= (controls->buttons1 & XINPUT_BUTTON_BACK) ? BIT(8) : 0;
+    expected |= (controls->buttons1 & XINPUT_BUTTON_START) ? BIT(9) : 0;
+    return expected;
+}
+
+static uint8_t ExpectedHat(uint8_t buttons) {
+    if (buttons & XINPUT_BUTTON_RIGHT)
+        return 0x02;
+    if (buttons & XINPUT_BUTTON_LEFT)
+        return 0x06;
+    if (buttons & XINPUT_BUTTON_DOWN)
+        return 0x04;
+    if (buttons & XINPUT_BUTTON_UP)
+        return 0x00;
+    return PS3_HAT_NEUTRAL;
+}
+
+// every kit report in the capture, anything else in it is left out
+static bool CheckCapture(const char *path, int *checked) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    OICaptureFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != OI_CAPTURE_FILE_MAGIC || header.version != OI_CAPTURE_FILE_VERSION) {
+        printf("%s isn't a capture file, or is an unknown version\n", path);
+        fclose(file);
+        return false;
+    }
+    bool ok = true;
+    OICaptureRecord record;
+    uint8_t report[256];
+    // the last real report stands when one isn't controls
+    xinput_report_controls last = { 0 };
+    while (ok && fread(&record, sizeof(record), 1, file) == 1 && fread(report, 1, record.length, file) == record.length) {
+        if (record.source != OI_Capture_RB4_XInputDrums || !Deliver(report, record.length))
+            continue;
+        if (record.length >= (int)sizeof(xinput_report_controls) && report[0] == 0x00)
+            memcpy(&last, report, sizeof(last));
+        uint8_t velocity[4] = {
+            ExpectedVelocity(last.left_stick_y), ExpectedVelocity(last.left_stick_x),
+            ExpectedVelocity(last.right_stick_y), ExpectedVelocity(last.right_stick_x)
+        };
+        char name[32];
+        snprintf(name, sizeof(name), "captured report %i", *checked);
+        ok &= CheckReport(name, ExpectedButtons(&last), ExpectedHat(last.buttons1), velocity);
+        (*checked)++;
+    }
+    fclose(file);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo("CUSA02084", "02.21");
+    InitUsbdHooks();
+    if (!SetUpKit()) {
+        printf("couldn't open the mock drum kit\n");
+        return 1;
+    }
+
+    bool ok = CheckHits();
+    printf("%i drum hits: %s\n", HIT_COUNT, ok ? "ok" : "FAILED");
+    for (int i = 1; i < argc; i++) {
+        int checked = 0;
+        bool capture_ok = CheckCapture(argv[i], &checked);
+        printf("%s, %i kit reports: %s\n", argv[i], checked, capture_ok ? "ok" : "FAILED");
+        ok &= capture_ok;
+    }
+    DestroyUsbdHooks();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+/*
+    oi_ghl_bench.c - OrbisInstrumentalizer host build
+    Measures the GHL event thread and the game's side of the pad hooks: CPU used while idle, how long a report
+    takes to reach the game, reports dropped when they come in bursts, and what scePadOutputReport and scePadRead
+    cost the game's thread.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OrbisPadTypes.h"
+
+void InitPadHooks();
+void DestroyPadHooks();
+int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param);
+int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info);
+int scePadReadState_hook(int handle, OrbisPadData *data);
+int scePadRead_hook(int handle, OrbisPadData *data, int num);
+int scePadOutputReport_hook(int handle, int type, uint8_t *report, int length);
+
+#define GHL_ENDPOINT 0x81
+#define GHL_CLAIM_TIMEOUT_USEC 2000000
+#define GHL_HID_REPORT_SIZE 27
+// a report's number goes in whammy and tilt, which PS3/Wii U dongles pass straight through
+#define WHAMMY_OFFSET 6
+#define TILT_OFFSET 19
+
+#define IDLE_MEASURE_MSEC 1000
+#define DELAY_REPORTS 2000
+#define DELAY_SPACING_USEC 1000
+// a dongle that saves its reports up and sends them together, the way they arrive after a hitch
+#define BURST_COUNT 2000
+#define BURST_LENGTH 3
+#define BURST_SPACING_USEC 2000
+// numbered after the delay's reports, so the last of those still showing isn't taken for one of these
+#define BURST_FIRST_SEQUENCE (DELAY_REPORTS + 1)
+// a dongle slow enough to answer a control transfer that a frame would notice
+#define SLOW_CONTROL_USEC 2000
+#define OUTPUT_CALLS 200
+#define OUTPUT_SPACING_USEC 1000
+#define READ_FRAMES 20000
+#define READ_BATCH 8
+
+// what the event thread can use with nothing to do, and what a keepalive can cost the game
+#define IDLE_BUDGET_MSEC_PER_SEC 10.0
+#define OUTPUT_BUDGET_USEC 100.0
+
+static libusb_device *dongle;
+static int pad_handle;
+static uint64_t queued_at[BURST_FIRST_SEQUENCE + BURST_COUNT * BURST_LENGTH];
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t CpuNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int CompareU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// the process's CPU time while this thread sleeps, so it's all the plugin's and the mock's
+static double IdleMsecPerSecond() {
+    uint64_t start = CpuNanoseconds();
+    usleep(IDLE_MEASURE_MSEC * 1000);
+    return (CpuNanoseconds() - start) / 1e6 / (IDLE_MEASURE_MSEC / 1000.0);
+}
+
+static void StampReport(uint8_t *report, int sequence) {
+    memset(report, 0, GHL_HID_REPORT_SIZE);
+    report[2] = 0x0F; // hat centred
+    report[WHAMMY_OFFSET] = sequence & 0xFF;
+    report[TILT_OFFSET] = sequence >> 8;
+}
+
+static int VisibleSequence() {
+    OrbisPadData pad;
+    scePadReadState_hook(pad_handle, &pad);
+    return pad.rightStick.y | pad.rightStick.x << 8;
+}
+
+static bool ConnectDongle() {
+    OIHostMockDeviceInfo info = { .vendorId = 0x12BA, .productId = 0x074B };
+    dongle = OIHostMockAddDevice(&info);
+    pad_handle = scePadOpenExt_hook(1, ORBIS_PAD_PORT_TYPE_SPECIAL, 0, NULL);
+    OrbisPadInformation pad_info;
+    for (int waited = 0; waited < GHL_CLAIM_TIMEOUT_USEC; waited += 1000) {
+        if (scePadGetControllerInformation_hook(pad_handle, &pad_info) == 0)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+// one report at a time, far enough apart that none wait on the one before
+static void MeasureDelay() {
+    static uint64_t delays[DELAY_REPORTS];
+    uint8_t report[GHL_HID_REPORT_SIZE];
+    int measured = 0;
+    for (int i = 0; i < DELAY_REPORTS; i++) {
+        int sequence = i + 1;
+        StampReport(report, sequence);
+        uint64_t queued = NowNanoseconds();
+        OIHostMockQueueReport(dongle, GHL_ENDPOINT, report, sizeof(report));
+        while (VisibleSequence() != sequence && NowNanoseconds() - queued < 100000000)
+            sched_yield();
+        if (VisibleSequence() == sequence)
+            delays[measured++] = NowNanoseconds() - queued;
+        usleep(DELAY_SPACING_USEC);
+    }
+    qsort(delays, measured, sizeof(delays[0]), CompareU64);
+    uint64_t total = 0;
+    for (int i = 0; i < measured; i++)
+        total += delays[i];
+    printf("report to game: %i of %i seen, mean %.1f us, p99 %.1f us, max %.1f us\n", measured, DELAY_REPORTS,
+        measured > 0 ? total / 1e3 / measured : 0.0, measured > 0 ? delays[measured * 99 / 100] / 1e3 : 0.0,
+        measured > 0 ? delays[measured - 1] / 1e3 : 0.0);
+}
+
+static volatile bool bursting;
+
+static void *BurstThread(void *unused) {
+    uint8_t report[GHL_HID_REPORT_SIZE];
+    int sequence = BURST_FIRST_SEQUENCE;
+    for (int i = 0; i < BURST_COUNT; i++) {
+        for (int j = 0; j < BURST_LENGTH; j++, sequence++) {
+            StampReport(report, sequence);
+            queued_at[sequence] = NowNanoseconds();
+            OIHostMockQueueReport(dongle, GHL_ENDPOINT, report, sizeof(report));
+        }
+        usleep(BURST_SPACING_USEC);
+    }
+    bursting = false;
+    return NULL;
+}
+
+// reports that turn up with no transfer waiting are lost, like on the wire, and with a transfer queued for each
+// report in a burst none should be
+static bool MeasureBursts() {
+    OIHostMockStats before, after;
+    OIHostMockSetDropUnclaimedReports(true);
+    OIHostMockGetStats(&before);
+    bursting = true;
+    pthread_t thread;
+    pthread_create(&thread, NULL, BurstThread, NULL);
+
+    int last = 0;
+    uint64_t worst = 0;
+    while (bursting) {
+        int sequence = VisibleSequence();
+        if (sequence != last && sequence >= BURST_FIRST_SEQUENCE && sequence < BURST_FIRST_SEQUENCE + BURST_COUNT * BURST_LENGTH) {
+            uint64_t latency = NowNanoseconds() - queued_at[sequence];
+            worst = latency > worst ? latency : worst;
+            last = sequence;
+        }
+        sched_yield();
+    }
+    pthread_join(thread, NULL);
+    OIHostMockGetStats(&after);
+    OIHostMockSetDropUnclaimedReports(false);
+    int sent = BURST_COUNT * BURST_LENGTH;
+    uint64_t dropped = after.reportsDropped - before.reportsDropped;
+    printf("bursts of %i: %lu of %i reports dropped (%.2f%%), worst report to game %.1f us\n", BURST_LENGTH,
+        dropped, sent, dropped * 100.0 / sent, worst / 1e3);
+    return dropped == 0;
+}
+
+// what the game's thread pays for each output report, with a dongle that's slow to answer
+static bool MeasureOutput() {
+    OIHostMockStats before, after;
+    OIHostMockSetControlDelay(SLOW_CONTROL_USEC);
+    OIHostMockGetStats(&before);
+    uint64_t total = 0, worst = 0;
+    for (int i = 0; i < OUTPUT_CALLS; i++) {
+        uint64_t start = NowNanoseconds();
+        scePadOutputReport_hook(pad_handle, 0, NULL, 0);
+        uint64_t elapsed = NowNanoseconds() - start;
+        total += elapsed;
+        worst = elapsed > worst ? elapsed : worst;
+        usleep(OUTPUT_SPACING_USEC);
+    }
+    OIHostMockGetStats(&after);
+    OIHostMockSetControlDelay(0);
+    double mean = total / 1e3 / OUTPUT_CALLS;
+    printf("scePadOutputReport, %i us dongle: mean %.2f us, max %.1f us per call, %lu keepalives sent for %i calls\n",
+        SLOW_CONTROL_USEC, mean, worst / 1e3, after.controlTransfers - before.controlTransfers, OUTPUT_CALLS);
+    return worst / 1e3 <= OUTPUT_BUDGET_USEC;
+}
+
+// how many of the frame's states the game actually got, reading the latest again doesn't count
+static int DistinctStates(const OrbisPadData *pads, int count) {
+    int distinct = 0;
+    for (int i = 0; i < count; i++) {
+        bool seen = false;
+        for (int j = 0; j < i && !seen; j++)
+            seen = pads[j].rightStick.x == pads[i].rightStick.x && pads[j].rightStick.y == pads[i].rightStick.y;
+        distinct += !seen;
+    }
+    return distinct;
+}
+
+// READ_BATCH reports a frame, read one at a time or all at once
+static void MeasureReads() {
+    uint8_t report[GHL_HID_REPORT_SIZE];
+    OrbisPadData pads[READ_BATCH];
+    uint64_t single = 0, batched = 0;
+    uint64_t single_states = 0, batched_states = 0;
+    int sequence = 1;
+    for (int frame = 0; frame < READ_FRAMES; frame++) {
+        bool batch = frame & 1;
+        for (int i = 0; i < READ_BATCH; i++, sequence = (sequence % 0xFFFF) + 1) {
+            StampReport(report, sequence);
+            OIHostMockCompleteTransfer(dongle, GHL_ENDPOINT, report, sizeof(report));
+        }
+        int read = READ_BATCH;
+        uint64_t start = NowNanoseconds();
+        if (batch) {
+            read = scePadRead_hook(pad_handle, pads, READ_BATCH);
+        } else {
+            for (int i = 0; i < READ_BATCH; i++)
+                scePadReadState_hook(pad_handle, &pads[i]);
+        }
+        uint64_t elapsed = NowNanoseconds() - start;
+        if (batch) {
+            batched += elapsed;
+            batched_states += DistinctStates(pads, read);
+        } else {
+            single += elapsed;
+            single_states += DistinctStates(pads, read);
+        }
+    }
+    printf("%i reports a frame: %.1f ns for %.1f states with scePadReadState each, %.1f ns for %.1f states with one scePadRead\n",
+        READ_BATCH, (double)single / (READ_FRAMES / 2), (double)single_states / (READ_FRAMES / 2),
+        (double)batched / (READ_FRAMES / 2), (double)batched_states / (READ_FRAMES / 2));
+}
+
+static bool Wants(int argc, char **argv, const char *section) {
+    if (argc < 2)
+        return true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], section) == 0)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo("CUSA02410", "01.00");
+    InitPadHooks();
+    bool ok = true;
+
+    if (Wants(argc, argv, "idle")) {
+        double idle = IdleMsecPerSecond();
+        printf("idle, no pads: %.2f ms CPU per second\n", idle);
+        ok &= idle <= IDLE_BUDGET_MSEC_PER_SEC;
+    }
+    if (!ConnectDongle()) {
+        printf("FAIL: the dongle never got a pad\n");
+        return 1;
+    }
+    if (Wants(argc, argv, "idle")) {
+        double idle = IdleMsecPerSecond();
+        printf("idle, dongle connected: %.2f ms CPU per second\n", idle);
+        ok &= idle <= IDLE_BUDGET_MSEC_PER_SEC;
+    }
+    if (Wants(argc, argv, "delay"))
+        MeasureDelay();
+    if (Wants(argc, argv, "bursts"))
+        ok &= MeasureBursts();
+    if (Wants(argc, argv, "output"))
+        ok &= MeasureOutput();
+    if (Wants(argc, argv, "read"))
+        MeasureReads();
+
+    DestroyPadHooks();
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
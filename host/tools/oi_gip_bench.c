@@ -0,0 +1,176 @@
+/*
+    oi_gip_bench.c - OrbisInstrumentalizer host build
+    Walks a mock Xbox One GHL dongle through its handshake, then times its reports against the PS3/Wii U ones.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OrbisPadTypes.h"
+#include "gip.h"
+
+void InitPadHooks();
+void DestroyPadHooks();
+int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param);
+int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info);
+int scePadReadState_hook(int handle, OrbisPadData *data);
+int scePadOutputReport_hook(int handle, int type, uint8_t *report, int length);
+
+#define DEFAULT_REPORTS 2000000
+#define TIMING_RUNS 5
+// an Xbox One report may cost this much more than a PS3/Wii U one, for the GIP header and the extra checks
+#define BUDGET_OVERHEAD_PERCENT 25
+#define BUDGET_OVERHEAD_NS 20
+#define IN_ENDPOINT 0x81
+#define OUT_ENDPOINT 0x01
+#define WAIT_TIMEOUT_USEC 2000000
+#define HID_REPORT_LENGTH 27
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool Check(bool ok, const char *what) {
+    if (!ok)
+        printf("FAIL: %s\n", what);
+    return ok;
+}
+
+static libusb_device *Connect(uint16_t vendorId, uint16_t productId, int userID, int *handle) {
+    OIHostMockDeviceInfo info = { 0 };
+    info.vendorId = vendorId;
+    info.productId = productId;
+    libusb_device *device = OIHostMockAddDevice(&info);
+    *handle = scePadOpenExt_hook(userID, ORBIS_PAD_PORT_TYPE_SPECIAL, 0, NULL);
+    OrbisPadInformation pad_info;
+    for (int waited = 0; waited < WAIT_TIMEOUT_USEC; waited += 1000) {
+        if (scePadGetControllerInformation_hook(*handle, &pad_info) == 0)
+            return device;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+// the event thread sends replies after the transfer's been handled, so give it a moment
+static bool ExpectSent(libusb_device *device, const uint8_t *expected, int length, const char *what) {
+    uint8_t sent[64];
+    for (int waited = 0; waited < WAIT_TIMEOUT_USEC; waited += 1000) {
+        int sent_length = OIHostMockTakeSentReport(device, OUT_ENDPOINT, sent, sizeof(sent));
+        if (sent_length >= 0)
+            return Check(sent_length == length && memcmp(sent, expected, length) == 0, what);
+        usleep(1000);
+    }
+    return Check(false, what);
+}
+
+static int GHLInputMessage(uint8_t *message, uint8_t sequence, const uint8_t *report) {
+    gip_header header = { GIP_CMD_GHL_INPUT, 0x00, sequence, HID_REPORT_LENGTH };
+    memcpy(message, &header, sizeof(header));
+    memcpy(message + sizeof(header), report, HID_REPORT_LENGTH);
+    return sizeof(header) + HID_REPORT_LENGTH;
+}
+
+// the dongle's side of connecting, as a real one would play it out
+static bool CheckHandshake() {
+    bool ok = true;
+    int handle;
+    libusb_device *device = Connect(0x1430, 0x079B, 1, &handle);
+    if (!Check(device != NULL, "Xbox One dongle gets picked up"))
+        return false;
+
+    static const uint8_t power_on[] = { GIP_CMD_POWER, GIP_OPT_INTERNAL, 0x01, 0x01, GIP_POWER_ON };
+    ok &= ExpectSent(device, power_on, sizeof(power_on), "dongle is powered on straight away");
+
+    // a dongle that resets announces itself again and wants it acknowledged
+    uint8_t announce[4 + 28] = { GIP_CMD_ANNOUNCE, GIP_OPT_INTERNAL | GIP_OPT_ACKNOWLEDGE, 0x01, 28 };
+    OIHostMockCompleteTransfer(device, IN_ENDPOINT, announce, sizeof(announce));
+    static const uint8_t acknowledge[] = {
+        GIP_CMD_ACKNOWLEDGE, GIP_OPT_INTERNAL, 0x01, 0x09,
+        0x00, GIP_CMD_ANNOUNCE, GIP_OPT_INTERNAL, 28, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    ok &= ExpectSent(device, acknowledge, sizeof(acknowledge), "announce is acknowledged first");
+    static const uint8_t power_on_again[] = { GIP_CMD_POWER, GIP_OPT_INTERNAL, 0x02, 0x01, GIP_POWER_ON };
+    ok &= ExpectSent(device, power_on_again, sizeof(power_on_again), "announce powers the dongle on again");
+
+    scePadOutputReport_hook(handle, 0, NULL, 0);
+    static const uint8_t poke[] = { GIP_CMD_GHL_POKE, 0x00, 0x03, 0x09, 0x02, 0x08, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    ok &= ExpectSent(device, poke, sizeof(poke), "game's keepalive is wrapped in GIP");
+
+    // green 1 held, strum bar down
+    uint8_t report[HID_REPORT_LENGTH] = { 0x02, 0x00, 0x0F, 0x80, 0xFF, 0x80, 0x80 };
+    uint8_t message[64];
+    int length = GHLInputMessage(message, 0x02, report);
+    OIHostMockCompleteTransfer(device, IN_ENDPOINT, message, length);
+    OrbisPadData pad;
+    scePadReadState_hook(handle, &pad);
+    ok &= Check((pad.buttons & ORBIS_PAD_BUTTON_CROSS) != 0 && pad.leftStick.y == 0xFF, "input report is decoded");
+
+    // cut short, or with a length running past the end of the packet, neither should change anything
+    OIHostMockCompleteTransfer(device, IN_ENDPOINT, message, 3);
+    message[3] = 60;
+    OIHostMockCompleteTransfer(device, IN_ENDPOINT, message, length);
+    uint8_t status[] = { GIP_CMD_STATUS, GIP_OPT_INTERNAL, 0x03, 0x04, 0x00, 0x00, 0x00, 0x00 };
+    OIHostMockCompleteTransfer(device, IN_ENDPOINT, status, sizeof(status));
+    scePadReadState_hook(handle, &pad);
+    ok &= Check((pad.buttons & ORBIS_PAD_BUTTON_CROSS) != 0 && pad.count == 0, "messages that aren't input are ignored");
+    ok &= Check(OIHostMockTakeSentReport(device, OUT_ENDPOINT, message, sizeof(message)) < 0, "nothing's sent that wasn't asked for");
+
+    OIHostMockRemoveDevice(device);
+    return ok;
+}
+
+// best of a few runs, through the same transfer callback path the event thread would take
+static double TimeReports(libusb_device *device, int handle, bool xone, int count) {
+    uint8_t message[64];
+    uint8_t report[HID_REPORT_LENGTH] = { 0 };
+    double best = 0;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        uint64_t start = NowNanoseconds();
+        for (int i = 0; i < count; i++) {
+            report[0] = i & 0x3F;
+            report[19] = i & 0xFF;
+            if (xone) {
+                int length = GHLInputMessage(message, i & 0xFF, report);
+                OIHostMockCompleteTransfer(device, IN_ENDPOINT, message, length);
+            } else {
+                OIHostMockCompleteTransfer(device, IN_ENDPOINT, report, sizeof(report));
+            }
+        }
+        double per_report = (double)(NowNanoseconds() - start) / count;
+        if (run == 0 || per_report < best)
+            best = per_report;
+    }
+    OrbisPadData pad;
+    scePadReadState_hook(handle, &pad);
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_REPORTS;
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo("CUSA02410", "01.00");
+    InitPadHooks();
+
+    bool ok = CheckHandshake();
+    int hid_handle, xone_handle;
+    libusb_device *hid = Connect(0x12BA, 0x074B, 2, &hid_handle);
+    libusb_device *xone = Connect(0x1430, 0x079B, 3, &xone_handle);
+    if (ok && Check(hid != NULL && xone != NULL, "both dongles get picked up for timing")) {
+        double hid_ns = TimeReports(hid, hid_handle, false, count);
+        double xone_ns = TimeReports(xone, xone_handle, true, count);
+        double budget = hid_ns * (100 + BUDGET_OVERHEAD_PERCENT) / 100 + BUDGET_OVERHEAD_NS;
+        printf("%i reports, PS3/Wii U %.1f ns/report, Xbox One %.1f ns/report (budget %.1f ns)\n", count, hid_ns, xone_ns, budget);
+        ok &= Check(xone_ns <= budget, "Xbox One reports cost no more than PS3/Wii U ones");
+    }
+    DestroyPadHooks();
+    return ok ? 0 : 1;
+}
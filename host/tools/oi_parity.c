@@ -0,0 +1,412 @@
+/*
+    oi_parity.c - OrbisInstrumentalizer host build
+    Runs every button combination and a sweep of each axis through the hooks, and through copies of the
+    hand-written parsers the lookup tables replaced, and checks the game gets the same thing from both.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OrbisPadTypes.h"
+#include "xinput.h"
+
+void InitPadHooks();
+void DestroyPadHooks();
+int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param);
+int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info);
+int scePadReadState_hook(int handle, OrbisPadData *data);
+
+void InitUsbdHooks();
+void DestroyUsbdHooks();
+int TsceUsbdOpen_hook(libusb_device *device, libusb_device_handle **dev_handle);
+void TsceUsbdFillInterruptTransfer_hook(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout);
+
+#define GHL_ENDPOINT 0x81
+#define GHL_CLAIM_TIMEOUT_USEC 2000000
+#define GHL_HID_REPORT_SIZE 27
+#define RB4_TRANSFER_LENGTH 27
+// the 360 whammy and tilt are calibrated now, so they're left out, see CompareRB4
+#define RB4_WHAMMY_OFFSET 5
+#define RB4_VELOCITY_OFFSET 11
+#define RB4_ACCEL_X_OFFSET 19
+#define MAX_REPORTED_MISMATCHES 8
+
+// The parsers as they were before OITranslate, only changed to be callable from here.
+
+static void BaselineParseXInputToPadStruct(xinput_report_controls *report, OrbisPadData *pad) {
+    pad->buttons = 0;
+
+    // fret buttons
+    pad->buttons |= ((report->buttons2 & 0x10) != 0x00) ? ORBIS_PAD_BUTTON_CROSS : 0; // b1
+    pad->buttons |= ((report->buttons2 & 0x20) != 0x00) ? ORBIS_PAD_BUTTON_CIRCLE : 0; // b2
+    pad->buttons |= ((report->buttons2 & 0x80) != 0x00) ? ORBIS_PAD_BUTTON_TRIANGLE : 0; // b3
+    pad->buttons |= ((report->buttons2 & 0x40) != 0x00) ? ORBIS_PAD_BUTTON_SQUARE : 0; // w1
+    pad->buttons |= ((report->buttons2 & 0x01) != 0x00) ? ORBIS_PAD_BUTTON_L1 : 0; // w2
+    pad->buttons |= ((report->buttons2 & 0x02) != 0x00) ? ORBIS_PAD_BUTTON_R1 : 0; // w3
+
+    // strum bar, due to enable packet being required lets just use the dpad and lie
+    pad->leftStick.y = 0x80;
+    if (report->left_stick_y == 32767 || (report->buttons1 & 0x02) != 0x00)
+        pad->leftStick.y = 0xFF;
+    if (report->left_stick_y == -32768 || (report->buttons1 & 0x01) != 0x00)
+        pad->leftStick.y = 0x00;
+
+    // dpad (nav + strumming)
+    if ((report->buttons1 & 0x01) != 0x00)
+        pad->buttons |= ORBIS_PAD_BUTTON_UP;
+    if ((report->buttons1 & 0x04) != 0x00)
+        pad->buttons |= ORBIS_PAD_BUTTON_LEFT;
+    if ((report->buttons1 & 0x02) != 0x00)
+        pad->buttons |= ORBIS_PAD_BUTTON_DOWN;
+    if ((report->buttons1 & 0x08) != 0x00)
+        pad->buttons |= ORBIS_PAD_BUTTON_RIGHT;
+
+    // special buttons (start, ghtv)
+    pad->buttons |= ((report->buttons1 & 0x20) != 0x00) ? ORBIS_PAD_BUTTON_R3 : 0; // hero power/select button
+    pad->buttons |= ((report->buttons1 & 0x10) != 0x00) ? ORBIS_PAD_BUTTON_OPTIONS : 0; // pause/start button
+    pad->buttons |= ((report->buttons1 & 0x40) != 0x00) ? ORBIS_PAD_BUTTON_L3 : 0; // GHTV button
+
+    // whammy
+    pad->rightStick.y = (uint8_t)(report->right_stick_y / 0x100);
+    // tilt
+    pad->rightStick.x = (uint8_t)(report->right_stick_x / 0x100);
+}
+
+static void BaselineParseHIDToPadStruct(uint8_t *hid_report, OrbisPadData *pad) {
+    uint8_t frets = hid_report[0];
+    uint8_t buttons = hid_report[1];
+    uint8_t dpad = hid_report[2];
+    uint8_t strum = hid_report[4];
+    uint8_t whammy = hid_report[6];
+    uint8_t tilt = hid_report[19];
+    pad->buttons = 0;
+
+    // fret buttons
+    pad->buttons |= ((frets & 0x02) != 0x00) ? ORBIS_PAD_BUTTON_CROSS : 0; // b1
+    pad->buttons |= ((frets & 0x04) != 0x00) ? ORBIS_PAD_BUTTON_CIRCLE : 0; // b2
+    pad->buttons |= ((frets & 0x08) != 0x00) ? ORBIS_PAD_BUTTON_TRIANGLE : 0; // b3
+    pad->buttons |= ((frets & 0x01) != 0x00) ? ORBIS_PAD_BUTTON_SQUARE : 0; // w1
+    pad->buttons |= ((frets & 0x10) != 0x00) ? ORBIS_PAD_BUTTON_L1 : 0; // w2
+    pad->buttons |= ((frets & 0x20) != 0x00) ? ORBIS_PAD_BUTTON_R1 : 0; // w3
+
+    // strum bar
+    pad->leftStick.y = strum;
+
+    // dpad (nav + strumming)
+    if (dpad == 0x00)
+        pad->buttons |= ORBIS_PAD_BUTTON_UP;
+    if (dpad == 0x02)
+        pad->buttons |= ORBIS_PAD_BUTTON_LEFT;
+    if (dpad == 0x04)
+        pad->buttons |= ORBIS_PAD_BUTTON_DOWN;
+    if (dpad == 0x06)
+        pad->buttons |= ORBIS_PAD_BUTTON_RIGHT;
+
+    // special buttons (start, ghtv)
+    pad->buttons |= ((buttons & 0x01) != 0x00) ? ORBIS_PAD_BUTTON_R3 : 0; // hero power/select button
+    pad->buttons |= ((buttons & 0x02) != 0x00) ? ORBIS_PAD_BUTTON_OPTIONS : 0; // pause/start button
+    pad->buttons |= ((buttons & 0x04) != 0x00) ? ORBIS_PAD_BUTTON_L3 : 0; // GHTV button
+
+    pad->rightStick.y = whammy;
+    pad->rightStick.x = tilt;
+}
+
+#define BIT(i) (1 << i)
+typedef struct _baseline_ps3_rb_guitar_report {
+    uint16_t buttons;
+    uint8_t hat;
+    uint8_t left_joy_x;
+    uint8_t left_joy_y;
+    uint8_t whammy;
+    uint8_t mode_switch;
+    uint8_t padding[12];
+    uint8_t accel_x;
+    uint8_t unk_1;
+    uint16_t accel_z;
+    uint8_t accel_y;
+    uint8_t unk_2;
+    uint16_t gyro;
+} baseline_ps3_rb_guitar_report;
+
+static void BaselineParseXInput(uint8_t *buffer, int length) {
+    baseline_ps3_rb_guitar_report parsed_report = { 0 };
+    xinput_report_controls *xparsed = (xinput_report_controls *)buffer;
+
+    // fret buttons (todo: make sure this is right for drums)
+    if ((xparsed->buttons2 & XINPUT_BUTTON_A) != 0) parsed_report.buttons |= BIT(1); // green
+    if ((xparsed->buttons2 & XINPUT_BUTTON_B) != 0) parsed_report.buttons |= BIT(2); // red
+    if ((xparsed->buttons2 & XINPUT_BUTTON_Y) != 0) parsed_report.buttons |= BIT(3); // yellow
+    if ((xparsed->buttons2 & XINPUT_BUTTON_X) != 0) parsed_report.buttons |= BIT(0); // blue
+    if ((xparsed->buttons2 & XINPUT_BUTTON_LB) != 0) parsed_report.buttons |= BIT(4); // orange / (drums) kick
+    if ((xparsed->buttons2 & XINPUT_BUTTON_RB) != 0) parsed_report.buttons |= BIT(11); // (drums) cymbal
+    // special buttons
+    if ((xparsed->buttons1 & XINPUT_BUTTON_L3) != 0) parsed_report.buttons |= BIT(5); // (drums) kick 2
+    if ((xparsed->buttons1 & XINPUT_BUTTON_BACK) != 0) parsed_report.buttons |= BIT(8); // back
+    if ((xparsed->buttons1 & XINPUT_BUTTON_START) != 0) parsed_report.buttons |= BIT(9); // start
+    if ((xparsed->buttons1 & XINPUT_BUTTON_R3) != 0) parsed_report.buttons |= BIT(10); // (drums) pad
+    // dpad/strum bar
+    parsed_report.hat = 0x08;
+    if ((xparsed->buttons1 & XINPUT_BUTTON_UP) != 0) parsed_report.hat = 0x00;
+    if ((xparsed->buttons1 & XINPUT_BUTTON_DOWN) != 0) parsed_report.hat = 0x04;
+    if ((xparsed->buttons1 & XINPUT_BUTTON_LEFT) != 0) parsed_report.hat = 0x06;
+    if ((xparsed->buttons1 & XINPUT_BUTTON_RIGHT) != 0) parsed_report.hat = 0x02;
+    // whammy
+    parsed_report.whammy = (uint8_t)((uint16_t)xparsed->right_stick_x / 0x100);
+    // tilt
+    parsed_report.accel_x = (uint8_t)((uint16_t)xparsed->right_stick_y / 0x100);
+
+    // copy the new parsed report back into the buffer
+    memcpy(buffer, &parsed_report, length);
+}
+
+static uint8_t baseline_last_report[64];
+
+static void BaselineParseWirelessXInput(uint8_t *buffer, int length) {
+    if (buffer[1] == 0x01) // new input data
+        memcpy(baseline_last_report, buffer, length);
+    // have this copy double as a way to fast-forward the input data by 4 bytes
+    memcpy(buffer, baseline_last_report + 4, length - 4);
+    BaselineParseXInput(buffer, length);
+}
+
+// GHL, through scePadReadState
+
+typedef struct _GHLPad {
+    const char *name;
+    uint16_t vendorId;
+    uint16_t productId;
+    libusb_device *device;
+    int padHandle;
+    int mismatches;
+} GHLPad;
+
+// what the pad reads as with no instrument, everything the parsers don't write has to come through untouched
+static OrbisPadData base_pad;
+
+static bool OpenGHLPad(GHLPad *pad, int userID) {
+    OIHostMockDeviceInfo info = { .vendorId = pad->vendorId, .productId = pad->productId };
+    pad->device = OIHostMockAddDevice(&info);
+    pad->padHandle = scePadOpenExt_hook(userID, ORBIS_PAD_PORT_TYPE_SPECIAL, 0, NULL);
+    OrbisPadInformation pad_info;
+    for (int waited = 0; waited < GHL_CLAIM_TIMEOUT_USEC; waited += 1000) {
+        if (scePadGetControllerInformation_hook(pad->padHandle, &pad_info) == 0)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+// axes says whether whammy and tilt are held to the baseline too
+static void CompareGHL(GHLPad *pad, uint8_t *report, int length, bool axes) {
+    OrbisPadData got, expected;
+    memset(&got, 0, sizeof(got));
+    OIHostMockCompleteTransfer(pad->device, GHL_ENDPOINT, report, length);
+    scePadReadState_hook(pad->padHandle, &got);
+
+    memcpy(&expected, &base_pad, sizeof(expected));
+    if (pad->vendorId == 0x12BA)
+        BaselineParseHIDToPadStruct(report, &expected);
+    else
+        BaselineParseXInputToPadStruct((xinput_report_controls *)report, &expected);
+    // the baseline counted reads on its own and never set the timestamp
+    expected.count = got.count;
+    expected.timestamp = got.timestamp;
+    if (!axes)
+        expected.rightStick = got.rightStick;
+
+    if (memcmp(&got, &expected, sizeof(got)) != 0 && pad->mismatches++ < MAX_REPORTED_MISMATCHES) {
+        printf("FAIL: %s report %02x %02x %02x %02x reads as buttons %08x strum %02x whammy %02x tilt %02x, "
+            "expected %08x %02x %02x %02x\n", pad->name, report[0], report[1], report[2], report[3],
+            got.buttons, got.leftStick.y, got.rightStick.y, got.rightStick.x,
+            expected.buttons, expected.leftStick.y, expected.rightStick.y, expected.rightStick.x);
+    }
+}
+
+// every fret, button and hat byte, then each axis on its own, all 8 bits of them go straight through
+static int CheckGHLHID(GHLPad *pad) {
+    uint8_t report[GHL_HID_REPORT_SIZE] = { 0 };
+    int reports = 0;
+    for (int buttons = 0; buttons < 0x10000; buttons++, reports++) {
+        memset(report, 0, sizeof(report));
+        report[0] = buttons;
+        report[1] = buttons >> 8;
+        report[2] = 0x0F;
+        CompareGHL(pad, report, sizeof(report), true);
+    }
+    for (int hat = 0; hat < 0x10000; hat++, reports++) {
+        memset(report, 0, sizeof(report));
+        report[0] = hat;
+        report[2] = hat >> 8;
+        CompareGHL(pad, report, sizeof(report), true);
+    }
+    const int axis_offsets[] = { 4, 6, 19 }; // strum, whammy, tilt
+    for (int axis = 0; axis < 3; axis++) {
+        for (int value = 0; value < 0x100; value++, reports++) {
+            memset(report, 0, sizeof(report));
+            report[2] = 0x0F;
+            report[axis_offsets[axis]] = value;
+            CompareGHL(pad, report, sizeof(report), true);
+        }
+    }
+    return reports;
+}
+
+// every button, then the whole range of the strum stick. Whammy and tilt are calibrated now, oi_analog_bench has those
+static int CheckGHLXInput(GHLPad *pad) {
+    xinput_report_controls report = { .header = { .message_type = 0x00, .message_size = sizeof(xinput_report_controls) } };
+    int reports = 0;
+    for (int buttons = 0; buttons < 0x10000; buttons++, reports++) {
+        report.buttons1 = buttons;
+        report.buttons2 = buttons >> 8;
+        CompareGHL(pad, (uint8_t *)&report, sizeof(report), false);
+    }
+    report.buttons1 = report.buttons2 = 0;
+    for (int strum = -32768; strum <= 32767; strum++, reports++) {
+        report.left_stick_y = strum;
+        CompareGHL(pad, (uint8_t *)&report, sizeof(report), false);
+    }
+    return reports;
+}
+
+static bool CheckGHL() {
+    GHLPad pads[] = {
+        { "PS3/Wii U GHL", 0x12BA, 0x074B },
+        { "360 GHL", 0x1430, 0x070B },
+    };
+    OIHostMockSetProcInfo("CUSA02410", "01.00");
+    memset(&base_pad, 0, sizeof(base_pad));
+    base_pad.leftStick.x = 0x80;
+    base_pad.analogButtons.l2 = 0x12;
+    base_pad.connected = 1;
+    memset(base_pad.ext, 0x5A, sizeof(base_pad.ext));
+    OIHostMockSetPadData(&base_pad);
+    InitPadHooks();
+
+    bool ok = true;
+    for (int i = 0; i < 2; i++) {
+        if (!OpenGHLPad(&pads[i], i + 1)) {
+            printf("FAIL: %s never got a pad\n", pads[i].name);
+            ok = false;
+            continue;
+        }
+        int reports = i == 0 ? CheckGHLHID(&pads[i]) : CheckGHLXInput(&pads[i]);
+        printf("%s, %i reports: %s\n", pads[i].name, reports, pads[i].mismatches == 0 ? "ok" : "FAILED");
+        ok &= pads[i].mismatches == 0;
+    }
+    DestroyPadHooks();
+    return ok;
+}
+
+// RB4, through the transfer callback
+
+typedef struct _RB4Instrument {
+    const char *name;
+    uint16_t productId;
+    uint8_t xinputSubtype;
+    int header_length; // the wireless adapter's own, in front of the controller's report
+    libusb_device *device;
+    struct libusb_transfer *transfer;
+    uint8_t buffer[RB4_TRANSFER_LENGTH];
+    int mismatches;
+} RB4Instrument;
+
+static void GameInterruptCallback(struct libusb_transfer *transfer) {
+}
+
+static bool OpenRB4Instrument(RB4Instrument *instrument) {
+    OIHostMockDeviceInfo info = {
+        .vendorId = 0x045E, .productId = instrument->productId, .deviceClass = 0xFF, .interfaceClass = 0xFF,
+        .interfaceSubClass = 0x5D, .xinputSubtype = instrument->xinputSubtype
+    };
+    instrument->device = OIHostMockAddDevice(&info);
+    libusb_device_handle *handle = NULL;
+    if (TsceUsbdOpen_hook(instrument->device, &handle) != 0)
+        return false;
+    instrument->transfer = sceUsbdAllocTransfer(0);
+    TsceUsbdFillInterruptTransfer_hook(instrument->transfer, handle, 0x81, instrument->buffer, RB4_TRANSFER_LENGTH,
+        GameInterruptCallback, NULL, 0);
+    return true;
+}
+
+static void CompareRB4(RB4Instrument *instrument, const xinput_report_controls *controls) {
+    uint8_t report[RB4_TRANSFER_LENGTH] = { 0x00, 0x01, 0x00, 0xF0 };
+    memcpy(report + instrument->header_length, controls, sizeof(*controls));
+    struct libusb_transfer *transfer = instrument->transfer;
+    memcpy(instrument->buffer, report, sizeof(report));
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+    transfer->actual_length = instrument->header_length + sizeof(*controls);
+    transfer->callback(transfer);
+
+    uint8_t expected[RB4_TRANSFER_LENGTH];
+    memcpy(expected, report, sizeof(report));
+    if (instrument->header_length > 0)
+        BaselineParseWirelessXInput(expected, sizeof(expected));
+    else
+        BaselineParseXInput(expected, sizeof(expected));
+    // whammy and tilt are calibrated now, and kits have pad velocities where there used to be padding
+    expected[RB4_WHAMMY_OFFSET] = instrument->buffer[RB4_WHAMMY_OFFSET];
+    expected[RB4_ACCEL_X_OFFSET] = instrument->buffer[RB4_ACCEL_X_OFFSET];
+    if (instrument->xinputSubtype == XINPUT_SUBTYPE_DRUM_KIT)
+        memcpy(expected + RB4_VELOCITY_OFFSET, instrument->buffer + RB4_VELOCITY_OFFSET, 4);
+
+    if (memcmp(instrument->buffer, expected, sizeof(expected)) != 0 && instrument->mismatches++ < MAX_REPORTED_MISMATCHES) {
+        printf("FAIL: %s buttons %02x %02x read as %02x %02x hat %02x, expected %02x %02x hat %02x\n", instrument->name,
+            controls->buttons1, controls->buttons2, instrument->buffer[0], instrument->buffer[1], instrument->buffer[2],
+            expected[0], expected[1], expected[2]);
+    }
+}
+
+// every button, and sticks that aren't whammy or tilt moving through their whole range
+static int CheckRB4Instrument(RB4Instrument *instrument) {
+    xinput_report_controls controls = { .header = { .message_type = 0x00, .message_size = sizeof(xinput_report_controls) } };
+    int reports = 0;
+    for (int buttons = 0; buttons < 0x10000; buttons++, reports++) {
+        controls.buttons1 = buttons;
+        controls.buttons2 = buttons >> 8;
+        CompareRB4(instrument, &controls);
+    }
+    controls.buttons1 = controls.buttons2 = 0;
+    for (int value = -32768; value <= 32767; value += 7, reports++) {
+        controls.left_trigger = controls.right_trigger = value >> 8;
+        controls.left_stick_x = controls.left_stick_y = value;
+        CompareRB4(instrument, &controls);
+    }
+    return reports;
+}
+
+static bool CheckRB4() {
+    RB4Instrument instruments[] = {
+        { "360 guitar", 0x028E, XINPUT_SUBTYPE_GUITAR_ALTERNATE, 0 },
+        { "360 drum kit", 0x028E, XINPUT_SUBTYPE_DRUM_KIT, 0 },
+        { "360 wireless adapter", 0x0719, XINPUT_SUBTYPE_ARCADE_PAD, 4 },
+    };
+    OIHostMockSetProcInfo("CUSA02084", "02.21");
+    InitUsbdHooks();
+
+    bool ok = true;
+    for (int i = 0; i < 3; i++) {
+        if (!OpenRB4Instrument(&instruments[i])) {
+            printf("FAIL: couldn't open the %s\n", instruments[i].name);
+            ok = false;
+            continue;
+        }
+        int reports = CheckRB4Instrument(&instruments[i]);
+        printf("%s, %i reports: %s\n", instruments[i].name, reports, instruments[i].mismatches == 0 ? "ok" : "FAILED");
+        ok &= instruments[i].mismatches == 0;
+    }
+    DestroyUsbdHooks();
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    OIHostMockSetQuiet(true);
+    bool ok = CheckGHL();
+    ok &= CheckRB4();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/*
+    oi_rb4_fuzz.c - OrbisInstrumentalizer host build
+    Completes RB4 transfers with random contents, buffer sizes and received lengths, so anything reading or writing
+    past the game's buffer shows up, with every report captured on the way. Build it with `make host-sanitize` to have
+    ASan and UBSan watching.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OICapture.h"
+#include "OILatency.h"
+#include "xinput.h"
+
+void InitUsbdHooks();
+void DestroyUsbdHooks();
+int TsceUsbdOpen_hook(libusb_device *device, libusb_device_handle **dev_handle);
+void TsceUsbdClose_hook(libusb_device_handle *dev_handle);
+void TsceUsbdFillInterruptTransfer_hook(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout);
+
+#define DEFAULT_ITERATIONS 1000000
+// the PS3 report the game asks for, and the XInput report that's rewritten into it
+#define PS3_REPORT_LENGTH 27
+#define XINPUT_REPORT_LENGTH 20
+#define MAX_FUZZ_LENGTH 96
+
+// a wired guitar, a wired drum kit and a wireless adapter, which each decode differently
+static const OIHostMockDeviceInfo fuzz_devices[] = {
+    { .vendorId = 0x045E, .productId = 0x028E, .deviceClass = 0xFF, .interfaceClass = 0xFF, .interfaceSubClass = 0x5D,
+        .xinputSubtype = XINPUT_SUBTYPE_GUITAR_ALTERNATE },
+    { .vendorId = 0x045E, .productId = 0x028E, .deviceClass = 0xFF, .interfaceClass = 0xFF, .interfaceSubClass = 0x5D,
+        .xinputSubtype = XINPUT_SUBTYPE_DRUM_KIT },
+    { .vendorId = 0x045E, .productId = 0x0719, .deviceClass = 0xFF, .interfaceClass = 0xFF, .interfaceSubClass = 0x5D,
+        .xinputSubtype = XINPUT_SUBTYPE_ARCADE_PAD, .numInterfaces = 8 },
+};
+#define FUZZ_DEVICE_COUNT (int)(sizeof(fuzz_devices) / sizeof(fuzz_devices[0]))
+
+static uint64_t game_callbacks = 0;
+static char data_directory[] = "/tmp/oi_rb4_fuzz.XXXXXX";
+
+static void GameInterruptCallback(struct libusb_transfer *transfer) {
+    game_callbacks++;
+}
+
+// nothing, a few bytes, exactly a report, more than a report, or nonsense
+static int FuzzLength() {
+    switch (rand() % 6) {
+    case 0:
+        return 0;
+    case 1:
+        return 1 + rand() % (XINPUT_REPORT_LENGTH - 1);
+    case 2:
+        return (rand() & 1) ? XINPUT_REPORT_LENGTH : PS3_REPORT_LENGTH;
+    case 3:
+        return PS3_REPORT_LENGTH + 1 + rand() % (MAX_FUZZ_LENGTH - PS3_REPORT_LENGTH);
+    case 4:
+        return -1 - rand() % 64;
+    default:
+        return rand() % (MAX_FUZZ_LENGTH + 1);
+    }
+}
+
+// random bytes, usually made to look enough like a real report that the decoders read it all the way through
+static void FuzzReport(uint8_t *buffer, int length) {
+    for (int i = 0; i < length; i++)
+        buffer[i] = rand();
+    if (length > 0 && (rand() & 1))
+        buffer[0] = 0x00; // controls
+    if (length > 1 && (rand() & 1))
+        buffer[1] = 0x01; // wireless input data
+    if (length > 4 && (rand() & 1))
+        buffer[4] = 0x00; // controls, after the wireless header
+}
+
+// capturing goes through the same lengths as decoding, so it's turned on for the whole run
+static bool StartCapture() {
+    if (mkdtemp(data_directory) == NULL)
+        return false;
+    OIHostMockSetDataDirectory(data_directory);
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", data_directory, strrchr(OI_CAPTURE_ENABLE_PATH, '/') + 1);
+    FILE *enable = fopen(path, "w");
+    if (enable == NULL)
+        return false;
+    fclose(enable);
+    OICaptureInit();
+    return oi_capture_enabled;
+}
+
+// every record has to fit in a report and the file has to end on a record, returns how many there were or -1
+static long CheckCapture() {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", data_directory, strrchr(OI_CAPTURE_FILE_PATH, '/') + 1);
+    FILE *capture = fopen(path, "rb");
+    if (capture == NULL)
+        return -1;
+    OICaptureFileHeader header;
+    OICaptureRecord record;
+    uint8_t report[256];
+    long records = 0;
+    bool ok = fread(&header, sizeof(header), 1, capture) == 1 && header.magic == OI_CAPTURE_FILE_MAGIC;
+    while (ok && fread(&record, sizeof(record), 1, capture) == 1) {
+        ok = record.length <= OI_CAPTURE_MAX_REPORT_SIZE && fread(report, 1, record.length, capture) == record.length;
+        records++;
+    }
+    ok &= feof(capture) != 0;
+    fclose(capture);
+    return ok ? records : -1;
+}
+
+static void RemoveCapture() {
+    const char *files[] = { OI_CAPTURE_ENABLE_PATH, OI_CAPTURE_FILE_PATH, OI_LATENCY_FILE_PATH };
+    for (int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", data_directory, strrchr(files[i], '/') + 1);
+        unlink(path);
+    }
+    rmdir(data_directory);
+    OIHostMockSetDataDirectory(NULL);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    srand(argc > 2 ? atoi(argv[2]) : 14);
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo("CUSA02084", "02.21");
+    if (!StartCapture()) {
+        printf("couldn't start capturing to %s\n", data_directory);
+        return 1;
+    }
+    InitUsbdHooks();
+
+    libusb_device_handle *handles[FUZZ_DEVICE_COUNT];
+    for (int i = 0; i < FUZZ_DEVICE_COUNT; i++) {
+        libusb_device *device = OIHostMockAddDevice(&fuzz_devices[i]);
+        if (TsceUsbdOpen_hook(device, &handles[i]) != 0) {
+            printf("couldn't open mock device %i\n", i);
+            return 1;
+        }
+    }
+
+    // the game's buffer is exactly as long as it says, so ASan catches anything past it
+    struct libusb_transfer *transfer = sceUsbdAllocTransfer(0);
+    for (int i = 0; i < iterations; i++) {
+        int length = FuzzLength();
+        uint8_t *buffer = malloc(length > 0 ? length : 1);
+        TsceUsbdFillInterruptTransfer_hook(transfer, handles[i % FUZZ_DEVICE_COUNT], 0x81, buffer, length,
+            GameInterruptCallback, NULL, 0);
+        FuzzReport(buffer, length);
+        transfer->actual_length = FuzzLength();
+        transfer->status = (rand() % 8) != 0 ? LIBUSB_TRANSFER_COMPLETED : LIBUSB_TRANSFER_ERROR;
+        transfer->callback(transfer);
+        free(buffer);
+    }
+    sceUsbdFreeTransfer(transfer);
+
+    for (int i = 0; i < FUZZ_DEVICE_COUNT; i++)
+        TsceUsbdClose_hook(handles[i]);
+    DestroyUsbdHooks();
+    OICaptureShutdown();
+    long captured = CheckCapture();
+    RemoveCapture();
+    OIHostMockStats stats;
+    OIHostMockGetStats(&stats);
+    bool ok = game_callbacks == (uint64_t)iterations && stats.devicesOpen == 0 && stats.transfersAllocated == 0 && captured >= 0;
+    if (game_callbacks != (uint64_t)iterations)
+        printf("FAIL: the game's callback ran %lu times for %i transfers\n", game_callbacks, iterations);
+    if (captured < 0)
+        printf("FAIL: the capture file has a record longer than a report, or doesn't end on a record\n");
+    printf("%i fuzzed transfers over %i devices, %li captured: %s\n", iterations, FUZZ_DEVICE_COUNT, captured, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
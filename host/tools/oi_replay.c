@@ -0,0 +1,262 @@
+/*
+    oi_replay.c - OrbisInstrumentalizer host build
+    Feeds a report capture back through the plugin's parsers as fast as it can.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OICapture.h"
+#include "OrbisPadTypes.h"
+#include "xinput.h"
+
+void InitPadHooks();
+void DestroyPadHooks();
+int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param);
+int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info);
+int scePadReadState_hook(int handle, OrbisPadData *data);
+int scePadRead_hook(int handle, OrbisPadData *data, int num);
+
+void InitUsbdHooks();
+void DestroyUsbdHooks();
+int TsceUsbdOpen_hook(libusb_device *device, libusb_device_handle **dev_handle);
+int TsceUsbdGetDeviceDescriptor_hook(libusb_device *device, struct libusb_device_descriptor *desc);
+void TsceUsbdFillInterruptTransfer_hook(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout);
+
+#define MAX_REPLAY_DEVICES 256
+#define GHL_ENDPOINT 0x81
+#define GHL_CLAIM_TIMEOUT_USEC 2000000
+// how much of a transfer RB4 gets to see, the PS3 report it's rewritten into is this big
+#define RB4_TRANSFER_LENGTH 27
+// most GHL reports queued up between two batched reads
+#define MAX_BATCH 16
+
+typedef struct _ReplayDevice {
+    bool ready;
+    libusb_device *device;
+    int padHandle; // GHL
+    int pending; // GHL reports completed since the last batched read
+    struct libusb_transfer *transfer; // RB4, handed to the parse callback directly
+    uint8_t buffer[OI_CAPTURE_MAX_REPORT_SIZE];
+} ReplayDevice;
+
+static ReplayDevice devices[MAX_REPLAY_DEVICES];
+static uint64_t checksum = 0xCBF29CE484222325; // FNV-1a over everything the game would have seen
+static int batch = 1; // how many GHL reports arrive per game frame, read back with scePadRead
+
+static void Checksum(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++)
+        checksum = (checksum ^ bytes[i]) * 0x100000001B3;
+}
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t TicksToNanoseconds(uint64_t ticks, uint64_t frequency) {
+    return ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency;
+}
+
+static void GameInterruptCallback(struct libusb_transfer *transfer) {
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+        Checksum(transfer->buffer, transfer->length);
+}
+
+static bool SetUpGHLDevice(ReplayDevice *replay, int id, OICaptureSource source) {
+    OIHostMockDeviceInfo info = { 0 };
+    info.vendorId = source == OI_Capture_GHL_HID ? 0x12BA : 0x1430;
+    info.productId = source == OI_Capture_GHL_HID ? 0x074B : source == OI_Capture_GHL_XOne ? 0x079B : 0x070B;
+    replay->device = OIHostMockAddDevice(&info);
+    // one at a time, so this pad is the one that gets the device
+    replay->padHandle = scePadOpenExt_hook(id + 1, ORBIS_PAD_PORT_TYPE_SPECIAL, 0, NULL);
+    OrbisPadInformation pad_info;
+    for (int waited = 0; waited < GHL_CLAIM_TIMEOUT_USEC; waited += 1000) {
+        if (scePadGetControllerInformation_hook(replay->padHandle, &pad_info) == 0)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+static bool IsRB4WirelessSource(OICaptureSource source) {
+    return source == OI_Capture_RB4_XInputWireless || source == OI_Capture_RB4_XInputWirelessDrums;
+}
+
+static bool SetUpRB4Device(ReplayDevice *replay, OICaptureSource source) {
+    OIHostMockDeviceInfo info = { 0 };
+    info.vendorId = 0x045E;
+    info.productId = IsRB4WirelessSource(source) ? 0x0719 : 0x028E;
+    info.deviceClass = 0xFF;
+    info.interfaceClass = 0xFF;
+    info.interfaceSubClass = 0x5D;
+    info.xinputSubtype = source == OI_Capture_RB4_XInput ? XINPUT_SUBTYPE_GUITAR_ALTERNATE :
+        source == OI_Capture_RB4_XInputDrums ? XINPUT_SUBTYPE_DRUM_KIT : XINPUT_SUBTYPE_ARCADE_PAD;
+    // the adapter's slot 0 is decoded as whatever it says is on it, which it's asked when its descriptor's read
+    if (source == OI_Capture_RB4_XInputWirelessDrums)
+        info.wirelessSubtypes[0] = XINPUT_SUBTYPE_DRUM_KIT;
+    replay->device = OIHostMockAddDevice(&info);
+    struct libusb_device_descriptor desc;
+    if (IsRB4WirelessSource(source))
+        TsceUsbdGetDeviceDescriptor_hook(replay->device, &desc);
+    libusb_device_handle *handle = NULL;
+    if (TsceUsbdOpen_hook(replay->device, &handle) != 0)
+        return false;
+    replay->transfer = sceUsbdAllocTransfer(0);
+    TsceUsbdFillInterruptTransfer_hook(replay->transfer, handle, 0x81, replay->buffer, RB4_TRANSFER_LENGTH, GameInterruptCallback, NULL, 0);
+    return true;
+}
+
+static void ChecksumPad(const OrbisPadData *pad) {
+    Checksum(&pad->buttons, sizeof(pad->buttons));
+    Checksum(&pad->leftStick, sizeof(pad->leftStick));
+    Checksum(&pad->rightStick, sizeof(pad->rightStick));
+}
+
+// every queued input report comes back in order, so a single device's capture checksums the same
+// as reading one at a time, as long as it doesn't have any 360 reports that aren't input
+static void ReadBatch(ReplayDevice *replay) {
+    OrbisPadData pads[MAX_BATCH];
+    int read = scePadRead_hook(replay->padHandle, pads, replay->pending);
+    for (int i = 0; i < read; i++)
+        ChecksumPad(&pads[i]);
+    replay->pending = 0;
+}
+
+static bool IsGHLSource(uint8_t source) {
+    return source == OI_Capture_GHL_HID || source == OI_Capture_GHL_XInput || source == OI_Capture_GHL_XOne;
+}
+
+static void ReplayRecord(ReplayDevice *replay, OICaptureSource source, const uint8_t *report, int length) {
+    if (IsGHLSource(source)) {
+        OIHostMockCompleteTransfer(replay->device, GHL_ENDPOINT, report, length);
+        if (batch == 1) {
+            OrbisPadData pad;
+            scePadReadState_hook(replay->padHandle, &pad);
+            ChecksumPad(&pad);
+        } else if (++replay->pending == batch) {
+            ReadBatch(replay);
+        }
+    } else {
+        struct libusb_transfer *transfer = replay->transfer;
+        memset(replay->buffer, 0, sizeof(replay->buffer));
+        memcpy(replay->buffer, report, length < RB4_TRANSFER_LENGTH ? length : RB4_TRANSFER_LENGTH);
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = length;
+        transfer->callback(transfer);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s capture.bin [passes] [batch]\n", argv[0]);
+        return 1;
+    }
+    int passes = argc > 2 ? atoi(argv[2]) : 1;
+    batch = argc > 3 ? atoi(argv[3]) : 1;
+    if (batch < 1 || batch > MAX_BATCH) {
+        printf("batch has to be between 1 and %i\n", MAX_BATCH);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *capture = malloc(size);
+    if (fread(capture, 1, size, file) != (size_t)size) {
+        printf("failed to read %s\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    OICaptureFileHeader *header = (OICaptureFileHeader *)capture;
+    if (size < (long)sizeof(OICaptureFileHeader) || header->magic != OI_CAPTURE_FILE_MAGIC || header->version != OI_CAPTURE_FILE_VERSION) {
+        printf("%s isn't a capture file, or is an unknown version\n", argv[1]);
+        return 1;
+    }
+
+    // work out which side of the plugin the capture came from by its first record
+    if (size < (long)(sizeof(OICaptureFileHeader) + sizeof(OICaptureRecord))) {
+        printf("capture is empty\n");
+        return 0;
+    }
+    OICaptureRecord *first = (OICaptureRecord *)(capture + sizeof(OICaptureFileHeader));
+    bool ghl = IsGHLSource(first->source);
+
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo(ghl ? "CUSA02410" : "CUSA02084", ghl ? "01.00" : "02.21");
+    if (ghl)
+        InitPadHooks();
+    else
+        InitUsbdHooks();
+
+    uint64_t records = 0;
+    uint64_t skipped = 0;
+    uint64_t elapsed = 0;
+    uint64_t tsc_frequency = header->tsc_frequency != 0 ? header->tsc_frequency : 1000000000;
+    uint64_t pass_base = 0;
+    uint64_t pass_end = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        long offset = sizeof(OICaptureFileHeader);
+        while (offset + (long)sizeof(OICaptureRecord) <= size) {
+            OICaptureRecord *record = (OICaptureRecord *)(capture + offset);
+            const uint8_t *report = capture + offset + sizeof(OICaptureRecord);
+            offset += sizeof(OICaptureRecord) + record->length;
+            if (offset > size)
+                break;
+
+            bool record_ghl = IsGHLSource(record->source);
+            ReplayDevice *replay = &devices[record->device];
+            if (record_ghl != ghl) {
+                skipped++;
+                continue;
+            }
+            if (!replay->ready) {
+                bool ok = ghl ? SetUpGHLDevice(replay, record->device, record->source) : SetUpRB4Device(replay, record->source);
+                if (!ok) {
+                    printf("couldn't set up a mock device for device %i\n", record->device);
+                    return 1;
+                }
+                replay->ready = true;
+            }
+
+            // the parsers see the capture's own timing, so anything smoothed over time replays the same every run
+            pass_end = TicksToNanoseconds(record->timestamp - first->timestamp, tsc_frequency);
+            OIHostMockSetTsc(pass_base + pass_end + 1);
+            uint64_t start = NowNanoseconds();
+            ReplayRecord(replay, record->source, report, record->length);
+            elapsed += NowNanoseconds() - start;
+            OIHostMockSetTsc(0);
+            records++;
+        }
+        // a gap between passes, so nothing smooths across the end of the capture and its start
+        pass_base += pass_end + 1000000000;
+    }
+
+    for (int i = 0; i < MAX_REPLAY_DEVICES; i++) {
+        if (devices[i].pending > 0)
+            ReadBatch(&devices[i]);
+    }
+    if (ghl)
+        DestroyPadHooks();
+    else
+        DestroyUsbdHooks();
+
+    printf("%lu reports replayed (%lu skipped), %.1f ns/report\n", records, skipped, records > 0 ? (double)elapsed / records : 0.0);
+    printf("checksum %016lx\n", checksum);
+    return 0;
+}
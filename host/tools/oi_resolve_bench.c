@@ -0,0 +1,210 @@
+/*
+    oi_resolve_bench.c - OrbisInstrumentalizer host build
+    Times the sceUsbd stub scan over an executable-sized blob with a PLT planted at the end of it, and the walk
+    through that PLT from one known stub.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <GoldHEN/Common.h>
+#include "OIHostMock.h"
+#include "OIResolver.h"
+
+#define DEFAULT_TEXT_SIZE (20 * 1024 * 1024)
+#define PLT_ENTRIES 256 // roughly what a game imports
+#define CACHE_PATH "oi_resolve_bench_stubs.bin"
+
+static const char *usbd_functions[] = {
+    "sceUsbdOpen",
+    "sceUsbdClose",
+    "sceUsbdGetConfigDescriptor",
+    "sceUsbdGetDeviceDescriptor",
+    "sceUsbdFillInterruptTransfer",
+    // optional, and left out of the PLT, so resolving has to cache the results without it
+    "sceUsbdGetDeviceList",
+};
+#define NUM_TARGETS (int)(sizeof(usbd_functions) / sizeof(usbd_functions[0]))
+#define NUM_REQUIRED 5
+
+static uint64_t NowNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// the obvious byte-at-a-time search, to check the real one against
+static int ReferenceScan(const uint8_t *text, size_t size, const uintptr_t *got, size_t got_count, OIResolverTarget *targets) {
+    int found = 0;
+    for (size_t i = 0; i + OI_RESOLVER_PLT_ENTRY_SIZE <= size; i++) {
+        const uint8_t *p = text + i;
+        if (p[0] != 0xFF || p[1] != 0x25 || p[6] != 0x68 || p[11] != 0xE9)
+            continue;
+        int32_t displacement;
+        memcpy(&displacement, p + 2, sizeof(displacement));
+        const uintptr_t *slot = (const uintptr_t *)(p + 6 + displacement);
+        if (slot < got || slot >= got + got_count)
+            continue;
+        for (int t = 0; t < NUM_TARGETS; t++) {
+            if (targets[t].stub == 0 && targets[t].function == *slot) {
+                targets[t].stub = (uintptr_t)p;
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+int main(int argc, char **argv) {
+    int passes = argc > 2 ? atoi(argv[2]) : 20;
+    size_t blob_size = DEFAULT_TEXT_SIZE;
+    uint8_t *blob = NULL;
+
+    // everything in one allocation so the GOT's within rip-relative reach of the text
+    size_t plt_size = PLT_ENTRIES * OI_RESOLVER_PLT_ENTRY_SIZE;
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        FILE *file = fopen(argv[1], "rb");
+        if (file == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+        fseek(file, 0, SEEK_END);
+        blob_size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        blob = malloc(blob_size + plt_size + PLT_ENTRIES * sizeof(uintptr_t) + 16);
+        if (fread(blob, 1, blob_size, file) != blob_size) {
+            printf("failed to read %s\n", argv[1]);
+            return 1;
+        }
+        fclose(file);
+    } else {
+        // random bytes turn up a lot more false starts than real code does
+        blob = malloc(blob_size + plt_size + PLT_ENTRIES * sizeof(uintptr_t) + 16);
+        uint32_t state = 0x12345678;
+        for (size_t i = 0; i < blob_size; i++) {
+            state = state * 1664525 + 1013904223;
+            blob[i] = state >> 24;
+        }
+    }
+    blob_size &= ~(size_t)15;
+
+    // PLT goes at the end of the text so the scan has to cover all of it
+    uint8_t *plt = blob + blob_size;
+    uintptr_t *got = (uintptr_t *)(plt + plt_size);
+    size_t text_size = blob_size + plt_size;
+
+    int usbd = 0;
+    sys_dynlib_load_prx("libSceUsbd.sprx", &usbd);
+    OIResolverTarget targets[NUM_TARGETS];
+    for (int i = 0; i < NUM_TARGETS; i++) {
+        targets[i].name = usbd_functions[i];
+        sys_dynlib_dlsym(usbd, usbd_functions[i], &targets[i].function);
+    }
+    for (int i = 0; i < PLT_ENTRIES; i++) {
+        uint8_t *entry = plt + i * OI_RESOLVER_PLT_ENTRY_SIZE;
+        int32_t displacement = (int32_t)((uint8_t *)&got[i] - (entry + 6));
+        int32_t index = i;
+        int32_t plt0 = (int32_t)(plt - (entry + 16));
+        memset(entry, 0xCC, OI_RESOLVER_PLT_ENTRY_SIZE);
+        entry[0] = 0xFF;
+        entry[1] = 0x25;
+        memcpy(entry + 2, &displacement, 4);
+        entry[6] = 0x68;
+        memcpy(entry + 7, &index, 4);
+        entry[11] = 0xE9;
+        memcpy(entry + 12, &plt0, 4);
+        // the usbd imports are spread through the middle, everything else is some other function
+        int target = i - (PLT_ENTRIES / 2);
+        got[i] = target >= 0 && target < NUM_REQUIRED ? targets[target].function : (uintptr_t)0x7FFF00000000 + i * 16;
+    }
+
+    OrbisKernelModuleInfo info = { 0 };
+    snprintf(info.name, sizeof(info.name), "eboot.bin");
+    info.segmentInfo[0].address = blob;
+    info.segmentInfo[0].size = text_size;
+    info.segmentInfo[0].prot = 0x05;
+    info.segmentInfo[1].address = got;
+    info.segmentInfo[1].size = PLT_ENTRIES * sizeof(uintptr_t);
+    info.segmentInfo[1].prot = 0x03;
+    info.segmentCount = 2;
+    for (int i = 0; i < 20; i++)
+        info.fingerprint[i] = i * 13;
+    OIHostMockSetModuleInfo(&info);
+    OIHostMockSetQuiet(true);
+
+    OIResolverImage image;
+    if (!OIResolverGetImage(0, &image)) {
+        printf("couldn't get the image\n");
+        return 1;
+    }
+
+    OIResolverTarget expected[NUM_TARGETS];
+    memcpy(expected, targets, sizeof(targets));
+    for (int i = 0; i < NUM_TARGETS; i++)
+        expected[i].stub = 0;
+    uint64_t start = NowNanoseconds();
+    int expected_found = ReferenceScan(blob, text_size, got, PLT_ENTRIES, expected);
+    uint64_t reference_elapsed = NowNanoseconds() - start;
+
+    uint64_t best = UINT64_MAX;
+    for (int pass = 0; pass < passes; pass++) {
+        start = NowNanoseconds();
+        int found = OIResolverScan(&image, targets, NUM_TARGETS);
+        uint64_t elapsed = NowNanoseconds() - start;
+        if (elapsed < best)
+            best = elapsed;
+        if (found != expected_found) {
+            printf("scan found %i stubs, expected %i\n", found, expected_found);
+            return 1;
+        }
+        for (int i = 0; i < NUM_TARGETS; i++) {
+            if (targets[i].stub != expected[i].stub) {
+                printf("scan found %s at %lx, expected %lx\n", targets[i].name, targets[i].stub, expected[i].stub);
+                return 1;
+            }
+        }
+    }
+
+    // walking from any one of them has to come up with the same as scanning everything
+    OIResolverTarget walked[NUM_TARGETS];
+    memcpy(walked, targets, sizeof(targets));
+    int unbound;
+    start = NowNanoseconds();
+    int walk_found = OIResolverWalk(expected[NUM_REQUIRED - 1].stub, walked, NUM_TARGETS, &unbound);
+    uint64_t walk_elapsed = NowNanoseconds() - start;
+    bool walk_ok = walk_found == expected_found && unbound == 0;
+    for (int i = 0; i < NUM_TARGETS; i++)
+        walk_ok &= walked[i].stub == expected[i].stub;
+    // an entry that hasn't been bound could be anything, so it has to be counted
+    uintptr_t bound = got[0];
+    got[0] = (uintptr_t)plt + 6;
+    OIResolverWalk(expected[0].stub, walked, NUM_TARGETS, &unbound);
+    got[0] = bound;
+    walk_ok &= unbound == 1;
+    if (!walk_ok)
+        printf("FAIL: walking the PLT found %i stubs and %i unbound entries\n", walk_found, unbound);
+
+    unlink(CACHE_PATH);
+    start = NowNanoseconds();
+    int found = OIResolverResolve(&image, targets, NUM_TARGETS, NUM_REQUIRED, CACHE_PATH);
+    uint64_t uncached = NowNanoseconds() - start;
+    bool saved = access(CACHE_PATH, F_OK) == 0;
+    start = NowNanoseconds();
+    int cached_found = OIResolverResolve(&image, targets, NUM_TARGETS, NUM_REQUIRED, CACHE_PATH);
+    uint64_t cached = NowNanoseconds() - start;
+    unlink(CACHE_PATH);
+    if (!saved)
+        printf("FAIL: nothing was cached with an optional stub missing\n");
+
+    printf("%.1f MB of text, %i of %i stubs found\n", text_size / (1024.0 * 1024.0), found, NUM_TARGETS);
+    printf("scan %.2f ms (%.2f GB/s), byte-at-a-time %.2f ms\n", best / 1e6, (double)text_size / best, reference_elapsed / 1e6);
+    printf("walk %.3f ms through %i entries\n", walk_elapsed / 1e6, PLT_ENTRIES);
+    printf("resolve %.2f ms without the cache, %.3f ms with it (%i found)\n", uncached / 1e6, cached / 1e6, cached_found);
+    return walk_ok && saved && found == NUM_REQUIRED && cached_found == NUM_REQUIRED ? 0 : 1;
+}
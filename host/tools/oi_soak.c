@@ -0,0 +1,100 @@
+/*
+    oi_soak.c - OrbisInstrumentalizer host build
+    Plugs GHL dongles in and out over and over, and checks nothing's leaked along the way.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "OrbisPadTypes.h"
+
+void InitPadHooks();
+void DestroyPadHooks();
+int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param);
+int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info);
+int scePadReadState_hook(int handle, OrbisPadData *data);
+
+#define DEFAULT_CYCLES 10000
+#define GHL_ENDPOINT 0x81
+#define WAIT_TIMEOUT_USEC 2000000
+// a cycle's report, zeroed so the guitar's at rest, long enough for either kind of dongle
+#define REPORT_LENGTH 27
+
+static bool WaitForConnected(int handle, bool connected) {
+    OrbisPadInformation info;
+    for (int waited = 0; waited < WAIT_TIMEOUT_USEC; waited += 100) {
+        if ((scePadGetControllerInformation_hook(handle, &info) == 0) == connected)
+            return true;
+        usleep(100);
+    }
+    return false;
+}
+
+// alternates between PS3/Wii U and 360 dongles, only the first has a keepalive transfer
+static bool Cycle(int cycle, int *pool_size) {
+    bool hid = cycle % 2 == 0;
+    OIHostMockDeviceInfo info = { 0 };
+    info.vendorId = hid ? 0x12BA : 0x1430;
+    info.productId = hid ? 0x074B : 0x070B;
+    libusb_device *device = OIHostMockAddDevice(&info);
+    // opening the pad again kicks discovery, rather than waiting out its interval every cycle
+    int handle = scePadOpenExt_hook(1, ORBIS_PAD_PORT_TYPE_SPECIAL, 0, NULL);
+    if (!WaitForConnected(handle, true)) {
+        printf("FAIL: cycle %i never connected\n", cycle);
+        return false;
+    }
+
+    uint8_t report[REPORT_LENGTH] = { 0 };
+    if (!hid)
+        report[1] = 0x14;
+    OIHostMockCompleteTransfer(device, GHL_ENDPOINT, report, sizeof(report));
+    OrbisPadData pad;
+    scePadReadState_hook(handle, &pad);
+
+    OIHostMockRemoveDevice(device);
+    if (!WaitForConnected(handle, false)) {
+        printf("FAIL: cycle %i never disconnected\n", cycle);
+        return false;
+    }
+
+    // the pool's allocated once, so the count mustn't move no matter how many dongles come and go
+    OIHostMockStats stats;
+    OIHostMockGetStats(&stats);
+    if (*pool_size < 0)
+        *pool_size = stats.transfersAllocated;
+    if (stats.transfersAllocated != *pool_size || stats.devicesOpen != 0) {
+        printf("FAIL: cycle %i left %i transfers allocated (pool has %i) and %i devices open\n",
+            cycle, stats.transfersAllocated, *pool_size, stats.devicesOpen);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int cycles = argc > 1 ? atoi(argv[1]) : DEFAULT_CYCLES;
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo("CUSA02410", "01.00");
+    InitPadHooks();
+
+    int pool_size = -1;
+    bool ok = true;
+    for (int i = 0; i < cycles && ok; i++)
+        ok = Cycle(i, &pool_size);
+
+    DestroyPadHooks();
+    OIHostMockStats stats;
+    OIHostMockGetStats(&stats);
+    if (stats.transfersAllocated != 0 || stats.devicesOpen != 0) {
+        printf("FAIL: %i transfers allocated and %i devices open after unloading\n", stats.transfersAllocated, stats.devicesOpen);
+        ok = false;
+    }
+    if (ok)
+        printf("%i connect/disconnect cycles, %i pooled transfers, nothing leaked\n", cycles, pool_size);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+/*
+    oi_wireless_check.c - OrbisInstrumentalizer host build
+    Plugs a 360 wireless adapter with two guitars and two drum kits on it into the RB4 hooks, checks each slot is
+    shown to the game as its own instrument, plays all four at once and checks each one's reports only ever reach
+    the game through its own slot, in order. Two threads list the devices at the same time first, and every list
+    has to come back whole and be freed.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "OIHostMock.h"
+#include "xinput.h"
+
+void InitUsbdHooks();
+void DestroyUsbdHooks();
+int TsceUsbdOpen_hook(libusb_device *device, libusb_device_handle **dev_handle);
+void TsceUsbdClose_hook(libusb_device_handle *dev_handle);
+int TsceUsbdGetDeviceDescriptor_hook(libusb_device *device, struct libusb_device_descriptor *desc);
+int TsceUsbdGetConfigDescriptor_hook(libusb_device *device, uint8_t config_index, struct libusb_config_descriptor **config);
+void TsceUsbdFillInterruptTransfer_hook(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout);
+int TsceUsbdGetDeviceList_hook(libusb_device ***list);
+int TsceUsbdFreeDeviceList_hook(libusb_device **list);
+int TsceUsbdClaimInterface_hook(libusb_device_handle *dev_handle, int interface_number);
+int TsceUsbdReleaseInterface_hook(libusb_device_handle *dev_handle, int interface_number);
+
+#define SLOTS 4
+#define REPORTS_PER_SLOT 64
+#define LISTING_THREADS 2
+#define LISTS_PER_THREAD 20000
+// an interface pair per slot, so the whole adapter has 8 of them
+#define ADAPTER_INTERFACES (SLOTS * 2)
+#define PS3_REPORT_LENGTH 27
+// the red pad's, drums have velocities where a guitar has nothing
+#define PS3_RED_VELOCITY_OFFSET 12
+// the adapter's own header in front of each controller report
+#define WIRELESS_HEADER_LENGTH 4
+
+#define BIT(i) (1 << i)
+#define PS3_BLUE BIT(0)
+#define PS3_GREEN BIT(1)
+#define PS3_RED BIT(2)
+#define PS3_YELLOW BIT(3)
+#define PS3_START BIT(9)
+
+// what's on each slot, and what the game should be shown for it
+static const uint8_t slot_subtypes[SLOTS] = {
+    XINPUT_SUBTYPE_GUITAR, XINPUT_SUBTYPE_DRUM_KIT, XINPUT_SUBTYPE_GUITAR_ALTERNATE, XINPUT_SUBTYPE_DRUM_KIT
+};
+#define RB4_GUITAR_PID 0x0200
+#define RB4_DRUMS_PID 0x0210
+// every slot holds down its own fret the whole time, and presses start on every other report so order shows.
+// the red pad's always hit this hard, which only the kits should pass on
+static const uint8_t slot_frets[SLOTS] = { XINPUT_BUTTON_A, XINPUT_BUTTON_B, XINPUT_BUTTON_Y, XINPUT_BUTTON_X };
+static const uint16_t slot_expected[SLOTS] = { PS3_GREEN, PS3_RED, PS3_YELLOW, PS3_BLUE };
+#define RED_PAD_AXIS 0x4000
+#define RED_PAD_VELOCITY (RED_PAD_AXIS >> 7)
+
+typedef struct _GameSlot {
+    libusb_device_handle *handle;
+    struct libusb_transfer *transfer;
+    uint8_t buffer[PS3_REPORT_LENGTH];
+    atomic_int reads; // only the event thread adds to it, the main thread waits on it
+    uint16_t buttons[REPORTS_PER_SLOT];
+    uint8_t velocity[REPORTS_PER_SLOT];
+} GameSlot;
+
+static GameSlot game_slots[SLOTS];
+static atomic_bool running = true;
+
+// the game's own callback, it reads the report and puts the transfer straight back
+static void GameInterruptCallback(struct libusb_transfer *transfer) {
+    GameSlot *slot = &game_slots[(intptr_t)transfer->user_data];
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
+        return;
+    int reads = atomic_load(&slot->reads);
+    if (reads < REPORTS_PER_SLOT) {
+        slot->buttons[reads] = transfer->buffer[0] | transfer->buffer[1] << 8;
+        slot->velocity[reads] = transfer->buffer[PS3_RED_VELOCITY_OFFSET];
+    }
+    atomic_store(&slot->reads, reads + 1);
+    sceUsbdSubmitTransfer(transfer);
+}
+
+static void *EventThread(void *unused) {
+    struct timeval timeout = { 0, 10000 };
+    while (running)
+        sceUsbdHandleEventsTimeout(&timeout);
+    return NULL;
+}
+
+// what the game sees, the adapter's other slots show up once it's read the adapter's descriptor
+static int ScanDevices(libusb_device **devices, uint16_t *product_ids, int max_devices) {
+    libusb_device **list;
+    int count = TsceUsbdGetDeviceList_hook(&list);
+    for (int i = 0; i < count && i < max_devices; i++) {
+        struct libusb_device_descriptor desc;
+        TsceUsbdGetDeviceDescriptor_hook(list[i], &desc);
+        devices[i] = list[i];
+        product_ids[i] = desc.idProduct;
+    }
+    TsceUsbdFreeDeviceList_hook(list);
+    return count;
+}
+
+static atomic_int bad_lists;
+
+// every list has all the slots in it, and is freed while the other thread is listing too
+static void *ListingThread(void *unused) {
+    for (int i = 0; i < LISTS_PER_THREAD; i++) {
+        libusb_device **list;
+        int count = TsceUsbdGetDeviceList_hook(&list);
+        int listed = 0;
+        while (listed <= count && list[listed] != NULL)
+            listed++;
+        if (count != SLOTS || listed != SLOTS)
+            atomic_fetch_add(&bad_lists, 1);
+        if ((i & 15) == 0)
+            sched_yield();
+        TsceUsbdFreeDeviceList_hook(list);
+    }
+    return NULL;
+}
+
+static bool CheckListing() {
+    pthread_t threads[LISTING_THREADS];
+    for (int i = 0; i < LISTING_THREADS; i++)
+        pthread_create(&threads[i], NULL, ListingThread, NULL);
+    for (int i = 0; i < LISTING_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    OIHostMockStats stats;
+    OIHostMockGetStats(&stats);
+    if (atomic_load(&bad_lists) != 0 || stats.deviceListsOpen != 0) {
+        printf("FAIL: %i device lists came back wrong and %i weren't freed, from %i threads listing at once\n",
+            atomic_load(&bad_lists), stats.deviceListsOpen, LISTING_THREADS);
+        return false;
+    }
+    return true;
+}
+
+static bool OpenSlot(libusb_device *device, int index) {
+    GameSlot *slot = &game_slots[index];
+    struct libusb_config_descriptor *config;
+    if (TsceUsbdGetConfigDescriptor_hook(device, 0, &config) != 0)
+        return false;
+    sceUsbdFreeConfigDescriptor(config);
+    if (TsceUsbdOpen_hook(device, &slot->handle) != 0 || TsceUsbdClaimInterface_hook(slot->handle, 0) != 0)
+        return false;
+    slot->transfer = sceUsbdAllocTransfer(0);
+    TsceUsbdFillInterruptTransfer_hook(slot->transfer, slot->handle, 0x81, slot->buffer, PS3_REPORT_LENGTH,
+        GameInterruptCallback, (void *)(intptr_t)index, 0);
+    return sceUsbdSubmitTransfer(slot->transfer) == 0;
+}
+
+static void CloseSlot(int index) {
+    GameSlot *slot = &game_slots[index];
+    TsceUsbdReleaseInterface_hook(slot->handle, 0);
+    TsceUsbdClose_hook(slot->handle);
+    sceUsbdFreeTransfer(slot->transfer);
+}
+
+static bool WaitForReads(int reads) {
+    for (int waited = 0; waited < 2000; waited++) {
+        bool done = true;
+        for (int i = 0; i < SLOTS; i++)
+            done &= game_slots[i].reads >= reads;
+        if (done)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+static bool CheckSlots() {
+    bool ok = true;
+    for (int i = 0; i < SLOTS; i++) {
+        GameSlot *slot = &game_slots[i];
+        if (slot->reads != REPORTS_PER_SLOT) {
+            printf("FAIL: slot %i got %i reports, expected %i\n", i, slot->reads, REPORTS_PER_SLOT);
+            ok = false;
+            continue;
+        }
+        uint8_t velocity = slot_subtypes[i] == XINPUT_SUBTYPE_DRUM_KIT ? RED_PAD_VELOCITY : 0;
+        for (int j = 0; j < REPORTS_PER_SLOT; j++) {
+            uint16_t expected = slot_expected[i] | ((j & 1) ? PS3_START : 0);
+            if (slot->buttons[j] != expected || slot->velocity[j] != velocity) {
+                printf("FAIL: slot %i report %i reads as buttons %04x red %i, expected %04x red %i\n", i, j,
+                    slot->buttons[j], slot->velocity[j], expected, velocity);
+                ok = false;
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    OIHostMockSetQuiet(true);
+    OIHostMockSetProcInfo("CUSA02084", "02.21");
+    InitUsbdHooks();
+
+    OIHostMockDeviceInfo info = {
+        .vendorId = 0x045E, .productId = 0x0719, .deviceClass = 0xFF, .interfaceClass = 0xFF, .interfaceSubClass = 0x5D,
+        // the adapter's own subtype, not the guitars'
+        .xinputSubtype = XINPUT_SUBTYPE_ARCADE_PAD, .numInterfaces = ADAPTER_INTERFACES
+    };
+    memcpy(info.wirelessSubtypes, slot_subtypes, SLOTS);
+    libusb_device *adapter = OIHostMockAddDevice(&info);
+    libusb_device *devices[SLOTS * 2];
+    uint16_t product_ids[SLOTS * 2];
+    ScanDevices(devices, product_ids, SLOTS * 2);
+    int count = ScanDevices(devices, product_ids, SLOTS * 2);
+    if (count != SLOTS) {
+        printf("FAIL: the adapter shows up as %i devices, expected %i\n", count, SLOTS);
+        return 1;
+    }
+
+    // the adapter's slot 0, then the others in order
+    bool ok = true;
+    for (int i = 0; i < SLOTS; i++) {
+        uint16_t expected = slot_subtypes[i] == XINPUT_SUBTYPE_DRUM_KIT ? RB4_DRUMS_PID : RB4_GUITAR_PID;
+        if (product_ids[i] != expected) {
+            printf("FAIL: slot %i is shown as 12BA:%04X, expected 12BA:%04X\n", i, product_ids[i], expected);
+            ok = false;
+        }
+    }
+    ok &= CheckListing();
+    pthread_t event_thread;
+    pthread_create(&event_thread, NULL, EventThread, NULL);
+    for (int i = 0; i < SLOTS; i++) {
+        if (!OpenSlot(devices[i], i)) {
+            printf("FAIL: couldn't open slot %i\n", i);
+            return 1;
+        }
+    }
+
+    // all four playing at once, interleaved on the adapter's endpoints
+    for (int j = 0; j < REPORTS_PER_SLOT; j++) {
+        for (int i = 0; i < SLOTS; i++) {
+            uint8_t report[WIRELESS_HEADER_LENGTH + sizeof(xinput_report_controls)] = { 0x00, 0x01, 0x00, 0xF0 };
+            xinput_report_controls *controls = (xinput_report_controls *)(report + WIRELESS_HEADER_LENGTH);
+            controls->header.message_type = 0x00;
+            controls->header.message_size = sizeof(xinput_report_controls);
+            controls->buttons1 = (j & 1) ? XINPUT_BUTTON_START : 0;
+            controls->buttons2 = slot_frets[i];
+            controls->left_stick_x = RED_PAD_AXIS;
+            OIHostMockQueueReport(adapter, 0x81 + i * 2, report, sizeof(report));
+        }
+    }
+
+    WaitForReads(REPORTS_PER_SLOT);
+    ok &= CheckSlots();
+    for (int i = 0; i < SLOTS; i++)
+        sceUsbdCancelTransfer(game_slots[i].transfer);
+    usleep(20000);
+    running = false;
+    pthread_join(event_thread, NULL);
+    for (int i = 0; i < SLOTS; i++)
+        CloseSlot(i);
+    DestroyUsbdHooks();
+
+    OIHostMockStats stats;
+    OIHostMockGetStats(&stats);
+    if (stats.devicesOpen != 0 || stats.transfersAllocated != 0) {
+        printf("FAIL: %i device handles and %i transfers left over\n", stats.devicesOpen, stats.transfersAllocated);
+        ok = false;
+    }
+    printf("%i slots, guitars and drums, %i interleaved reports each: %s\n", SLOTS, REPORTS_PER_SLOT, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
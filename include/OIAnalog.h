@@ -0,0 +1,46 @@
+/*
+    OIAnalog.h - OrbisInstrumentalizer
+    Calibration, deadzone and smoothing for instrument axes like whammy and tilt, in fixed point.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// axes are worked on in 0-65535 once calibrated, and handed out as the top 8 bits
+#define OI_ANALOG_FULL_SCALE 65535
+// filter state carries this many extra bits so slow movements don't round away
+#define OI_ANALOG_FILTER_SHIFT 8
+// gaps between reports longer than this start the filter over instead of smoothing across them
+#define OI_ANALOG_FILTER_RESET_USEC 100000
+
+typedef struct _OIAnalogConfig {
+    int32_t min_span; // raw range the axis is assumed to cover until it's been seen to move further
+    uint16_t deadzone; // fraction of the calibrated range snapped to each end, out of 65536
+    bool filter; // one euro filter, cuts jitter at rest without adding lag to fast movements
+    uint32_t min_cutoff; // mHz, how hard a still axis is smoothed
+    uint32_t beta; // mHz per unit/s, out of 65536, how quickly smoothing backs off as the axis moves
+    uint32_t derivative_cutoff; // mHz, smoothing of the speed estimate beta works from
+} OIAnalogConfig;
+
+// Each axis belongs to one device and is only touched by whichever thread parses its reports
+typedef struct _OIAnalogAxis {
+    const OIAnalogConfig *config;
+    bool calibrated; // seen at least one sample
+    int32_t min;
+    int32_t max;
+    // mapping from raw to full scale, redone whenever min or max move
+    int32_t low;
+    int32_t high;
+    uint32_t scale; // full scale per raw unit, out of 65536
+    bool primed; // filter has a previous sample
+    int32_t filtered; // full scale << OI_ANALOG_FILTER_SHIFT
+    int32_t speed; // full scale units per second
+    uint64_t last_time;
+} OIAnalogAxis;
+
+void OIAnalogInit(OIAnalogAxis *axis, const OIAnalogConfig *config);
+// calibrates against and maps a raw reading taken at time (in microseconds), returns 0-255
+uint8_t OIAnalogProcess(OIAnalogAxis *axis, int32_t raw, uint64_t time);
@@ -0,0 +1,57 @@
+/*
+    OICapture.h - OrbisInstrumentalizer
+    Recording raw instrument reports to a capture file, for replaying them through the parsers later.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// capturing is only turned on if this file exists when the plugin starts
+#define OI_CAPTURE_ENABLE_PATH "/data/GoldHEN/plugins/OrbisInstrumentalizer_capture"
+#define OI_CAPTURE_FILE_PATH "/data/GoldHEN/plugins/OrbisInstrumentalizer_capture.bin"
+
+#define OI_CAPTURE_FILE_MAGIC 0x5043494F // 'OICP'
+#define OI_CAPTURE_FILE_VERSION 1
+#define OI_CAPTURE_MAX_REPORT_SIZE 64
+
+// where a report was picked up, so a replay knows which parser to hand it to
+typedef enum _OICaptureSource {
+    OI_Capture_GHL_HID = 1,
+    OI_Capture_GHL_XInput,
+    OI_Capture_RB4_XInput,
+    OI_Capture_RB4_XInputWireless,
+    OI_Capture_GHL_XOne,
+    OI_Capture_RB4_XInputDrums,
+    OI_Capture_RB4_XInputWirelessDrums
+} OICaptureSource;
+
+typedef struct _OICaptureFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t tsc_frequency;
+} OICaptureFileHeader;
+
+// each record is this followed by length bytes of the report as it came off the wire
+typedef struct __attribute__((packed)) _OICaptureRecord {
+    uint64_t timestamp; // TSC ticks at transfer completion
+    uint8_t source;
+    uint8_t device;
+    uint8_t length;
+} OICaptureRecord;
+
+extern bool oi_capture_enabled;
+
+void OICaptureWrite(OICaptureSource source, int device, const uint8_t *report, int length, uint64_t timestamp);
+
+// copies the report into a preallocated ring, a background thread does the file writes
+static inline void OICaptureReport(OICaptureSource source, int device, const uint8_t *report, int length, uint64_t timestamp) {
+    if (oi_capture_enabled)
+        OICaptureWrite(source, device, report, length, timestamp);
+}
+
+void OICaptureInit();
+void OICaptureShutdown();
@@ -0,0 +1,57 @@
+/*
+    OIConfig.h - OrbisInstrumentalizer
+    Per-title settings file, for remapping buttons and adjusting axes on each kind of instrument.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "OIDriver.h"
+
+// the title ID goes in the middle, e.g. OrbisInstrumentalizer_CUSA02084.ini
+#define OI_CONFIG_PATH_FORMAT "/data/GoldHEN/plugins/OrbisInstrumentalizer_%s.ini"
+// anything past this is ignored, a settings file has no business being bigger
+#define OI_CONFIG_MAX_SIZE 16384
+#define OI_CONFIG_MAX_LINE 256
+// per driver, every button a driver has can be remapped with room to spare
+#define OI_CONFIG_MAX_REMAPS 32
+#define OI_CONFIG_REMAP_NONE 0xFF
+#define OI_CONFIG_MAX_SCALE 400
+
+// applied to the 0-255 value the game would otherwise get, in this order
+typedef struct _OIConfigAxis {
+    uint8_t deadzone; // readings up to this are 0, the rest is stretched back out to 255
+    uint16_t scale; // percent, clamped at 255
+    bool invert;
+} OIConfigAxis;
+
+// button and target are indexes into the driver's buttons, see OIDriverButtonIndex
+typedef struct _OIConfigRemap {
+    uint8_t button;
+    uint8_t target; // OI_CONFIG_REMAP_NONE if it does nothing
+} OIConfigRemap;
+
+typedef struct _OIConfigDriver {
+    int num_remaps;
+    OIConfigRemap remaps[OI_CONFIG_MAX_REMAPS]; // later ones for the same button win
+    OIConfigAxis whammy;
+    OIConfigAxis tilt;
+} OIConfigDriver;
+
+typedef struct _OIConfig {
+    OIConfigDriver drivers[OI_Driver_Count];
+} OIConfig;
+
+// nothing remapped and every axis left as it is
+void OIConfigDefaults(OIConfig *config);
+// applies every line it understands on top of config, and returns how many it had to skip
+int OIConfigParse(OIConfig *config, const char *text, int length);
+// replaces the settings the drivers are built from with defaults plus the file at path, false if it couldn't be read
+bool OIConfigLoad(const char *path);
+// the same, from the title's own settings file
+bool OIConfigLoadForTitle(const char *title_id);
+// defaults until something's been loaded
+const OIConfig *OIConfigGet();
@@ -0,0 +1,130 @@
+/*
+    OIDriver.h - OrbisInstrumentalizer
+    One driver per instrument family, shared by the GHL and RB4 hooks for identifying and decoding devices.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// uncomment when OpenOrbis merges #229
+//#include <orbis/Usbd.h>
+#include "OrbisUsbd.h"
+#include "OICapture.h"
+#include "OIAnalog.h"
+#include "OITranslate.h"
+
+// the biggest report_size any driver asks for, and the most output will ever write, the control setup packet included
+#define OI_DRIVER_REPORT_MAX 64
+#define OI_DRIVER_OUTPUT_MAX 32
+
+// which set of hooks a driver's devices are handed to
+typedef enum _OIDriverFrontEnd {
+    OI_FrontEnd_GHL, // scePad, Guitar Hero Live
+    OI_FrontEnd_RB4 // the game's own sceUsbd stubs, Rock Band 4
+} OIDriverFrontEnd;
+
+// identification tries drivers in this order, so more specific ones come first
+typedef enum _OIDriverId {
+    OI_Driver_GHL_HID,
+    OI_Driver_GHL_XInput,
+    OI_Driver_GHL_XOne,
+    OI_Driver_WiiRB,
+    OI_Driver_XInputGuitar,
+    OI_Driver_XInputDrums,
+    OI_Driver_XInputWireless,
+    OI_Driver_XInputWirelessDrums,
+    OI_Driver_Count
+} OIDriverId;
+
+// everything identification gets to look at
+typedef struct _OIDriverDescriptor {
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint8_t device_class;
+    uint8_t device_subclass;
+    uint8_t device_protocol;
+    uint8_t interface_subclass; // of the first interface, only read for vendor specific devices
+    bool xinput; // the first interface has an XInput descriptor
+    uint8_t xinput_subtype;
+} OIDriverDescriptor;
+
+// drum pads in the order the PS3 drum report has their velocities
+typedef enum _OIDrumPad {
+    OI_Drum_Yellow,
+    OI_Drum_Red,
+    OI_Drum_Green,
+    OI_Drum_Blue,
+    OI_Drum_Count
+} OIDrumPad;
+
+// what every instrument decodes to, translated is in the button layout of the driver's front-end
+typedef struct _OIDriverInput {
+    uint32_t translated;
+    uint8_t strum; // strum bar as a stick position, GHL only
+    uint8_t whammy;
+    uint8_t tilt;
+    uint8_t velocity[OI_Drum_Count]; // how hard each pad is being hit, drums only
+} OIDriverInput;
+
+// what a driver's settings compile down to, so remapped buttons and adjusted axes cost the same as the defaults
+typedef struct _OIDriverTuning {
+    OITranslateTable buttons;
+    uint8_t whammy[256];
+    uint8_t tilt[256];
+} OIDriverTuning;
+
+// One per open device, decode and output are each only called from one thread at a time
+typedef struct _OIDriverState {
+    const OIDriverTuning *tuning; // the driver's, set by OIDriverStart
+    OIDriverInput input; // from the last report that had any
+    OIAnalogAxis whammy;
+    OIAnalogAxis tilt;
+    // GIP replies the device is owed, queued up by decode and sent by output
+    atomic_bool gip_power_on_pending;
+    atomic_uint gip_ack_pending; // 0 if there's nothing to acknowledge
+    uint8_t gip_sequence; // of the last message output sent
+} OIDriverState;
+
+typedef struct _OIDriver {
+    OIDriverId id;
+    const char *name;
+    const char *config_name; // its section in the settings file, NULL if it has no settings
+    OIDriverFrontEnd front_end;
+    OICaptureSource capture_source;
+    int report_size; // how big GHL's interrupt transfers are
+    uint8_t output_endpoint; // interrupt OUT endpoint, 0 sends output as control transfers with the setup packet first
+    // for instruments that aren't in data/instrument_ids.txt, NULL if the driver only takes listed ones
+    // or is only ever picked by the hooks
+    bool (*identify)(const OIDriverDescriptor *desc);
+    // RB4 only, swaps the VID/PID for an instrument the game already knows if the list doesn't say what to.
+    // NULL leaves it alone
+    void (*present)(struct libusb_device_descriptor *desc);
+    void (*init)(OIDriverState *state);
+    // true if the report had input in it, state->input keeps the last input either way.
+    // time is when it arrived in microseconds. NULL if the game gets the device's reports as they are
+    bool (*decode)(OIDriverState *state, const uint8_t *report, int length, uint64_t time);
+    // fills buffer with the next message the device is owed and returns its length, 0 if there isn't one.
+    // keepalive says whether one's due, it's cleared if one was sent. NULL if the device never needs anything
+    int (*output)(OIDriverState *state, uint8_t *buffer, bool *keepalive);
+} OIDriver;
+
+extern const OIDriver oi_drivers[OI_Driver_Count];
+
+// builds the drivers' lookup tables from the loaded settings, only needs doing once
+void OIDriversInit();
+// gets state ready for a newly opened device
+void OIDriverStart(const OIDriver *driver, OIDriverState *state);
+// fills desc in from the device, device_desc can be passed in if it's already been read
+bool OIDriverDescribe(libusb_device *device, const struct libusb_device_descriptor *device_desc, OIDriverDescriptor *desc);
+// NULL if no driver for that front-end wants the device
+const OIDriver *OIDriverIdentify(const OIDriverDescriptor *desc, OIDriverFrontEnd front_end);
+// rewrites desc into what the game is shown for the driver's instrument
+void OIDriverPresent(const OIDriver *driver, struct libusb_device_descriptor *desc);
+// for the settings file, -1 if the driver has no button called name
+int OIDriverButtonIndex(OIDriverId id, const char *name);
+// hat positions can only be swapped with each other, target can be OI_CONFIG_REMAP_NONE for anything else
+bool OIDriverCanRemap(OIDriverId id, int button, int target);
@@ -0,0 +1,27 @@
+/*
+    OIInstrumentIds.h - OrbisInstrumentalizer
+    Instruments known by their VID/PID, generated from data/instrument_ids.txt.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "OIDriver.h"
+
+typedef struct _OIInstrumentId {
+    uint16_t vendor_id;
+    uint16_t product_id;
+    OIDriverId driver;
+    // what Rock Band 4 is shown instead, 0 leaves the descriptor as it is
+    uint16_t present_vendor_id;
+    uint16_t present_product_id;
+    const char *name;
+} OIInstrumentId;
+
+// NULL if the instrument isn't listed, one hash and compare whatever the size of the list
+const OIInstrumentId *OIInstrumentIdLookup(uint16_t vendor_id, uint16_t product_id);
+// every listed instrument, sorted by VID/PID
+const OIInstrumentId *OIInstrumentIdGet(int index);
+int OIInstrumentIdCount();
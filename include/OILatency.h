@@ -0,0 +1,91 @@
+/*
+    OILatency.h - OrbisInstrumentalizer
+    Fixed-size latency histograms for timing reports from USB completion to the game.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <orbis/libkernel.h>
+
+// 4 buckets per power of two of TSC ticks, which covers everything a uint64_t can hold
+#define OI_LATENCY_BUCKETS 256
+
+typedef enum _OILatencyStage {
+    OI_Latency_Parse, // transfer completion until the report has been translated and handed over
+    OI_Latency_Read, // transfer completion until the game has the report
+    OI_Latency_StageCount
+} OILatencyStage;
+
+// Each histogram has a single writer, so recording is a couple of plain increments.
+// Layout is also what ends up in the dump file, so keep it free of padding.
+typedef struct _OILatencyHistogram {
+    uint64_t max;
+    uint64_t count;
+    uint32_t buckets[OI_LATENCY_BUCKETS];
+} OILatencyHistogram;
+
+typedef struct _OILatencyStats {
+    OILatencyHistogram stages[OI_Latency_StageCount];
+} OILatencyStats;
+
+#define OI_LATENCY_FILE_PATH "/data/GoldHEN/plugins/OrbisInstrumentalizer_latency.bin"
+#define OI_LATENCY_FILE_MAGIC 0x544C494F // 'OILT'
+#define OI_LATENCY_FILE_VERSION 1
+
+// dump file is this header followed by num_devices OILatencyStats, see tools/oi_latency.py
+typedef struct _OILatencyFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_stages;
+    uint32_t num_devices;
+    uint32_t num_buckets;
+    uint64_t tsc_frequency;
+} OILatencyFileHeader;
+
+static inline uint64_t OILatencyNow() {
+    return sceKernelReadTsc();
+}
+
+static inline int OILatencyBucket(uint64_t ticks) {
+    if (ticks < 4)
+        return (int)ticks;
+    int msb = 63 - __builtin_clzll(ticks);
+    return msb * 4 + (int)((ticks >> (msb - 2)) & 3) - 4;
+}
+
+// start is an OILatencyNow() timestamp taken when the transfer completed
+static inline void OILatencyRecord(OILatencyStats *stats, OILatencyStage stage, uint64_t start) {
+    OILatencyHistogram *hist = &stats->stages[stage];
+    uint64_t ticks = OILatencyNow() - start;
+    hist->buckets[OILatencyBucket(ticks)]++;
+    hist->count++;
+    if (ticks > hist->max)
+        hist->max = ticks;
+}
+
+// maps OILatencyNow() ticks onto sceKernelGetProcessTime(), for report timestamps handed to the game
+#define OI_LATENCY_CLOCK_SHIFT 48
+typedef struct _OILatencyClock {
+    uint64_t tsc_base;
+    uint64_t time_base; // microseconds
+    uint64_t scale; // microseconds per tick, fixed point
+} OILatencyClock;
+
+void OILatencyClockInit(OILatencyClock *clock);
+
+static inline uint64_t OILatencyClockMicroseconds(const OILatencyClock *clock, uint64_t ticks) {
+    if (ticks < clock->tsc_base)
+        return clock->time_base;
+    return clock->time_base + (uint64_t)(((unsigned __int128)(ticks - clock->tsc_base) * clock->scale) >> OI_LATENCY_CLOCK_SHIFT);
+}
+
+// returns the latency in microseconds that percent of the recorded reports came in under
+uint64_t OILatencyPercentile(const OILatencyHistogram *hist, int percent);
+// prints p50/p99/max of every stage to klog
+void OILatencyLog(const char *name, int device, const OILatencyStats *stats);
+// writes the raw histograms for num_devices devices to path
+bool OILatencyWriteFile(const char *path, const OILatencyStats **stats, int num_devices);
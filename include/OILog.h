@@ -0,0 +1,20 @@
+/*
+    OILog.h - OrbisInstrumentalizer
+    Lock-free log ring for tracing from transfer callbacks without a klog syscall each time.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define OI_LOG_MAX_ARGS 4
+
+// Stores the format string and its arguments, a low priority thread formats them and hands them to klog later.
+// Arguments are kept as integers, so only integers can be passed and only integer formats used, no %s or %p.
+// The format itself has to be a string literal, it's read when the entry is formatted.
+#define trace_printf(a, args...) OILogWrite("[" PLUGIN_NAME "] " a, (const uint64_t[OI_LOG_MAX_ARGS]){ args })
+
+void OILogWrite(const char *format, const uint64_t *args);
+void OILogInit();
+void OILogShutdown();
@@ -0,0 +1,107 @@
+/*
+    OIPadHistory.h - OrbisInstrumentalizer
+    Ring of decoded pad states, for handing every report to a game that reads several at once.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// how many states a device keeps, anything older than this by the time the game reads is dropped
+#ifndef OI_PAD_HISTORY_SIZE
+#define OI_PAD_HISTORY_SIZE 16
+#endif
+_Static_assert((OI_PAD_HISTORY_SIZE & (OI_PAD_HISTORY_SIZE - 1)) == 0, "OI_PAD_HISTORY_SIZE has to be a power of 2");
+
+// the parts of OrbisPadData an instrument report sets, small enough to go in one atomic store
+typedef union _OIPadState {
+    struct {
+        uint32_t buttons;
+        uint8_t left_stick_y;
+        uint8_t right_stick_x;
+        uint8_t right_stick_y;
+        uint8_t count; // the device's own report counter, what the game sees as OrbisPadData::count
+    };
+    uint64_t packed;
+} OIPadState;
+_Static_assert(sizeof(OIPadState) == sizeof(uint64_t), "OIPadState has to pack into 64 bits");
+
+// each entry is written under its own sequence number, odd while the writer's in it,
+// so a reader copying one the writer has lapped can tell and skip it
+typedef struct _OIPadHistoryEntry {
+    atomic_uint sequence;
+    _Atomic uint64_t state;
+    _Atomic uint64_t timestamp; // when the report's transfer completed
+} OIPadHistoryEntry;
+
+// One writer (the USB callback) and one reader (the game thread), the writer never waits
+// and overwrites the oldest states if the reader falls behind
+typedef struct _OIPadHistory {
+    OIPadHistoryEntry entries[OI_PAD_HISTORY_SIZE];
+    atomic_uint head; // how many states have been written, only the writer stores it
+    uint32_t tail; // how many have been read, only touched by the reader
+    uint32_t dropped; // states the reader never got to, only touched by the reader
+} OIPadHistory;
+
+static inline void OIPadHistoryInit(OIPadHistory *history) {
+    for (int i = 0; i < OI_PAD_HISTORY_SIZE; i++) {
+        atomic_store(&history->entries[i].sequence, 0);
+        atomic_store(&history->entries[i].state, 0);
+        atomic_store(&history->entries[i].timestamp, 0);
+    }
+    atomic_store(&history->head, 0);
+    history->tail = 0;
+    history->dropped = 0;
+}
+
+static inline void OIPadHistoryWrite(OIPadHistory *history, OIPadState state, uint64_t timestamp) {
+    uint32_t head = atomic_load_explicit(&history->head, memory_order_relaxed);
+    OIPadHistoryEntry *entry = &history->entries[head & (OI_PAD_HISTORY_SIZE - 1)];
+    atomic_store_explicit(&entry->sequence, head * 2 + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&entry->state, state.packed, memory_order_relaxed);
+    atomic_store_explicit(&entry->timestamp, timestamp, memory_order_relaxed);
+    atomic_store_explicit(&entry->sequence, head * 2 + 2, memory_order_release);
+    atomic_store_explicit(&history->head, head + 1, memory_order_release);
+}
+
+// copies out up to max states the reader hasn't seen yet, oldest first, and returns how many
+static inline int OIPadHistoryRead(OIPadHistory *history, OIPadState *states, uint64_t *timestamps, int max) {
+    uint32_t head = atomic_load_explicit(&history->head, memory_order_acquire);
+    // only the newest max are wanted, and only the newest OI_PAD_HISTORY_SIZE are still there
+    uint32_t available = head - history->tail;
+    uint32_t keep = (uint32_t)max < OI_PAD_HISTORY_SIZE ? (uint32_t)max : OI_PAD_HISTORY_SIZE;
+    if (available > keep) {
+        history->dropped += available - keep;
+        history->tail = head - keep;
+    }
+    int count = 0;
+    for (; history->tail != head; history->tail++) {
+        OIPadHistoryEntry *entry = &history->entries[history->tail & (OI_PAD_HISTORY_SIZE - 1)];
+        uint32_t expected = history->tail * 2 + 2;
+        if (atomic_load_explicit(&entry->sequence, memory_order_acquire) != expected) {
+            history->dropped++;
+            continue;
+        }
+        OIPadState state = { .packed = atomic_load_explicit(&entry->state, memory_order_relaxed) };
+        uint64_t timestamp = atomic_load_explicit(&entry->timestamp, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&entry->sequence, memory_order_relaxed) != expected) {
+            history->dropped++;
+            continue;
+        }
+        states[count] = state;
+        if (timestamps != NULL)
+            timestamps[count] = timestamp;
+        count++;
+    }
+    return count;
+}
+
+// marks everything written so far as read, for when the game's only taken the latest state
+static inline void OIPadHistorySkip(OIPadHistory *history) {
+    history->tail = atomic_load_explicit(&history->head, memory_order_acquire);
+}
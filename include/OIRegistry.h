@@ -0,0 +1,84 @@
+/*
+    OIRegistry.h - OrbisInstrumentalizer
+    Device slot registry, indexed by the handles the game and sceUsbd know a device by.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <orbis/libkernel.h>
+
+// most devices a registry can hold, each hook file picks its own capacity up to this
+#ifndef OI_REGISTRY_MAX_SLOTS
+#define OI_REGISTRY_MAX_SLOTS 16
+#endif
+// per key kind, kept to a quarter full at most so probes stay short
+#define OI_REGISTRY_BUCKET_BITS 6
+#define OI_REGISTRY_BUCKETS (1 << OI_REGISTRY_BUCKET_BITS)
+_Static_assert(OI_REGISTRY_BUCKETS >= OI_REGISTRY_MAX_SLOTS * 4, "registry hash tables are too small for OI_REGISTRY_MAX_SLOTS");
+
+#define OI_REGISTRY_NO_KEY UINT64_MAX
+#define OI_REGISTRY_TOMBSTONE (UINT64_MAX - 1)
+
+typedef enum _OIRegistryKey {
+    OI_Registry_UserID,
+    OI_Registry_PadHandle,
+    OI_Registry_USBDevice, // libusb_device *
+    OI_Registry_USBHandle, // libusb_device_handle *
+    OI_Registry_BusAddress,
+    OI_Registry_KeyCount
+} OIRegistryKey;
+
+typedef struct _OIRegistryBucket {
+    _Atomic uint64_t key;
+    atomic_int slot;
+} OIRegistryBucket;
+
+// Claiming, releasing and setting keys take a lock, lookups don't and can run on any thread.
+// A lookup racing a change can miss, but never returns a slot that doesn't hold the key
+typedef struct _OIRegistry {
+    int capacity;
+    OrbisPthreadMutex mutex;
+    bool used[OI_REGISTRY_MAX_SLOTS]; // only touched with the lock held
+    _Atomic uint64_t keys[OI_Registry_KeyCount][OI_REGISTRY_MAX_SLOTS]; // each slot's current key of every kind
+    int live[OI_Registry_KeyCount]; // only touched with the lock held
+    OIRegistryBucket buckets[OI_Registry_KeyCount][OI_REGISTRY_BUCKETS];
+} OIRegistry;
+
+void OIRegistryInit(OIRegistry *registry, int capacity, const char *name);
+void OIRegistryDestroy(OIRegistry *registry);
+// takes a free slot with no keys, -1 if they're all in use
+int OIRegistryClaim(OIRegistry *registry);
+// drops every key the slot has and frees it
+void OIRegistryRelease(OIRegistry *registry, int slot);
+// replaces the slot's key of that kind, if another slot had it that one loses it
+void OIRegistrySetKey(OIRegistry *registry, int slot, OIRegistryKey kind, uint64_t key);
+void OIRegistryClearKey(OIRegistry *registry, int slot, OIRegistryKey kind);
+
+static inline uint32_t OIRegistryHash(uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - OI_REGISTRY_BUCKET_BITS));
+}
+
+// the slot holding key, or -1
+static inline int OIRegistryLookup(OIRegistry *registry, OIRegistryKey kind, uint64_t key) {
+    OIRegistryBucket *buckets = registry->buckets[kind];
+    uint32_t index = OIRegistryHash(key);
+    for (int probes = 0; probes < OI_REGISTRY_BUCKETS; probes++) {
+        uint64_t bucket_key = atomic_load_explicit(&buckets[index].key, memory_order_acquire);
+        if (bucket_key == OI_REGISTRY_NO_KEY)
+            return -1;
+        if (bucket_key == key) {
+            int slot = atomic_load_explicit(&buckets[index].slot, memory_order_acquire);
+            // the bucket could've been reused since its key was read, the slot has the final say
+            if (slot >= 0 && atomic_load_explicit(&registry->keys[kind][slot], memory_order_acquire) == key)
+                return slot;
+            return -1;
+        }
+        index = (index + 1) & (OI_REGISTRY_BUCKETS - 1);
+    }
+    return -1;
+}
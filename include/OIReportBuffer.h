@@ -0,0 +1,66 @@
+/*
+    OIReportBuffer.h - OrbisInstrumentalizer
+    Lock-free triple buffer for handing USB reports from a transfer callback to the game thread.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define OI_REPORT_MAX_SIZE 32
+
+// set on the middle index when it holds a report the reader hasn't picked up yet
+#define OI_REPORT_FRESH 0x04
+#define OI_REPORT_INDEX_MASK 0x03
+
+// One writer (the USB callback) and one reader (the game thread) per buffer.
+// Each side owns one of the three slots, and they swap with the shared middle
+// slot atomically, so neither ever waits and the reader never sees a half-written report.
+typedef struct _OIReportBuffer {
+    uint8_t reports[3][OI_REPORT_MAX_SIZE];
+    int lengths[3];
+    uint64_t timestamps[3]; // when each report's transfer completed
+    uint8_t write_index; // only touched by the writer
+    uint8_t read_index; // only touched by the reader
+    atomic_uchar middle_index;
+} OIReportBuffer;
+
+static inline void OIReportBufferInit(OIReportBuffer *buf) {
+    memset(buf->reports, 0, sizeof(buf->reports));
+    memset(buf->lengths, 0, sizeof(buf->lengths));
+    memset(buf->timestamps, 0, sizeof(buf->timestamps));
+    buf->write_index = 0;
+    atomic_store(&buf->middle_index, 1);
+    buf->read_index = 2;
+}
+
+// copies a report in and makes it the latest one the reader can see
+static inline void OIReportBufferWrite(OIReportBuffer *buf, const uint8_t *report, int length, uint64_t timestamp) {
+    if (length > OI_REPORT_MAX_SIZE)
+        length = OI_REPORT_MAX_SIZE;
+    memcpy(buf->reports[buf->write_index], report, length);
+    buf->lengths[buf->write_index] = length;
+    buf->timestamps[buf->write_index] = timestamp;
+    uint8_t old = atomic_exchange_explicit(&buf->middle_index, buf->write_index | OI_REPORT_FRESH, memory_order_acq_rel);
+    buf->write_index = old & OI_REPORT_INDEX_MASK;
+}
+
+// returns the latest complete report, fresh is set if it arrived since the last read
+static inline const uint8_t *OIReportBufferRead(OIReportBuffer *buf, int *length, bool *fresh, uint64_t *timestamp) {
+    bool is_fresh = (atomic_load_explicit(&buf->middle_index, memory_order_relaxed) & OI_REPORT_FRESH) != 0;
+    if (is_fresh) {
+        uint8_t old = atomic_exchange_explicit(&buf->middle_index, buf->read_index, memory_order_acq_rel);
+        buf->read_index = old & OI_REPORT_INDEX_MASK;
+    }
+    if (length != NULL)
+        *length = buf->lengths[buf->read_index];
+    if (fresh != NULL)
+        *fresh = is_fresh;
+    if (timestamp != NULL)
+        *timestamp = buf->timestamps[buf->read_index];
+    return buf->reports[buf->read_index];
+}
@@ -0,0 +1,63 @@
+/*
+    OIResolver.h - OrbisInstrumentalizer
+    Finds a game's PLT stubs for library functions by scanning its loaded executable.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <orbis/libkernel.h>
+
+#define OI_RESOLVER_CACHE_PATH "/data/GoldHEN/plugins/OrbisInstrumentalizer_stubs.bin"
+#define OI_RESOLVER_CACHE_MAGIC 0x5453494F // 'OIST'
+#define OI_RESOLVER_CACHE_VERSION 2
+#define OI_RESOLVER_MAX_TARGETS 48
+
+// a PLT entry is jmp [rip+got]; push index; jmp plt0
+#define OI_RESOLVER_PLT_ENTRY_SIZE 16
+
+typedef struct _OIResolverTarget {
+    const char *name; // for logging
+    uintptr_t function; // where the library function really is, what the game's GOT slot holds once bound
+    uintptr_t stub; // filled in with the game's stub that jumps to it, 0 if it wasn't found
+} OIResolverTarget;
+
+// module image the stubs are searched for in, the text segment is scanned
+// and GOT slots are only followed if they land in one of the readable segments
+typedef struct _OIResolverImage {
+    uintptr_t base;
+    struct {
+        const uint8_t *address;
+        size_t size;
+        bool executable;
+    } segments[4];
+    int num_segments;
+    uint8_t fingerprint[20]; // what the stub cache is keyed by
+} OIResolverImage;
+
+// cache file is this header followed by num_targets stub offsets from the image base, in target order,
+// 0 for any the scan didn't find
+typedef struct _OIResolverCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t fingerprint[20];
+    uint32_t num_targets;
+} OIResolverCacheHeader;
+
+// fills in an image from the loaded module, 0 is the game's executable
+bool OIResolverGetImage(int module, OIResolverImage *image);
+// true if stub is a PLT entry whose GOT slot points to function
+bool OIResolverCheckStub(const OIResolverImage *image, uintptr_t stub, uintptr_t function);
+// scans every executable segment for stubs to the targets, returns how many were found
+int OIResolverScan(const OIResolverImage *image, OIResolverTarget *targets, int num_targets);
+// for when there's no image to scan but one stub is already known, matches every entry of the PLT that stub is in
+// against the targets instead. unbound is set to how many entries the game hasn't called through yet, which could
+// be any function. returns how many targets were found
+int OIResolverWalk(uintptr_t stub, OIResolverTarget *targets, int num_targets, int *unbound);
+// checks the cache for this image first and only scans if it's missing or stale. the results are written back to it
+// as long as the first num_required targets were all found, the rest are optional. returns how many targets were found
+int OIResolverResolve(const OIResolverImage *image, OIResolverTarget *targets, int num_targets, int num_required, const char *cache_path);
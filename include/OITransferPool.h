@@ -0,0 +1,54 @@
+/*
+    OITransferPool.h - OrbisInstrumentalizer
+    Transfers and their buffers allocated once up front, lent to devices while they're connected.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <orbis/libkernel.h>
+// uncomment when OpenOrbis merges #229
+//#include <orbis/Usbd.h>
+#include "OrbisUsbd.h"
+
+#define OI_TRANSFER_POOL_MAX 64
+// big enough for any interrupt report or control transfer the plugin sends itself
+#define OI_TRANSFER_BUFFER_SIZE 64
+
+typedef struct _OIPooledTransfer {
+    struct libusb_transfer *transfer; // NULL when nothing's been lent out
+    uint8_t *buffer;
+    int index;
+} OIPooledTransfer;
+
+typedef struct _OITransferPoolStats {
+    int size;
+    int in_use; // lent out and not back yet, anything left at destroy time is leaked
+    int peak;
+    uint32_t acquired;
+    uint32_t released;
+    uint32_t exhausted; // asked for with none left
+} OITransferPoolStats;
+
+// Lending and returning take a lock, they only happen on connect and disconnect
+typedef struct _OITransferPool {
+    OrbisPthreadMutex mutex;
+    struct libusb_transfer *transfers[OI_TRANSFER_POOL_MAX];
+    uint8_t buffers[OI_TRANSFER_POOL_MAX][OI_TRANSFER_BUFFER_SIZE];
+    int free_list[OI_TRANSFER_POOL_MAX];
+    int free_count;
+    OITransferPoolStats stats;
+} OITransferPool;
+
+// allocates every transfer the pool will ever lend, returns false if sceUsbd ran out first
+bool OITransferPoolInit(OITransferPool *pool, int size, const char *name);
+// frees whatever's been returned, returns how many transfers were still lent out and had to be leaked
+int OITransferPoolDestroy(OITransferPool *pool);
+bool OITransferPoolAcquire(OITransferPool *pool, OIPooledTransfer *pooled);
+// hands a transfer back, it mustn't still be in flight
+void OITransferPoolRelease(OITransferPool *pool, OIPooledTransfer *pooled);
+void OITransferPoolGetStats(OITransferPool *pool, OITransferPoolStats *stats);
+void OITransferPoolLog(OITransferPool *pool, const char *name);
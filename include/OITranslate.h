@@ -0,0 +1,41 @@
+/*
+    OITranslate.h - OrbisInstrumentalizer
+    Table-driven translation of instrument report bytes into button words.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// how many distinct report bytes a single table can read from
+#define OI_TRANSLATE_MAX_SOURCES 4
+
+// Sets output when (report[offset] & mask) == value.
+// A plain button is { offset, bit, bit, output }, a hat position is { offset, 0xFF, position, output }.
+typedef struct _OITranslateMapping {
+    uint8_t offset;
+    uint8_t mask;
+    uint8_t value;
+    uint32_t output;
+    const char *name; // what the settings file calls it, NULL if it can't be remapped
+} OITranslateMapping;
+
+// Every possible value of each source byte, resolved to its output bits ahead of time.
+typedef struct _OITranslateTable {
+    int num_sources;
+    uint8_t offsets[OI_TRANSLATE_MAX_SOURCES];
+    uint32_t lut[OI_TRANSLATE_MAX_SOURCES][256];
+} OITranslateTable;
+
+// builds the lookup tables for a list of mappings, returns false if they read too many bytes
+bool OITranslateCompile(OITranslateTable *table, const OITranslateMapping *mappings, int num_mappings);
+
+// one load and OR per source byte, no per-button branches
+static inline uint32_t OITranslate(const OITranslateTable *table, const uint8_t *report) {
+    uint32_t output = 0;
+    for (int i = 0; i < table->num_sources; i++)
+        output |= table->lut[i][report[table->offsets[i]]];
+    return output;
+}
@@ -2,6 +2,7 @@
 #define _SCE_USBD_H_
 
 #include <stdint.h>
+#include <sys/time.h>
 #include <libusb.h>
 
 #ifdef __cplusplus 
@@ -63,7 +64,7 @@ void sceUsbdFillInterruptTransfer(struct libusb_transfer *transfer, libusb_devic
 void sceUsbdFillIsoTransfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout);
 void sceUsbdSetIsoPacketLengths(struct libusb_transfer *transfer, unsigned int length);
 unsigned char *sceUsbdGetIsoPacketBuffer(struct libusb_transfer *transfer, unsigned int packet);
-int sceUsbdHandleEventsTimeout(int *timeval);
+int sceUsbdHandleEventsTimeout(struct timeval *tv);
 
 // Empty Comment
 void sceUsbdAttachKernelDriver();
@@ -0,0 +1,47 @@
+#include <stdint.h>
+
+// Xbox One Gaming Input Protocol, every message on the interrupt endpoints starts with a header
+
+// commands, everything below 0x20 is the protocol's own
+#define GIP_CMD_ACKNOWLEDGE  0x01
+#define GIP_CMD_ANNOUNCE     0x02
+#define GIP_CMD_STATUS       0x03
+#define GIP_CMD_IDENTIFY     0x04
+#define GIP_CMD_POWER        0x05
+#define GIP_CMD_AUTHENTICATE 0x06
+#define GIP_CMD_VIRTUAL_KEY  0x07
+#define GIP_CMD_INPUT        0x20
+// Guitar Hero Live dongles send the PS3/Wii U report in a message of their own, and want poking the same way
+#define GIP_CMD_GHL_INPUT    0x21
+#define GIP_CMD_GHL_POKE     0x22
+
+// options
+#define GIP_OPT_CLIENT_MASK  0x0F
+#define GIP_OPT_ACKNOWLEDGE  0x10 // sender wants an acknowledge back
+#define GIP_OPT_INTERNAL     0x20 // one of the protocol's own commands
+#define GIP_OPT_CHUNK_START  0x40
+#define GIP_OPT_CHUNK        0x80
+
+#define GIP_POWER_ON 0x00
+
+// header with a one byte length, the length is a LEB128 varint so longer messages have more
+typedef struct _gip_header {
+    uint8_t command;
+    uint8_t options;
+    uint8_t sequence;
+    uint8_t length;
+} __attribute__((packed)) gip_header;
+
+// the payload of an acknowledge, sent back with the same sequence as the message it's for
+typedef struct _gip_acknowledge {
+    uint8_t unknown;
+    uint8_t command;
+    uint8_t options;
+    uint16_t length; // bytes received so far
+    uint8_t padding[2];
+    uint16_t remaining; // bytes still to come, for chunked messages
+} __attribute__((packed)) gip_acknowledge;
+
+typedef struct _gip_power {
+    uint8_t mode;
+} __attribute__((packed)) gip_power;
@@ -31,6 +31,16 @@
 #define XINPUT_SUBTYPE_GUITAR_BASS      0x0B
 #define XINPUT_SUBTYPE_ARCADE_PAD       0x13
 
+// the 360 wireless receiver's own messages, on the endpoints of each of its slots
+#define XINPUT_WIRELESS_LINK 0x08 // 08 xx, a controller has come or gone
+#define XINPUT_WIRELESS_LINK_CONTROLLER 0x80 // set in the second byte while there's a controller on the slot
+#define XINPUT_WIRELESS_DATA 0x01 // 00 01 00 F0, then the controller's report
+#define XINPUT_WIRELESS_ANNOUNCE 0x0F // 00 0F 00 F0, sent by a controller as it connects
+#define XINPUT_WIRELESS_ANNOUNCE_SUBTYPE 25 // where the controller's subtype is in its announce
+// asks the receiver what's on a slot, it answers with a link message and the controller announces itself again
+#define XINPUT_WIRELESS_INQUIRY { 0x08, 0x00, 0x0F, 0xC0 }
+#define XINPUT_WIRELESS_INQUIRY_LENGTH 12
+
 // reports from the controller all start with this header
 typedef struct _xinput_report {
     uint8_t message_type;
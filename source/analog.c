@@ -0,0 +1,109 @@
+/*
+    analog.c - OrbisInstrumentalizer
+    Calibration, deadzone and smoothing for instrument axes like whammy and tilt, in fixed point.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "OIAnalog.h"
+
+// 1e9 / 2pi, turns a cutoff in mHz into the filter's time constant in microseconds
+#define CUTOFF_TO_TAU_USEC 159154943ULL
+// speed estimates are clamped so the filter's sums stay in 32 bits, far beyond anything a hand does
+#define MAX_SPEED (1 << 29)
+
+void OIAnalogInit(OIAnalogAxis *axis, const OIAnalogConfig *config) {
+    axis->config = config;
+    axis->calibrated = false;
+    axis->min = axis->max = 0;
+    axis->low = 0;
+    axis->high = OI_ANALOG_FULL_SCALE;
+    axis->scale = 1 << 16;
+    axis->primed = false;
+    axis->filtered = 0;
+    axis->speed = 0;
+    axis->last_time = 0;
+}
+
+// only runs when the axis goes further than it has before, so the division's off the common path
+static void Recalibrate(OIAnalogAxis *axis) {
+    int32_t max = axis->max;
+    if (max - axis->min < axis->config->min_span)
+        max = axis->min + axis->config->min_span;
+    int32_t deadzone = (int32_t)(((int64_t)(max - axis->min) * axis->config->deadzone) >> 16);
+    axis->low = axis->min + deadzone;
+    axis->high = max - deadzone;
+    if (axis->high <= axis->low)
+        axis->high = axis->low + 1;
+    axis->scale = (uint32_t)(((uint64_t)OI_ANALOG_FULL_SCALE << 16) / (uint32_t)(axis->high - axis->low));
+}
+
+// smoothing factor out of 65536 for a sample dt microseconds after the last one
+static uint32_t FilterAlpha(uint32_t dt, uint32_t cutoff) {
+    if (cutoff == 0)
+        cutoff = 1;
+    uint64_t tau = CUTOFF_TO_TAU_USEC / cutoff;
+    return (uint32_t)(((uint64_t)dt << 16) / (dt + tau));
+}
+
+static int32_t Filter(OIAnalogAxis *axis, int32_t value, uint64_t time) {
+    const OIAnalogConfig *config = axis->config;
+    int32_t target = value << OI_ANALOG_FILTER_SHIFT;
+    uint64_t elapsed = time - axis->last_time;
+    if (!axis->primed || time < axis->last_time || elapsed > OI_ANALOG_FILTER_RESET_USEC) {
+        axis->primed = true;
+        axis->filtered = target;
+        axis->speed = 0;
+        axis->last_time = time;
+        return value;
+    }
+    uint32_t dt = elapsed == 0 ? 1 : (uint32_t)elapsed;
+    axis->last_time = time;
+
+    // how fast the axis is moving decides how much it gets smoothed
+    int64_t speed = (((int64_t)(target - axis->filtered) * 1000000) / dt) >> OI_ANALOG_FILTER_SHIFT;
+    if (speed > MAX_SPEED)
+        speed = MAX_SPEED;
+    else if (speed < -MAX_SPEED)
+        speed = -MAX_SPEED;
+    uint32_t alpha = FilterAlpha(dt, config->derivative_cutoff);
+    axis->speed += (int32_t)(((speed - axis->speed) * alpha) >> 16);
+    uint32_t magnitude = axis->speed < 0 ? -(uint32_t)axis->speed : (uint32_t)axis->speed;
+    uint64_t cutoff = config->min_cutoff + (((uint64_t)magnitude * config->beta) >> 16);
+    if (cutoff > UINT32_MAX)
+        cutoff = UINT32_MAX;
+
+    alpha = FilterAlpha(dt, (uint32_t)cutoff);
+    axis->filtered += (int32_t)(((int64_t)(target - axis->filtered) * alpha) >> 16);
+    return axis->filtered >> OI_ANALOG_FILTER_SHIFT;
+}
+
+uint8_t OIAnalogProcess(OIAnalogAxis *axis, int32_t raw, uint64_t time) {
+    if (!axis->calibrated) {
+        axis->calibrated = true;
+        axis->min = axis->max = raw;
+        Recalibrate(axis);
+    } else if (raw < axis->min) {
+        axis->min = raw;
+        Recalibrate(axis);
+    } else if (raw > axis->max) {
+        axis->max = raw;
+        Recalibrate(axis);
+    }
+
+    int32_t value;
+    if (raw <= axis->low)
+        value = 0;
+    else if (raw >= axis->high)
+        value = OI_ANALOG_FULL_SCALE;
+    else
+        value = (int32_t)(((uint64_t)(raw - axis->low) * axis->scale) >> 16);
+    if (value > OI_ANALOG_FULL_SCALE)
+        value = OI_ANALOG_FULL_SCALE;
+
+    if (axis->config->filter)
+        value = Filter(axis, value, time);
+    return (uint8_t)(value >> 8);
+}
@@ -0,0 +1,151 @@
+/*
+    capture.c - OrbisInstrumentalizer
+    Ring buffer and writer thread for recording raw instrument reports.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OICapture.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+#define OI_CAPTURE_RING_SIZE 2048 // must be a power of two
+#define OI_CAPTURE_WRITE_INTERVAL_USEC 50000
+#define OI_CAPTURE_STAGING_SIZE 0x10000
+#define OI_CAPTURE_WRITER_PRIORITY 767
+
+typedef struct _OICaptureEntry {
+    // even while the slot is free for lap/2 of the ring, odd once it's been written in that lap
+    atomic_size_t lap;
+    OICaptureRecord record;
+    uint8_t report[OI_CAPTURE_MAX_REPORT_SIZE];
+} OICaptureEntry;
+
+bool oi_capture_enabled = false;
+
+static OICaptureEntry ring[OI_CAPTURE_RING_SIZE];
+static atomic_size_t write_pos = 0;
+static size_t read_pos = 0; // only touched by the writer thread
+static atomic_uint dropped_count = 0;
+
+static int capture_fd = -1;
+static uint8_t staging[OI_CAPTURE_STAGING_SIZE]; // only touched by the writer thread
+static int staging_length = 0;
+static OrbisPthread writer_thread;
+static atomic_bool writer_thread_quit = false;
+
+void OICaptureWrite(OICaptureSource source, int device, const uint8_t *report, int length, uint64_t timestamp) {
+    size_t pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+    OICaptureEntry *entry;
+    for (;;) {
+        entry = &ring[pos & (OI_CAPTURE_RING_SIZE - 1)];
+        size_t expected = (pos / OI_CAPTURE_RING_SIZE) * 2;
+        intptr_t diff = (intptr_t)(atomic_load_explicit(&entry->lap, memory_order_acquire) - expected);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&write_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // the writer thread hasn't caught up, drop it rather than hold up the transfer callback
+            atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+        }
+    }
+    if (length < 0)
+        length = 0;
+    else if (length > OI_CAPTURE_MAX_REPORT_SIZE)
+        length = OI_CAPTURE_MAX_REPORT_SIZE;
+    entry->record.timestamp = timestamp;
+    entry->record.source = source;
+    entry->record.device = device;
+    entry->record.length = length;
+    memcpy(entry->report, report, length);
+    atomic_store_explicit(&entry->lap, (pos / OI_CAPTURE_RING_SIZE) * 2 + 1, memory_order_release);
+}
+
+static void FlushStaging() {
+    if (staging_length > 0 && sceKernelWrite(capture_fd, staging, staging_length) != staging_length)
+        final_printf("Failed to write to the capture file!\n");
+    staging_length = 0;
+}
+
+static void DrainCapture() {
+    for (;;) {
+        OICaptureEntry *entry = &ring[read_pos & (OI_CAPTURE_RING_SIZE - 1)];
+        size_t lap = (read_pos / OI_CAPTURE_RING_SIZE) * 2;
+        if (atomic_load_explicit(&entry->lap, memory_order_acquire) != lap + 1)
+            break;
+        int size = sizeof(OICaptureRecord) + entry->record.length;
+        if (staging_length + size > OI_CAPTURE_STAGING_SIZE)
+            FlushStaging();
+        memcpy(staging + staging_length, &entry->record, sizeof(OICaptureRecord));
+        memcpy(staging + staging_length + sizeof(OICaptureRecord), entry->report, entry->record.length);
+        staging_length += size;
+        atomic_store_explicit(&entry->lap, lap + 2, memory_order_release);
+        read_pos++;
+    }
+    FlushStaging();
+
+    uint32_t dropped = atomic_exchange_explicit(&dropped_count, 0, memory_order_relaxed);
+    if (dropped > 0)
+        final_printf("Capture ring was full, dropped %u reports\n", dropped);
+}
+
+static void *writerThread(void *args) {
+    while (!atomic_load(&writer_thread_quit)) {
+        DrainCapture();
+        sceKernelUsleep(OI_CAPTURE_WRITE_INTERVAL_USEC);
+    }
+    DrainCapture();
+    scePthreadExit(NULL);
+    return NULL;
+}
+
+void OICaptureInit() {
+    int enable_fd = sceKernelOpen(OI_CAPTURE_ENABLE_PATH, O_RDONLY, 0);
+    if (enable_fd < 0)
+        return;
+    sceKernelClose(enable_fd);
+
+    capture_fd = sceKernelOpen(OI_CAPTURE_FILE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (capture_fd < 0) {
+        final_printf("Failed to open %s for capturing (%08x)\n", OI_CAPTURE_FILE_PATH, capture_fd);
+        return;
+    }
+    OICaptureFileHeader header = {
+        .magic = OI_CAPTURE_FILE_MAGIC,
+        .version = OI_CAPTURE_FILE_VERSION,
+        .tsc_frequency = sceKernelGetTscFrequency()
+    };
+    sceKernelWrite(capture_fd, &header, sizeof(header));
+
+    atomic_store(&writer_thread_quit, false);
+    if (scePthreadCreate(&writer_thread, NULL, writerThread, NULL, "OrbisInstrumentCaptureThread") != 0) {
+        final_printf("Failed to start the capture thread!\n");
+        sceKernelClose(capture_fd);
+        capture_fd = -1;
+        return;
+    }
+    scePthreadSetprio(writer_thread, OI_CAPTURE_WRITER_PRIORITY);
+    final_printf("Capturing reports to %s\n", OI_CAPTURE_FILE_PATH);
+    oi_capture_enabled = true;
+}
+
+void OICaptureShutdown() {
+    if (!oi_capture_enabled)
+        return;
+    oi_capture_enabled = false;
+    atomic_store(&writer_thread_quit, true);
+    scePthreadJoin(writer_thread, NULL);
+    sceKernelClose(capture_fd);
+    capture_fd = -1;
+}
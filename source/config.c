@@ -0,0 +1,228 @@
+/*
+    config.c - OrbisInstrumentalizer
+    Reads the per-title settings file, which the drivers build their lookup tables from.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OIConfig.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+static OIConfig active_config;
+static bool active_config_set = false;
+// only used while loading, a settings file isn't worth a stack this size
+static char file_buffer[OI_CONFIG_MAX_SIZE];
+
+void OIConfigDefaults(OIConfig *config) {
+    memset(config, 0, sizeof(OIConfig));
+    for (int i = 0; i < OI_Driver_Count; i++) {
+        config->drivers[i].whammy.scale = 100;
+        config->drivers[i].tilt.scale = 100;
+    }
+}
+
+static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// cuts the whitespace off both ends in place
+static char *Trim(char *start, char *end) {
+    while (start < end && IsSpace(*start))
+        start++;
+    while (end > start && IsSpace(end[-1]))
+        end--;
+    *end = '\0';
+    return start;
+}
+
+static bool ParseNumber(const char *text, int max, int *value) {
+    if (*text == '\0')
+        return false;
+    int parsed = 0;
+    for (; *text != '\0'; text++) {
+        if (*text < '0' || *text > '9')
+            return false;
+        parsed = parsed * 10 + (*text - '0');
+        if (parsed > max)
+            return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+static bool ParseBool(const char *text, bool *value) {
+    if (strcmp(text, "true") == 0 || strcmp(text, "yes") == 0 || strcmp(text, "on") == 0 || strcmp(text, "1") == 0)
+        *value = true;
+    else if (strcmp(text, "false") == 0 || strcmp(text, "no") == 0 || strcmp(text, "off") == 0 || strcmp(text, "0") == 0)
+        *value = false;
+    else
+        return false;
+    return true;
+}
+
+static int FindSection(const char *name) {
+    for (int i = 0; i < OI_Driver_Count; i++) {
+        if (oi_drivers[i].config_name != NULL && strcmp(oi_drivers[i].config_name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool ParseAxis(OIConfigAxis *axis, const char *property, const char *value) {
+    int number;
+    if (strcmp(property, "deadzone") == 0 && ParseNumber(value, 254, &number))
+        axis->deadzone = number;
+    else if (strcmp(property, "scale") == 0 && ParseNumber(value, OI_CONFIG_MAX_SCALE, &number))
+        axis->scale = number;
+    else if (strcmp(property, "invert") == 0)
+        return ParseBool(value, &axis->invert);
+    else
+        return false;
+    return true;
+}
+
+static bool ParseRemap(OIConfigDriver *driver, OIDriverId id, const char *button_name, const char *target_name) {
+    int button = OIDriverButtonIndex(id, button_name);
+    int target = strcmp(target_name, "none") == 0 ? OI_CONFIG_REMAP_NONE : OIDriverButtonIndex(id, target_name);
+    if (button < 0 || target < 0 || !OIDriverCanRemap(id, button, target))
+        return false;
+    // the same button again replaces what it was remapped to before
+    int i = 0;
+    while (i < driver->num_remaps && driver->remaps[i].button != button)
+        i++;
+    if (i == OI_CONFIG_MAX_REMAPS)
+        return false;
+    driver->remaps[i].button = button;
+    driver->remaps[i].target = target;
+    if (i == driver->num_remaps)
+        driver->num_remaps++;
+    return true;
+}
+
+// false if the line has to be skipped, section is -1 until a known one is seen
+static bool ParseLine(OIConfig *config, char *line, int *section) {
+    if (*line == '[') {
+        char *close = strchr(line, ']');
+        if (close == NULL || close[1] != '\0') {
+            *section = -1;
+            return false;
+        }
+        *section = FindSection(Trim(line + 1, close));
+        return *section >= 0;
+    }
+    char *equals = strchr(line, '=');
+    if (equals == NULL || *section < 0)
+        return false;
+    char *value = Trim(equals + 1, equals + strlen(equals));
+    char *key = Trim(line, equals);
+    char *property = strchr(key, '.');
+    if (property == NULL)
+        return false;
+    *property++ = '\0';
+
+    OIConfigDriver *driver = &config->drivers[*section];
+    if (strcmp(key, "button") == 0)
+        return ParseRemap(driver, (OIDriverId)*section, property, value);
+    else if (strcmp(key, "whammy") == 0)
+        return ParseAxis(&driver->whammy, property, value);
+    else if (strcmp(key, "tilt") == 0)
+        return ParseAxis(&driver->tilt, property, value);
+    return false;
+}
+
+int OIConfigParse(OIConfig *config, const char *text, int length) {
+    char line[OI_CONFIG_MAX_LINE];
+    int section = -1;
+    int skipped = 0;
+    int line_number = 0;
+    int position = 0;
+    while (position < length) {
+        int start = position;
+        while (position < length && text[position] != '\n')
+            position++;
+        int line_length = position - start;
+        position++;
+        line_number++;
+        if (line_length >= OI_CONFIG_MAX_LINE) {
+            final_printf("Settings line %i is too long, skipping it\n", line_number);
+            skipped++;
+            continue;
+        }
+        // lowercased since names don't care about case, and cut off at a comment or anything that couldn't be text
+        int used = 0;
+        for (; used < line_length; used++) {
+            char c = text[start + used];
+            if (c == ';' || c == '#' || c == '\0')
+                break;
+            line[used] = ToLower(c);
+        }
+        char *trimmed = Trim(line, line + used);
+        if (*trimmed == '\0')
+            continue;
+        if (!ParseLine(config, trimmed, &section)) {
+            final_printf("Settings line %i couldn't be understood, skipping it\n", line_number);
+            skipped++;
+        }
+    }
+    return skipped;
+}
+
+static int ReadFile(const char *path) {
+    int fd = sceKernelOpen(path, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    int length = 0;
+    while (length < OI_CONFIG_MAX_SIZE) {
+        ssize_t r = sceKernelRead(fd, file_buffer + length, OI_CONFIG_MAX_SIZE - length);
+        if (r <= 0)
+            break;
+        length += r;
+    }
+    // if there's more, only whole lines get used
+    char extra;
+    if (length == OI_CONFIG_MAX_SIZE && sceKernelRead(fd, &extra, 1) == 1) {
+        final_printf("%s is bigger than %i bytes, only reading the start of it\n", path, OI_CONFIG_MAX_SIZE);
+        while (length > 0 && file_buffer[length - 1] != '\n')
+            length--;
+    }
+    sceKernelClose(fd);
+    return length;
+}
+
+bool OIConfigLoad(const char *path) {
+    OIConfigDefaults(&active_config);
+    active_config_set = true;
+    int length = ReadFile(path);
+    if (length < 0)
+        return false;
+    int skipped = OIConfigParse(&active_config, file_buffer, length);
+    final_printf("Loaded settings from %s, %i lines skipped\n", path, skipped);
+    return true;
+}
+
+bool OIConfigLoadForTitle(const char *title_id) {
+    char path[128];
+    snprintf(path, sizeof(path), OI_CONFIG_PATH_FORMAT, title_id);
+    return OIConfigLoad(path);
+}
+
+const OIConfig *OIConfigGet() {
+    if (!active_config_set) {
+        OIConfigDefaults(&active_config);
+        active_config_set = true;
+    }
+    return &active_config;
+}
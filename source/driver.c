@@ -0,0 +1,568 @@
+/*
+    driver.c - OrbisInstrumentalizer
+    One driver per instrument family, shared by the GHL and RB4 hooks for identifying and decoding devices.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+// uncomment when OpenOrbis merges #228
+//#include <orbis/_types/pad.h>
+#include "OrbisPadTypes.h"
+#include "OIConfig.h"
+#include "OIDriver.h"
+#include "OIInstrumentIds.h"
+#include "OITranslate.h"
+#include "xinput.h"
+#include "gip.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+#define BIT(i) (1 << i)
+
+// whammy rests at one end and is read as is, tilt is noisy enough at rest to want smoothing
+static const OIAnalogConfig whammy_config = {
+    .min_span = 16384, .deadzone = 2048, .filter = false
+};
+static const OIAnalogConfig tilt_config = {
+    .min_span = 16384, .deadzone = 2048, .filter = true,
+    .min_cutoff = 1000, .beta = 3000, .derivative_cutoff = 1000
+};
+
+#define XINPUT_MESSAGE_CONTROLS 0x00
+// decoding reads up to the end of the right stick
+#define XINPUT_CONTROLS_MIN_LENGTH (offsetof(xinput_report_controls, right_stick_y) + sizeof(int16_t))
+static const uint8_t xinput_neutral_report[XINPUT_CONTROLS_MIN_LENGTH] = { XINPUT_MESSAGE_CONTROLS };
+// the wireless adapter puts 4 bytes of its own in front of the controller's report
+#define XINPUT_WIRELESS_HEADER_LENGTH 4
+// far enough into a PS3/Wii U GHL report to reach tilt
+#define GHL_HID_MIN_REPORT_SIZE 20
+#define GHL_CONTROL_SETUP_SIZE 8
+#define GHL_KEEPALIVE_SIZE 9
+
+// OIDriversInit copies a driver's mappings onto the stack to remap them, so no driver can have more than this
+#define MAX_DRIVER_MAPPINGS 16
+#define MAPPING_COUNT(mapping) (sizeof(mapping) / sizeof(mapping[0]))
+
+// internal bits in the translated word, used to work out the strum bar position
+#define GHL_STRUM_UP   0x40000000
+#define GHL_STRUM_DOWN 0x80000000
+#define GHL_STRUM_MASK (GHL_STRUM_UP | GHL_STRUM_DOWN)
+
+static const OITranslateMapping ghl_xinput_mapping[] = {
+    // fret buttons
+    { 3, 0x10, 0x10, ORBIS_PAD_BUTTON_CROSS, "b1" },
+    { 3, 0x20, 0x20, ORBIS_PAD_BUTTON_CIRCLE, "b2" },
+    { 3, 0x80, 0x80, ORBIS_PAD_BUTTON_TRIANGLE, "b3" },
+    { 3, 0x40, 0x40, ORBIS_PAD_BUTTON_SQUARE, "w1" },
+    { 3, 0x01, 0x01, ORBIS_PAD_BUTTON_L1, "w2" },
+    { 3, 0x02, 0x02, ORBIS_PAD_BUTTON_R1, "w3" },
+    // dpad (nav + strumming)
+    { 2, 0x01, 0x01, ORBIS_PAD_BUTTON_UP | GHL_STRUM_UP, "up" },
+    { 2, 0x04, 0x04, ORBIS_PAD_BUTTON_LEFT, "left" },
+    { 2, 0x02, 0x02, ORBIS_PAD_BUTTON_DOWN | GHL_STRUM_DOWN, "down" },
+    { 2, 0x08, 0x08, ORBIS_PAD_BUTTON_RIGHT, "right" },
+    // special buttons (start, ghtv)
+    { 2, 0x20, 0x20, ORBIS_PAD_BUTTON_R3, "hero_power" }, // hero power/select button
+    { 2, 0x10, 0x10, ORBIS_PAD_BUTTON_OPTIONS, "pause" }, // pause/start button
+    { 2, 0x40, 0x40, ORBIS_PAD_BUTTON_L3, "ghtv" }, // GHTV button
+};
+_Static_assert(MAPPING_COUNT(ghl_xinput_mapping) <= MAX_DRIVER_MAPPINGS, "ghl_xinput_mapping has more than MAX_DRIVER_MAPPINGS entries");
+
+static const OITranslateMapping ghl_hid_mapping[] = {
+    // fret buttons
+    { 0, 0x02, 0x02, ORBIS_PAD_BUTTON_CROSS, "b1" },
+    { 0, 0x04, 0x04, ORBIS_PAD_BUTTON_CIRCLE, "b2" },
+    { 0, 0x08, 0x08, ORBIS_PAD_BUTTON_TRIANGLE, "b3" },
+    { 0, 0x01, 0x01, ORBIS_PAD_BUTTON_SQUARE, "w1" },
+    { 0, 0x10, 0x10, ORBIS_PAD_BUTTON_L1, "w2" },
+    { 0, 0x20, 0x20, ORBIS_PAD_BUTTON_R1, "w3" },
+    // dpad (nav + strumming), this is a hat so only exact values count
+    { 2, 0xFF, 0x00, ORBIS_PAD_BUTTON_UP, "up" },
+    { 2, 0xFF, 0x02, ORBIS_PAD_BUTTON_LEFT, "left" },
+    { 2, 0xFF, 0x04, ORBIS_PAD_BUTTON_DOWN, "down" },
+    { 2, 0xFF, 0x06, ORBIS_PAD_BUTTON_RIGHT, "right" },
+    // special buttons (start, ghtv)
+    { 1, 0x01, 0x01, ORBIS_PAD_BUTTON_R3, "hero_power" }, // hero power/select button
+    { 1, 0x02, 0x02, ORBIS_PAD_BUTTON_OPTIONS, "pause" }, // pause/start button
+    { 1, 0x04, 0x04, ORBIS_PAD_BUTTON_L3, "ghtv" }, // GHTV button
+};
+_Static_assert(MAPPING_COUNT(ghl_hid_mapping) <= MAX_DRIVER_MAPPINGS, "ghl_hid_mapping has more than MAX_DRIVER_MAPPINGS entries");
+
+// the hat value lives above the PS3 button bits in RB4's translated word
+#define RB4_HAT_SHIFT 16
+#define RB4_HAT_NEUTRAL (0x08 << RB4_HAT_SHIFT)
+
+static const OITranslateMapping rb4_xinput_mapping[] = {
+    // fret buttons (todo: make sure this is right for drums)
+    { 3, XINPUT_BUTTON_A, XINPUT_BUTTON_A, BIT(1), "green" },
+    { 3, XINPUT_BUTTON_B, XINPUT_BUTTON_B, BIT(2), "red" },
+    { 3, XINPUT_BUTTON_Y, XINPUT_BUTTON_Y, BIT(3), "yellow" },
+    { 3, XINPUT_BUTTON_X, XINPUT_BUTTON_X, BIT(0), "blue" },
+    { 3, XINPUT_BUTTON_LB, XINPUT_BUTTON_LB, BIT(4), "orange" }, // orange / (drums) kick
+    { 3, XINPUT_BUTTON_RB, XINPUT_BUTTON_RB, BIT(11), "cymbal" }, // (drums) cymbal
+    // special buttons
+    { 2, XINPUT_BUTTON_L3, XINPUT_BUTTON_L3, BIT(5), "kick2" }, // (drums) kick 2
+    { 2, XINPUT_BUTTON_BACK, XINPUT_BUTTON_BACK, BIT(8), "back" },
+    { 2, XINPUT_BUTTON_START, XINPUT_BUTTON_START, BIT(9), "start" },
+    { 2, XINPUT_BUTTON_R3, XINPUT_BUTTON_R3, BIT(10), "pad" }, // (drums) pad
+    // dpad/strum bar, when several are held right beats left beats down beats up
+    { 2, 0x0F, 0x00, RB4_HAT_NEUTRAL, NULL },
+    { 2, 0x0F, XINPUT_BUTTON_UP, 0x00 << RB4_HAT_SHIFT, "up" },
+    { 2, 0x0E, XINPUT_BUTTON_DOWN, 0x04 << RB4_HAT_SHIFT, "down" },
+    { 2, 0x0C, XINPUT_BUTTON_LEFT, 0x06 << RB4_HAT_SHIFT, "left" },
+    { 2, 0x08, XINPUT_BUTTON_RIGHT, 0x02 << RB4_HAT_SHIFT, "right" },
+};
+_Static_assert(MAPPING_COUNT(rb4_xinput_mapping) <= MAX_DRIVER_MAPPINGS, "rb4_xinput_mapping has more than MAX_DRIVER_MAPPINGS entries");
+
+// which mappings a driver's buttons come from, and what a remap can't move
+typedef struct _OIDriverButtons {
+    const OITranslateMapping *mappings;
+    int num_mappings;
+    // the positions of a hat, they only swap with each other since the hat reads as one value
+    bool has_hat;
+    uint32_t keep; // internal bits that stay with the physical button
+} OIDriverButtons;
+
+#define DRIVER_BUTTONS(mapping, hat, keep) { mapping, MAPPING_COUNT(mapping), hat, keep }
+static const OIDriverButtons driver_buttons[OI_Driver_Count] = {
+    [OI_Driver_GHL_HID] = DRIVER_BUTTONS(ghl_hid_mapping, false, 0),
+    [OI_Driver_GHL_XInput] = DRIVER_BUTTONS(ghl_xinput_mapping, false, GHL_STRUM_MASK),
+    [OI_Driver_GHL_XOne] = DRIVER_BUTTONS(ghl_hid_mapping, false, 0),
+    [OI_Driver_XInputGuitar] = DRIVER_BUTTONS(rb4_xinput_mapping, true, 0),
+    [OI_Driver_XInputDrums] = DRIVER_BUTTONS(rb4_xinput_mapping, true, 0),
+    [OI_Driver_XInputWireless] = DRIVER_BUTTONS(rb4_xinput_mapping, true, 0),
+    [OI_Driver_XInputWirelessDrums] = DRIVER_BUTTONS(rb4_xinput_mapping, true, 0),
+};
+
+// built from the settings by OIDriversInit, nothing writes to them after that
+static OIDriverTuning driver_tuning[OI_Driver_Count];
+
+// strum bar position from the up/down strum bits, up wins if both are set
+static const uint8_t ghl_strum_positions[4] = { 0x80, 0x00, 0xFF, 0x00 };
+
+// PS3/Wii U guitars require a constant keepalive packet to have strums work, Xbox One ones get it wrapped in GIP
+// TODO: set the LED index in this packet, once we know where it goes
+static const uint8_t ghl_keepalive[GHL_KEEPALIVE_SIZE] = { 0x02, 0x08, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+static void InitAxes(OIDriverState *state) {
+    memset(&state->input, 0, sizeof(state->input));
+    OIAnalogInit(&state->whammy, &whammy_config);
+    OIAnalogInit(&state->tilt, &tilt_config);
+}
+
+// PS3/Wii U GHL dongle
+
+static void DecodeGHLReport(OIDriverState *state, const uint8_t *hid_report) {
+    const OIDriverTuning *tuning = state->tuning;
+    state->input.translated = OITranslate(&tuning->buttons, hid_report);
+    // strum bar
+    state->input.strum = hid_report[4];
+    // whammy
+    state->input.whammy = tuning->whammy[hid_report[6]];
+    // tilt
+    state->input.tilt = tuning->tilt[hid_report[19]];
+}
+
+static bool DecodeGHLHID(OIDriverState *state, const uint8_t *report, int length, uint64_t time) {
+    if (length < GHL_HID_MIN_REPORT_SIZE)
+        return false;
+    DecodeGHLReport(state, report);
+    return true;
+}
+
+static int OutputGHLHID(OIDriverState *state, uint8_t *buffer, bool *keepalive) {
+    if (!*keepalive)
+        return 0;
+    *keepalive = false;
+    sceUsbdFillControlSetup(buffer, 0x21, 0x09, 0x0201, 0x0000, GHL_KEEPALIVE_SIZE);
+    memcpy(buffer + GHL_CONTROL_SETUP_SIZE, ghl_keepalive, GHL_KEEPALIVE_SIZE);
+    return GHL_CONTROL_SETUP_SIZE + GHL_KEEPALIVE_SIZE;
+}
+
+// XInput, the 360 GHL dongle and RB4's wired and wireless instruments
+
+static inline bool IsXInputControls(const uint8_t *report, int length) {
+    return length >= (int)XINPUT_CONTROLS_MIN_LENGTH && report[0] == XINPUT_MESSAGE_CONTROLS;
+}
+
+// whammy and tilt, calibrated against what the instrument's actually been seen to send
+static inline void DecodeXInputAxes(OIDriverState *state, int16_t whammy, int16_t tilt, uint64_t time) {
+    state->input.whammy = state->tuning->whammy[OIAnalogProcess(&state->whammy, whammy, time)];
+    state->input.tilt = state->tuning->tilt[OIAnalogProcess(&state->tilt, tilt, time)];
+}
+
+static bool DecodeGHLXInput(OIDriverState *state, const uint8_t *report, int length, uint64_t time) {
+    if (!IsXInputControls(report, length))
+        return false;
+    const xinput_report_controls *controls = (const xinput_report_controls *)report;
+    uint32_t translated = OITranslate(&state->tuning->buttons, report);
+    // strum bar, due to enable packet being required lets just use the dpad and lie
+    translated |= (controls->left_stick_y == 32767) ? GHL_STRUM_DOWN : 0;
+    translated |= (controls->left_stick_y == -32768) ? GHL_STRUM_UP : 0;
+    state->input.strum = ghl_strum_positions[translated >> 30];
+    state->input.translated = translated & ~GHL_STRUM_MASK;
+    DecodeXInputAxes(state, controls->right_stick_y, controls->right_stick_x, time);
+    return true;
+}
+
+// the controller subtype is in the XInput descriptor, the device class doesn't say what kind of instrument it is
+static bool IsXInput(const OIDriverDescriptor *desc) {
+    return desc->interface_subclass == 0x5D && desc->xinput;
+}
+
+static bool IdentifyXInputGuitar(const OIDriverDescriptor *desc) {
+    return IsXInput(desc) && (desc->xinput_subtype == XINPUT_SUBTYPE_GUITAR ||
+        desc->xinput_subtype == XINPUT_SUBTYPE_GUITAR_ALTERNATE ||
+        desc->xinput_subtype == XINPUT_SUBTYPE_GUITAR_BASS);
+}
+
+static bool IdentifyXInputDrums(const OIDriverDescriptor *desc) {
+    return IsXInput(desc) && (desc->xinput_subtype == XINPUT_SUBTYPE_DRUM_KIT ||
+        desc->xinput_subtype == XINPUT_SUBTYPE_GAMEPAD); // (for testing purposes)
+}
+
+// if we're not a known subtype, assume that we're a wireless dongle (mine has 0x13 at this position)
+static bool IdentifyXInputWireless(const OIDriverDescriptor *desc) {
+    return IsXInput(desc);
+}
+
+static void PresentRB4Guitar(struct libusb_device_descriptor *desc) {
+    desc->idVendor = 0x12BA;
+    desc->idProduct = 0x0200;
+}
+
+static void PresentRB4Drums(struct libusb_device_descriptor *desc) {
+    desc->idVendor = 0x12BA;
+    desc->idProduct = 0x0210;
+}
+
+// what a freshly opened instrument reads as until its first report, nothing held
+static void InitRB4XInput(OIDriverState *state) {
+    InitAxes(state);
+    state->input.translated = OITranslate(&state->tuning->buttons, xinput_neutral_report);
+}
+
+static bool DecodeRB4XInput(OIDriverState *state, const uint8_t *report, int length, uint64_t time) {
+    if (!IsXInputControls(report, length))
+        return false;
+    const xinput_report_controls *controls = (const xinput_report_controls *)report;
+    state->input.translated = OITranslate(&state->tuning->buttons, report);
+    DecodeXInputAxes(state, controls->right_stick_x, controls->right_stick_y, time);
+    return true;
+}
+
+// 360 kits put each pad's velocity on a stick axis, with some of them negated, so only the distance from the middle counts
+static inline uint8_t DrumVelocity(int16_t axis) {
+    uint32_t velocity = (axis < 0 ? -(int32_t)axis : axis) >> 7;
+    return velocity > 255 ? 255 : velocity;
+}
+
+// the pad and cymbal flags and both kicks are buttons like any other, the sticks are velocities rather than whammy and tilt
+static bool DecodeRB4XInputDrums(OIDriverState *state, const uint8_t *report, int length, uint64_t time) {
+    if (!IsXInputControls(report, length))
+        return false;
+    const xinput_report_controls *controls = (const xinput_report_controls *)report;
+    state->input.translated = OITranslate(&state->tuning->buttons, report);
+    state->input.velocity[OI_Drum_Red] = DrumVelocity(controls->left_stick_x);
+    state->input.velocity[OI_Drum_Yellow] = DrumVelocity(controls->left_stick_y);
+    state->input.velocity[OI_Drum_Blue] = DrumVelocity(controls->right_stick_x);
+    state->input.velocity[OI_Drum_Green] = DrumVelocity(controls->right_stick_y);
+    return true;
+}
+
+// sometimes the wireless report will just be a silly nothingpacket, then the last real one stands
+static inline bool IsXInputWirelessData(const uint8_t *report, int length) {
+    return length > XINPUT_WIRELESS_HEADER_LENGTH && report[1] == XINPUT_WIRELESS_DATA;
+}
+
+static bool DecodeRB4XInputWireless(OIDriverState *state, const uint8_t *report, int length, uint64_t time) {
+    if (!IsXInputWirelessData(report, length))
+        return false;
+    return DecodeRB4XInput(state, report + XINPUT_WIRELESS_HEADER_LENGTH, length - XINPUT_WIRELESS_HEADER_LENGTH, time);
+}
+
+static bool DecodeRB4XInputWirelessDrums(OIDriverState *state, const uint8_t *report, int length, uint64_t time) {
+    if (!IsXInputWirelessData(report, length))
+        return false;
+    return DecodeRB4XInputDrums(state, report + XINPUT_WIRELESS_HEADER_LENGTH, length - XINPUT_WIRELESS_HEADER_LENGTH, time);
+}
+
+// Wii instruments use the Harmonix Music Systems vendor id, and already send reports RB4 understands.
+// the ones in data/instrument_ids.txt get their PS3 counterpart's PID, anything else at least gets the vendor
+
+static bool IdentifyWiiRB(const OIDriverDescriptor *desc) {
+    return desc->vendor_id == 0x1BAD;
+}
+
+static void PresentWiiRB(struct libusb_device_descriptor *desc) {
+    desc->idVendor = 0x12BA; // licensed by SCEA
+}
+
+// Xbox One GHL dongle, speaks GIP in both directions
+
+// an Xbox One dongle that was already plugged in won't announce itself, so it gets powered on regardless
+static void InitGHLXOne(OIDriverState *state) {
+    InitAxes(state);
+    atomic_store(&state->gip_power_on_pending, true);
+    atomic_store(&state->gip_ack_pending, 0);
+    state->gip_sequence = 0;
+}
+
+// what's owed to the acknowledged message, 7 bits of length is plenty since nothing longer than a packet gets decoded
+static uint32_t PackGIPAcknowledge(const gip_header *header, uint32_t length) {
+    return 0x80000000 | ((length & 0x7F) << 24) | ((uint32_t)header->sequence << 16) |
+        ((uint32_t)header->command << 8) | header->options;
+}
+
+static uint8_t NextGIPSequence(OIDriverState *state) {
+    // 0 isn't a valid sequence
+    if (++state->gip_sequence == 0)
+        state->gip_sequence = 1;
+    return state->gip_sequence;
+}
+
+// where a GIP message's payload starts, or 0 if its header's cut short
+static int ParseGIPLength(const uint8_t *message, int length, uint32_t *payload_length) {
+    // a LEB128 varint, anything a dongle sends in one packet fits in a byte or two
+    *payload_length = 0;
+    for (int offset = 3, shift = 0; offset < length && shift < 28; offset++, shift += 7) {
+        *payload_length |= (uint32_t)(message[offset] & 0x7F) << shift;
+        if ((message[offset] & 0x80) == 0)
+            return offset + 1;
+    }
+    return 0;
+}
+
+// queues up anything the dongle wants sent back, output sends it once this report's been handled
+static bool DecodeGHLXOne(OIDriverState *state, const uint8_t *message, int length, uint64_t time) {
+    uint32_t payload_length;
+    int start = ParseGIPLength(message, length, &payload_length);
+    // chunked messages are descriptors, which we never ask for
+    if (start == 0 || payload_length > (uint32_t)(length - start))
+        return false;
+    const gip_header *header = (const gip_header *)message;
+    if (header->options & GIP_OPT_ACKNOWLEDGE)
+        atomic_store(&state->gip_ack_pending, PackGIPAcknowledge(header, payload_length));
+
+    if (header->command == GIP_CMD_GHL_INPUT && payload_length >= GHL_HID_MIN_REPORT_SIZE) {
+        DecodeGHLReport(state, message + start);
+        return true;
+    } else if (header->command == GIP_CMD_ANNOUNCE && (header->options & GIP_OPT_INTERNAL)) {
+        // the dongle's only just come up, or has reset itself
+        atomic_store(&state->gip_power_on_pending, true);
+    }
+    return false;
+}
+
+// acknowledges come first since the dongle's waiting on them, then powering on, then the game's keepalives
+static int OutputGHLXOne(OIDriverState *state, uint8_t *buffer, bool *keepalive) {
+    gip_header *header = (gip_header *)buffer;
+    uint8_t *payload = buffer + sizeof(gip_header);
+    uint32_t ack = atomic_exchange(&state->gip_ack_pending, 0);
+    if (ack != 0) {
+        gip_acknowledge *acknowledge = (gip_acknowledge *)payload;
+        uint8_t client = ack & GIP_OPT_CLIENT_MASK;
+        header->command = GIP_CMD_ACKNOWLEDGE;
+        header->options = GIP_OPT_INTERNAL | client;
+        header->sequence = (ack >> 16) & 0xFF;
+        header->length = sizeof(gip_acknowledge);
+        memset(acknowledge, 0, sizeof(gip_acknowledge));
+        acknowledge->command = (ack >> 8) & 0xFF;
+        acknowledge->options = GIP_OPT_INTERNAL | client;
+        acknowledge->length = (ack >> 24) & 0x7F;
+    } else if (atomic_exchange(&state->gip_power_on_pending, false)) {
+        header->command = GIP_CMD_POWER;
+        header->options = GIP_OPT_INTERNAL;
+        header->sequence = NextGIPSequence(state);
+        header->length = sizeof(gip_power);
+        ((gip_power *)payload)->mode = GIP_POWER_ON;
+    } else if (*keepalive) {
+        *keepalive = false;
+        header->command = GIP_CMD_GHL_POKE;
+        header->options = 0;
+        header->sequence = NextGIPSequence(state);
+        header->length = GHL_KEEPALIVE_SIZE;
+        memcpy(payload, ghl_keepalive, GHL_KEEPALIVE_SIZE);
+    } else {
+        return 0;
+    }
+    return sizeof(gip_header) + header->length;
+}
+
+_Static_assert(GHL_CONTROL_SETUP_SIZE + GHL_KEEPALIVE_SIZE <= OI_DRIVER_OUTPUT_MAX &&
+    sizeof(gip_header) + sizeof(gip_acknowledge) <= OI_DRIVER_OUTPUT_MAX &&
+    sizeof(gip_header) + GHL_KEEPALIVE_SIZE <= OI_DRIVER_OUTPUT_MAX, "driver output doesn't fit");
+
+const OIDriver oi_drivers[OI_Driver_Count] = {
+    [OI_Driver_GHL_HID] = {
+        .id = OI_Driver_GHL_HID, .name = "PS3/Wii U GHL guitar", .config_name = "ghl_ps3", .front_end = OI_FrontEnd_GHL,
+        .capture_source = OI_Capture_GHL_HID, .report_size = 30, .output_endpoint = 0,
+        .init = InitAxes, .decode = DecodeGHLHID, .output = OutputGHLHID
+    },
+    [OI_Driver_GHL_XInput] = {
+        .id = OI_Driver_GHL_XInput, .name = "Xbox 360 GHL guitar", .config_name = "ghl_xbox360", .front_end = OI_FrontEnd_GHL,
+        .capture_source = OI_Capture_GHL_XInput, .report_size = 30,
+        .init = InitAxes, .decode = DecodeGHLXInput
+    },
+    [OI_Driver_GHL_XOne] = {
+        .id = OI_Driver_GHL_XOne, .name = "Xbox One GHL guitar", .config_name = "ghl_xboxone", .front_end = OI_FrontEnd_GHL,
+        // GIP messages can take up a whole packet
+        .capture_source = OI_Capture_GHL_XOne, .report_size = OI_DRIVER_REPORT_MAX, .output_endpoint = 0x01,
+        .init = InitGHLXOne, .decode = DecodeGHLXOne, .output = OutputGHLXOne
+    },
+    [OI_Driver_WiiRB] = {
+        .id = OI_Driver_WiiRB, .name = "Wii instrument", .front_end = OI_FrontEnd_RB4,
+        .identify = IdentifyWiiRB, .present = PresentWiiRB, .init = InitAxes
+    },
+    [OI_Driver_XInputGuitar] = {
+        .id = OI_Driver_XInputGuitar, .name = "Xbox 360 guitar", .config_name = "xbox360_guitar", .front_end = OI_FrontEnd_RB4,
+        .capture_source = OI_Capture_RB4_XInput,
+        .identify = IdentifyXInputGuitar, .present = PresentRB4Guitar, .init = InitRB4XInput, .decode = DecodeRB4XInput
+    },
+    [OI_Driver_XInputDrums] = {
+        .id = OI_Driver_XInputDrums, .name = "Xbox 360 drums", .config_name = "xbox360_drums", .front_end = OI_FrontEnd_RB4,
+        .capture_source = OI_Capture_RB4_XInputDrums,
+        .identify = IdentifyXInputDrums, .present = PresentRB4Drums, .init = InitRB4XInput, .decode = DecodeRB4XInputDrums
+    },
+    [OI_Driver_XInputWireless] = {
+        .id = OI_Driver_XInputWireless, .name = "Xbox 360 wireless adapter", .config_name = "xbox360_wireless", .front_end = OI_FrontEnd_RB4,
+        .capture_source = OI_Capture_RB4_XInputWireless,
+        .identify = IdentifyXInputWireless, .present = PresentRB4Guitar, .init = InitRB4XInput, .decode = DecodeRB4XInputWireless
+    },
+    // what a wireless adapter slot with a kit on it is switched to, the adapter itself always identifies as the above
+    [OI_Driver_XInputWirelessDrums] = {
+        .id = OI_Driver_XInputWirelessDrums, .name = "Xbox 360 wireless drums", .config_name = "xbox360_wireless_drums", .front_end = OI_FrontEnd_RB4,
+        .capture_source = OI_Capture_RB4_XInputWirelessDrums,
+        .present = PresentRB4Drums, .init = InitRB4XInput, .decode = DecodeRB4XInputWirelessDrums
+    },
+};
+
+static bool IsHat(const OIDriverButtons *buttons, int index) {
+    return buttons->has_hat && buttons->mappings[index].mask != buttons->mappings[index].value;
+}
+
+// deadzone, then scale, then invert, worked out for every value once so decoding is a single load
+static void CompileAxis(uint8_t *lut, const OIConfigAxis *axis) {
+    for (int i = 0; i < 256; i++) {
+        int value = i <= axis->deadzone ? 0 : (i - axis->deadzone) * 255 / (255 - axis->deadzone);
+        value = value * axis->scale / 100;
+        if (value > 255)
+            value = 255;
+        lut[i] = axis->invert ? 255 - value : value;
+    }
+}
+
+static void CompileButtons(OIDriverId id, const OIConfigDriver *config) {
+    const OIDriverButtons *buttons = &driver_buttons[id];
+    if (buttons->mappings == NULL)
+        return;
+    // a remapped button reads as whatever its target does by default
+    OITranslateMapping mappings[MAX_DRIVER_MAPPINGS];
+    memcpy(mappings, buttons->mappings, buttons->num_mappings * sizeof(OITranslateMapping));
+    for (int i = 0; i < config->num_remaps; i++) {
+        const OIConfigRemap *remap = &config->remaps[i];
+        uint32_t kept = buttons->mappings[remap->button].output & buttons->keep;
+        uint32_t target = remap->target == OI_CONFIG_REMAP_NONE ? 0 : buttons->mappings[remap->target].output & ~buttons->keep;
+        mappings[remap->button].output = target | kept;
+    }
+    if (!OITranslateCompile(&driver_tuning[id].buttons, mappings, buttons->num_mappings))
+        final_printf("Couldn't build the button table for %s\n", oi_drivers[id].name);
+}
+
+void OIDriversInit() {
+    const OIConfig *config = OIConfigGet();
+    for (int i = 0; i < OI_Driver_Count; i++) {
+        CompileButtons((OIDriverId)i, &config->drivers[i]);
+        CompileAxis(driver_tuning[i].whammy, &config->drivers[i].whammy);
+        CompileAxis(driver_tuning[i].tilt, &config->drivers[i].tilt);
+    }
+}
+
+void OIDriverStart(const OIDriver *driver, OIDriverState *state) {
+    state->tuning = &driver_tuning[driver->id];
+    driver->init(state);
+}
+
+int OIDriverButtonIndex(OIDriverId id, const char *name) {
+    const OIDriverButtons *buttons = &driver_buttons[id];
+    for (int i = 0; i < buttons->num_mappings; i++) {
+        if (buttons->mappings[i].name != NULL && strcmp(buttons->mappings[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+bool OIDriverCanRemap(OIDriverId id, int button, int target) {
+    const OIDriverButtons *buttons = &driver_buttons[id];
+    if (button < 0 || button >= buttons->num_mappings || buttons->mappings[button].name == NULL)
+        return false;
+    // a hat has to read as one of its positions, so it can't be left doing nothing
+    if (target == OI_CONFIG_REMAP_NONE)
+        return !IsHat(buttons, button);
+    if (target < 0 || target >= buttons->num_mappings || buttons->mappings[target].name == NULL)
+        return false;
+    return IsHat(buttons, button) == IsHat(buttons, target);
+}
+
+bool OIDriverDescribe(libusb_device *device, const struct libusb_device_descriptor *device_desc, OIDriverDescriptor *desc) {
+    struct libusb_device_descriptor read_desc;
+    if (device_desc == NULL) {
+        if (sceUsbdGetDeviceDescriptor(device, &read_desc) != 0)
+            return false;
+        device_desc = &read_desc;
+    }
+    memset(desc, 0, sizeof(*desc));
+    desc->vendor_id = device_desc->idVendor;
+    desc->product_id = device_desc->idProduct;
+    desc->device_class = device_desc->bDeviceClass;
+    desc->device_subclass = device_desc->bDeviceSubClass;
+    desc->device_protocol = device_desc->bDeviceProtocol;
+
+    // only vendor specific devices are worth reading the config descriptor of
+    if (desc->device_class != 0xFF || desc->device_subclass != 0xFF || desc->device_protocol != 0xFF)
+        return true;
+    struct libusb_config_descriptor *config;
+    if (sceUsbdGetConfigDescriptor(device, 0, &config) != 0)
+        return true;
+    // the xinput devices have a class of 0xFF and subclass of 0x5D
+    // just in case whatever we messed with breaks, use subclass rather than class
+    const struct libusb_interface_descriptor *altsetting = config->interface[0].altsetting;
+    desc->interface_subclass = altsetting->bInterfaceSubClass;
+    // controller subtype is at the 5th byte
+    if (altsetting->extra != NULL && altsetting->extra_length > 6) {
+        desc->xinput = true;
+        desc->xinput_subtype = altsetting->extra[4];
+    }
+    sceUsbdFreeConfigDescriptor(config);
+    return true;
+}
+
+const OIDriver *OIDriverIdentify(const OIDriverDescriptor *desc, OIDriverFrontEnd front_end) {
+    // a listed VID/PID beats anything worked out from the descriptors
+    const OIInstrumentId *id = OIInstrumentIdLookup(desc->vendor_id, desc->product_id);
+    if (id != NULL && oi_drivers[id->driver].front_end == front_end)
+        return &oi_drivers[id->driver];
+    for (int i = 0; i < OI_Driver_Count; i++) {
+        if (oi_drivers[i].front_end == front_end && oi_drivers[i].identify != NULL && oi_drivers[i].identify(desc))
+            return &oi_drivers[i];
+    }
+    return NULL;
+}
+
+void OIDriverPresent(const OIDriver *driver, struct libusb_device_descriptor *desc) {
+    const OIInstrumentId *id = OIInstrumentIdLookup(desc->idVendor, desc->idProduct);
+    if (id != NULL && id->driver == driver->id && id->present_vendor_id != 0) {
+        desc->idVendor = id->present_vendor_id;
+        desc->idProduct = id->present_product_id;
+    } else if (driver->present != NULL) {
+        driver->present(desc);
+    }
+}
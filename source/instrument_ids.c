@@ -0,0 +1,42 @@
+/*
+    instrument_ids.c - OrbisInstrumentalizer
+    Looks instruments up by VID/PID in the table generated from data/instrument_ids.txt.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "OIInstrumentIds.h"
+// made by tools/oi_gen_ids.py at build time
+#include "instrument_ids.gen.h"
+
+// has to match hash_key in tools/oi_gen_ids.py
+static inline uint32_t OIInstrumentIdHash(uint32_t key, uint32_t seed) {
+    uint32_t h = key ^ seed;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+const OIInstrumentId *OIInstrumentIdLookup(uint16_t vendor_id, uint16_t product_id) {
+    uint32_t key = ((uint32_t)vendor_id << 16) | product_id;
+    uint16_t displacement = instrument_id_displacements[OIInstrumentIdHash(key, 0) & (OI_INSTRUMENT_ID_BUCKETS - 1)];
+    uint16_t index = instrument_id_slots[OIInstrumentIdHash(key, displacement) & (OI_INSTRUMENT_ID_SLOTS - 1)];
+    // anything that isn't listed still lands somewhere, so the slot has to be checked
+    if (index == OI_INSTRUMENT_ID_EMPTY)
+        return NULL;
+    const OIInstrumentId *id = &instrument_ids[index];
+    return id->vendor_id == vendor_id && id->product_id == product_id ? id : NULL;
+}
+
+const OIInstrumentId *OIInstrumentIdGet(int index) {
+    return index >= 0 && index < OI_INSTRUMENT_ID_COUNT ? &instrument_ids[index] : NULL;
+}
+
+int OIInstrumentIdCount() {
+    return OI_INSTRUMENT_ID_COUNT;
+}
@@ -0,0 +1,87 @@
+/*
+    latency.c - OrbisInstrumentalizer
+    Reporting for the report latency histograms.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OILatency.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+static const char *stage_names[OI_Latency_StageCount] = { "parse", "read" };
+
+static uint64_t TicksToMicroseconds(uint64_t ticks) {
+    uint64_t frequency = sceKernelGetTscFrequency();
+    if (frequency == 0)
+        return 0;
+    // split so a long uptime's worth of ticks can't overflow before the divide
+    return (ticks / frequency) * 1000000 + (ticks % frequency) * 1000000 / frequency;
+}
+
+void OILatencyClockInit(OILatencyClock *clock) {
+    uint64_t frequency = sceKernelGetTscFrequency();
+    clock->time_base = sceKernelGetProcessTime();
+    clock->tsc_base = OILatencyNow();
+    clock->scale = frequency == 0 ? 0 : (uint64_t)(((unsigned __int128)1000000 << OI_LATENCY_CLOCK_SHIFT) / frequency);
+}
+
+// the highest tick count that lands in a bucket
+static uint64_t BucketLimit(int bucket) {
+    if (bucket < 4)
+        return bucket;
+    int msb = (bucket + 4) / 4;
+    uint64_t step = 1ULL << (msb - 2);
+    return ((4 + ((bucket + 4) % 4)) * step) + step - 1;
+}
+
+uint64_t OILatencyPercentile(const OILatencyHistogram *hist, int percent) {
+    if (hist->count == 0)
+        return 0;
+    uint64_t target = (hist->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < OI_LATENCY_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target) {
+            // the bucket's upper edge can overshoot what was actually recorded
+            uint64_t limit = BucketLimit(i);
+            return TicksToMicroseconds(limit < hist->max ? limit : hist->max);
+        }
+    }
+    return TicksToMicroseconds(hist->max);
+}
+
+void OILatencyLog(const char *name, int device, const OILatencyStats *stats) {
+    for (int i = 0; i < OI_Latency_StageCount; i++) {
+        const OILatencyHistogram *hist = &stats->stages[i];
+        final_printf("%s device %i %s latency: %lu reports, p50 %luus, p99 %luus, max %luus\n", name, device, stage_names[i],
+            hist->count, OILatencyPercentile(hist, 50), OILatencyPercentile(hist, 99), TicksToMicroseconds(hist->max));
+    }
+}
+
+bool OILatencyWriteFile(const char *path, const OILatencyStats **stats, int num_devices) {
+    int fd = sceKernelOpen(path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (fd < 0) {
+        final_printf("Failed to open %s for latency stats (%08x)\n", path, fd);
+        return false;
+    }
+    OILatencyFileHeader header = {
+        .magic = OI_LATENCY_FILE_MAGIC,
+        .version = OI_LATENCY_FILE_VERSION,
+        .num_stages = OI_Latency_StageCount,
+        .num_devices = num_devices,
+        .num_buckets = OI_LATENCY_BUCKETS,
+        .tsc_frequency = sceKernelGetTscFrequency()
+    };
+    bool ok = sceKernelWrite(fd, &header, sizeof(header)) == sizeof(header);
+    for (int i = 0; ok && i < num_devices; i++)
+        ok = sceKernelWrite(fd, stats[i], sizeof(OILatencyStats)) == sizeof(OILatencyStats);
+    sceKernelClose(fd);
+    return ok;
+}
@@ -0,0 +1,126 @@
+/*
+    log.c - OrbisInstrumentalizer
+    Lock-free log ring and the thread that drains it to klog.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OILog.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+#define OI_LOG_RING_SIZE 1024 // must be a power of two
+#define OI_LOG_DRAIN_INTERVAL_USEC 10000
+#define OI_LOG_BATCH_SIZE 1024
+// lowest priority a thread can have
+#define OI_LOG_DRAIN_PRIORITY 767
+
+typedef struct _OILogEntry {
+    // even while the slot is free for lap/2 of the ring, odd once it's been written in that lap
+    atomic_size_t lap;
+    const char *format;
+    uint64_t args[OI_LOG_MAX_ARGS];
+} OILogEntry;
+
+// zeroed memory is a valid empty ring, so logging works even before OILogInit
+static OILogEntry ring[OI_LOG_RING_SIZE];
+static atomic_size_t write_pos = 0;
+static size_t read_pos = 0; // only touched by the drain thread
+static atomic_uint dropped_count = 0;
+
+static OrbisPthread drain_thread;
+static atomic_bool drain_thread_quit = false;
+static bool drain_thread_running = false;
+
+void OILogWrite(const char *format, const uint64_t *args) {
+    size_t pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+    OILogEntry *entry;
+    for (;;) {
+        entry = &ring[pos & (OI_LOG_RING_SIZE - 1)];
+        size_t expected = (pos / OI_LOG_RING_SIZE) * 2;
+        intptr_t diff = (intptr_t)(atomic_load_explicit(&entry->lap, memory_order_acquire) - expected);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&write_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // the drain thread hasn't caught up, never wait for it
+            atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+        }
+    }
+    entry->format = format;
+    for (int i = 0; i < OI_LOG_MAX_ARGS; i++)
+        entry->args[i] = args[i];
+    atomic_store_explicit(&entry->lap, (pos / OI_LOG_RING_SIZE) * 2 + 1, memory_order_release);
+}
+
+// formats everything that's been written so far, in as few klog calls as possible
+static void DrainLog() {
+    char batch[OI_LOG_BATCH_SIZE];
+    int batch_length = 0;
+    for (;;) {
+        OILogEntry *entry = &ring[read_pos & (OI_LOG_RING_SIZE - 1)];
+        size_t lap = (read_pos / OI_LOG_RING_SIZE) * 2;
+        if (atomic_load_explicit(&entry->lap, memory_order_acquire) != lap + 1)
+            break;
+        char line[256];
+        // integer varargs all go through 64-bit slots on x86_64, so this is fine for %i and friends too
+        int length = snprintf(line, sizeof(line), entry->format, entry->args[0], entry->args[1], entry->args[2], entry->args[3]);
+        atomic_store_explicit(&entry->lap, lap + 2, memory_order_release);
+        read_pos++;
+
+        if (length < 0)
+            continue;
+        if (length >= (int)sizeof(line))
+            length = sizeof(line) - 1;
+        if (batch_length + length >= OI_LOG_BATCH_SIZE) {
+            klog("%s", batch);
+            batch_length = 0;
+        }
+        memcpy(batch + batch_length, line, length + 1);
+        batch_length += length;
+    }
+    if (batch_length > 0)
+        klog("%s", batch);
+
+    uint32_t dropped = atomic_exchange_explicit(&dropped_count, 0, memory_order_relaxed);
+    if (dropped > 0)
+        final_printf("Log ring was full, dropped %u messages\n", dropped);
+}
+
+static void *drainThread(void *args) {
+    while (!atomic_load(&drain_thread_quit)) {
+        DrainLog();
+        sceKernelUsleep(OI_LOG_DRAIN_INTERVAL_USEC);
+    }
+    DrainLog();
+    scePthreadExit(NULL);
+    return NULL;
+}
+
+void OILogInit() {
+    atomic_store(&drain_thread_quit, false);
+    if (scePthreadCreate(&drain_thread, NULL, drainThread, NULL, "OrbisInstrumentLogThread") != 0) {
+        final_printf("Failed to start the log thread!\n");
+        return;
+    }
+    scePthreadSetprio(drain_thread, OI_LOG_DRAIN_PRIORITY);
+    drain_thread_running = true;
+}
+
+void OILogShutdown() {
+    if (!drain_thread_running)
+        return;
+    atomic_store(&drain_thread_quit, true);
+    scePthreadJoin(drain_thread, NULL);
+    drain_thread_running = false;
+}
@@ -18,6 +18,9 @@
 #include <GoldHEN/Common.h>
 #include <orbis/libkernel.h>
 #include <orbis/Sysmodule.h>
+#include "OILog.h"
+#include "OICapture.h"
+#include "OIConfig.h"
 
 attr_public const char *g_pluginName = PLUGIN_NAME;
 attr_public const char *g_pluginDesc = "Use other platform's plastic instruments on a PS4.";
@@ -53,12 +56,18 @@ void DoNotification(const char* text) {
 
 int32_t attr_module_hidden module_start(size_t argc, const void *args)
 {
+    OILogInit();
+    OICaptureInit();
+
     if (sys_sdk_proc_info(&procInfo) != 0) {
         final_printf("Failed to get process info!\n");
         return 0;
     }
 
     final_printf("Started plugin! Title ID: %s\n", procInfo.titleid);
+    // read before any hooks go in, the drivers build their tables from it
+    if (!OIConfigLoadForTitle(procInfo.titleid))
+        final_printf("No settings file for %s, using the defaults\n", procInfo.titleid);
 
     for (int i = 0; i < num_PadHookTitleIDs; i++) {
         if (strcmp(procInfo.titleid, PadHookTitleIDs[i]) == 0) {
@@ -90,5 +99,7 @@ int32_t attr_module_hidden module_stop(size_t argc, const void *args)
     if (UsingUsbdHooks)
         DestroyUsbdHooks();
 
+    OICaptureShutdown();
+    OILogShutdown();
     return 0;
 }
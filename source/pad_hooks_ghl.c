@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include <GoldHEN/Common.h>
 #include <orbis/Sysmodule.h>
@@ -17,7 +18,14 @@
 // uncomment when OpenOrbis merges #229
 //#include <orbis/Usbd.h>
 #include "OrbisUsbd.h"
-#include "xinput.h"
+#include "OIReportBuffer.h"
+#include "OIPadHistory.h"
+#include "OILatency.h"
+#include "OILog.h"
+#include "OICapture.h"
+#include "OIRegistry.h"
+#include "OITransferPool.h"
+#include "OIDriver.h"
 
 #define PLUGIN_NAME "OrbisInstrumentalizer"
 #define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
@@ -29,96 +37,242 @@ int (*scePadReadState)(int handle, OrbisPadData *data);
 int (*scePadGetControllerInformation)(int handle, OrbisPadInformation *info);
 int (*scePadOutputReport)(int handle, int type, uint8_t *report, int length);
 
-typedef enum _OIGHLDeviceType {
-    GHL_Type_None,
-    GHL_Type_HID,
-    GHL_Type_XInput,
-    //GHL_Type_XOne
-} OIGHLDeviceType;
+// how many interrupt transfers each device keeps queued, so the endpoint is never left without one
+#ifndef GHL_TRANSFERS_PER_DEVICE
+#define GHL_TRANSFERS_PER_DEVICE 3
+#endif
 
 typedef struct _OIGHLOpenDevice {
     bool isOpen;
     int sceUserID;
     int scePadHandle;
-    OIGHLDeviceType type;
+    const OIDriver *driver; // NULL while there's no instrument
     libusb_device_handle *usbDevice;
     uint8_t deviceAddress;
-    uint8_t reportBuffer[30];
+    // lent from transfer_pool while connected, only touched by sceUsbd and the transfer callback
+    OIPooledTransfer transfers[GHL_TRANSFERS_PER_DEVICE];
+    atomic_int transfersInFlight;
+    atomic_bool closing;
+    // keepalives and anything else sent to the device, only the event thread sends them, one at a time
+    OIPooledTransfer output;
+    atomic_bool outputInFlight;
+    atomic_bool keepaliveRequested; // by the game thread
+    uint64_t keepaliveLastSent; // only touched by the event thread
+    // decoded by the transfer callback, and whatever it leaves for output is sent by the event thread
+    OIDriverState driverState;
+    OIReportBuffer reports; // latest decoded OIPadState, handed over to the game thread
+    OIPadHistory history; // every decoded report, for games that read more than one state at a time
+    uint8_t reportSequence; // counts the device's input reports, only touched by the event thread
+    OILatencyStats latency; // kept across reconnects, parse is written by the event thread and read by the game thread
+    bool dumpChordHeld;
 } OIGHLOpenDevice;
 
-#define MAX_DEVICE_COUNT 4
+// one per pad the game opens on a special port, a registry can hold up to OI_REGISTRY_MAX_SLOTS
+#ifndef MAX_DEVICE_COUNT
+#define MAX_DEVICE_COUNT 8
+#endif
 static OIGHLOpenDevice open_devices[MAX_DEVICE_COUNT] = { 0 };
+// every transfer a device could need, so connecting never allocates and reconnecting never leaks
+#define GHL_POOL_SIZE (MAX_DEVICE_COUNT * (GHL_TRANSFERS_PER_DEVICE + 1))
+_Static_assert(GHL_POOL_SIZE <= OI_TRANSFER_POOL_MAX, "GHL needs more transfers than a pool holds");
+_Static_assert(OI_DRIVER_REPORT_MAX <= OI_TRANSFER_BUFFER_SIZE && OI_DRIVER_OUTPUT_MAX <= OI_TRANSFER_BUFFER_SIZE,
+    "GHL transfers don't fit in pooled buffers");
+static OITransferPool transfer_pool;
+// slots match open_devices, keyed by user ID and pad handle from the game and bus address from the event thread
+static OIRegistry device_registry;
 
 static OIGHLOpenDevice *OIGHLGetDeviceByUserID(int userID) {
-    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
-        if (open_devices[i].sceUserID == userID) {
-            return &open_devices[i];
-        } else if (open_devices[i].isOpen == false) {
-            open_devices[i].isOpen = true;
-            open_devices[i].sceUserID = userID;
-            return &open_devices[i];
-        }
-    }
-    return NULL;
+    int slot = OIRegistryLookup(&device_registry, OI_Registry_UserID, (uint32_t)userID);
+    return slot >= 0 ? &open_devices[slot] : NULL;
+}
+
+// only the game thread opens pads, so there's no racing another claim for the same user
+static OIGHLOpenDevice *OIGHLClaimDeviceForUserID(int userID) {
+    OIGHLOpenDevice *device = OIGHLGetDeviceByUserID(userID);
+    if (device != NULL)
+        return device;
+    int slot = OIRegistryClaim(&device_registry);
+    if (slot < 0)
+        return NULL;
+    device = &open_devices[slot];
+    device->isOpen = true;
+    device->sceUserID = userID;
+    OIRegistrySetKey(&device_registry, slot, OI_Registry_UserID, (uint32_t)userID);
+    return device;
 }
 
 static OIGHLOpenDevice *OIGHLGetDeviceByHandle(int padHandle) {
-    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
-        if (open_devices[i].isOpen == true && open_devices[i].scePadHandle == padHandle)
-            return &open_devices[i];
-    }
-    return NULL;
+    int slot = OIRegistryLookup(&device_registry, OI_Registry_PadHandle, (uint32_t)padHandle);
+    return slot >= 0 ? &open_devices[slot] : NULL;
 }
 
 static OIGHLOpenDevice *OIGHLGetDeviceByDeviceAddress(uint8_t deviceAddress) {
+    int slot = OIRegistryLookup(&device_registry, OI_Registry_BusAddress, deviceAddress);
+    return slot >= 0 ? &open_devices[slot] : NULL;
+}
+
+// instruments the event thread has found and opened, waiting for a pad to claim them
+typedef struct _OIGHLCandidate {
+    libusb_device_handle *usbDevice;
+    const OIDriver *driver;
+    uint8_t deviceAddress;
+} OIGHLCandidate;
+
+static OIGHLCandidate candidates[MAX_DEVICE_COUNT];
+static int candidate_count = 0;
+// guards candidates, and moving one into a pad's device slot
+static OrbisPthreadMutex candidate_mutex;
+
+static bool IsAddressTaken(uint8_t deviceAddress) {
+    for (int i = 0; i < candidate_count; i++) {
+        if (candidates[i].deviceAddress == deviceAddress)
+            return true;
+    }
+    return OIGHLGetDeviceByDeviceAddress(deviceAddress) != NULL;
+}
+
+// hands the newest candidate over to a pad, called every frame so it mustn't touch the USB stack
+static bool ClaimCandidate(OIGHLOpenDevice *open_device) {
+    bool claimed = false;
+    scePthreadMutexLock(&candidate_mutex);
+    if (candidate_count > 0) {
+        OIGHLCandidate *candidate = &candidates[--candidate_count];
+        open_device->usbDevice = candidate->usbDevice;
+        open_device->driver = candidate->driver;
+        open_device->deviceAddress = candidate->deviceAddress;
+        OIRegistrySetKey(&device_registry, open_device - open_devices, OI_Registry_BusAddress, candidate->deviceAddress);
+        claimed = true;
+    }
+    scePthreadMutexUnlock(&candidate_mutex);
+    return claimed;
+}
+
+// how long the event thread blocks inside sceUsbd before re-checking if it should park or quit
+#define USB_EVENT_TIMEOUT_USEC 100000
+// how many timeouts the event thread waits for cancelled transfers to come back when quitting
+#define USB_EVENT_DRAIN_PASSES 10
+
+static OrbisPthread event_thread;
+static OrbisPthreadMutex event_mutex;
+static OrbisPthreadCond event_cond;
+static atomic_int active_device_count = 0;
+static atomic_bool event_thread_quit = false;
+
+// wakes the event thread up if it's parked waiting for a device
+static void WakeEventThread() {
+    scePthreadMutexLock(&event_mutex);
+    scePthreadCondBroadcast(&event_cond);
+    scePthreadMutexUnlock(&event_mutex);
+}
+
+// how often the event thread looks for new devices, backing off while the bus stays the same
+#define DISCOVERY_MIN_INTERVAL_USEC 250000
+#define DISCOVERY_MAX_INTERVAL_USEC 4000000
+
+// only touched by the event thread
+static uint64_t discovery_seen[2] = { 0 }; // device addresses whose descriptors have already been checked
+static uint64_t discovery_next_time = 0;
+static uint32_t discovery_interval = DISCOVERY_MIN_INTERVAL_USEC;
+// set when a pad is opened or a device is closed, to look again straight away
+static atomic_bool discovery_kick = true;
+
+static bool WantsDiscovery() {
+    int waiting = 0;
     for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
-        if (open_devices[i].usbDevice != NULL && open_devices[i].deviceAddress == deviceAddress)
-            return &open_devices[i];
+        if (open_devices[i].isOpen && open_devices[i].usbDevice == NULL)
+            waiting++;
     }
-    return NULL;
+    return waiting > candidate_count;
 }
 
-static bool SearchForNewDevices(OIGHLOpenDevice *open_device) {
+static void DiscoverDevices() {
     libusb_device **list;
-    libusb_device_handle *candidate = NULL;
-    uint8_t cand_dev_addr = 0;
-    OIGHLDeviceType cand_type = GHL_Type_None;
+    uint64_t present[2] = { 0 };
+    bool changed = false;
+
+    // a kick means a device may have been let go of without being unplugged, so check everything again
+    if (atomic_exchange(&discovery_kick, false)) {
+        discovery_seen[0] = discovery_seen[1] = 0;
+        discovery_interval = DISCOVERY_MIN_INTERVAL_USEC;
+    }
+
     int items = sceUsbdGetDeviceList(&list);
     for (int i = 0; i < items; i++) {
-        cand_dev_addr = sceUsbdGetDeviceAddress(list[i]);
-        if (OIGHLGetDeviceByDeviceAddress(cand_dev_addr) == NULL) {
-            struct libusb_device_descriptor desc;
-            sceUsbdGetDeviceDescriptor(list[i], &desc);
-            if (desc.idVendor == 0x12BA && desc.idProduct == 0x074B) {
-                cand_type = GHL_Type_HID;
-                sceUsbdOpen(list[i], &candidate);
-                final_printf("Opened PS3 GHL guitar at bus %02x!\n");
-                break;
-            } else if (desc.idVendor == 0x1430 && desc.idProduct == 0x070B) {
-                cand_type = GHL_Type_XInput;
-                sceUsbdOpen(list[i], &candidate);
-                final_printf("Opened Xbox 360 GHL guitar at bus %02x!\n");
-                break;
-            }
-        }
+        uint8_t cand_dev_addr = sceUsbdGetDeviceAddress(list[i]) & 0x7F;
+        uint64_t bit = 1ULL << (cand_dev_addr & 0x3F);
+        present[cand_dev_addr >> 6] |= bit;
+        // only read descriptors for devices that weren't here last time
+        if ((discovery_seen[cand_dev_addr >> 6] & bit) != 0)
+            continue;
+        changed = true;
+
+        // only this thread adds candidates, so once an address isn't taken it stays that way
+        scePthreadMutexLock(&candidate_mutex);
+        bool taken = IsAddressTaken(cand_dev_addr) || candidate_count >= MAX_DEVICE_COUNT;
+        scePthreadMutexUnlock(&candidate_mutex);
+        if (taken)
+            continue;
+
+        OIDriverDescriptor desc;
+        if (!OIDriverDescribe(list[i], NULL, &desc))
+            continue;
+        const OIDriver *cand_driver = OIDriverIdentify(&desc, OI_FrontEnd_GHL);
+        libusb_device_handle *candidate = NULL;
+        if (cand_driver == NULL || sceUsbdOpen(list[i], &candidate) != 0 || candidate == NULL)
+            continue;
+        trace_printf("Opened GHL guitar (driver %i) at bus %02x!\n", cand_driver->id, cand_dev_addr);
+
+        scePthreadMutexLock(&candidate_mutex);
+        candidates[candidate_count].usbDevice = candidate;
+        candidates[candidate_count].driver = cand_driver;
+        candidates[candidate_count].deviceAddress = cand_dev_addr;
+        candidate_count++;
+        scePthreadMutexUnlock(&candidate_mutex);
     }
     sceUsbdFreeDeviceList(list);
-    if (candidate != NULL)
-    {
-        open_device->usbDevice = candidate;
-        open_device->type = cand_type;
-        open_device->deviceAddress = cand_dev_addr;
+
+    // let go of anything unplugged before a pad got to it
+    if (present[0] != discovery_seen[0] || present[1] != discovery_seen[1]) {
+        changed = true;
+        scePthreadMutexLock(&candidate_mutex);
+        for (int i = 0; i < candidate_count; i++) {
+            uint8_t addr = candidates[i].deviceAddress;
+            if ((present[addr >> 6] & (1ULL << (addr & 0x3F))) == 0) {
+                sceUsbdClose(candidates[i].usbDevice);
+                candidates[i--] = candidates[--candidate_count];
+            }
+        }
+        scePthreadMutexUnlock(&candidate_mutex);
     }
-    return candidate != NULL;
+    discovery_seen[0] = present[0];
+    discovery_seen[1] = present[1];
+
+    if (changed)
+        discovery_interval = DISCOVERY_MIN_INTERVAL_USEC;
+    else if (discovery_interval < DISCOVERY_MAX_INTERVAL_USEC)
+        discovery_interval *= 2;
+    discovery_next_time = sceKernelGetProcessTime() + discovery_interval;
+}
+
+static void CloseCandidates() {
+    scePthreadMutexLock(&candidate_mutex);
+    for (int i = 0; i < candidate_count; i++)
+        sceUsbdClose(candidates[i].usbDevice);
+    candidate_count = 0;
+    scePthreadMutexUnlock(&candidate_mutex);
 }
 
 HOOK_INIT(scePadOpenExt);
 int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param) {
     int r = HOOK_CONTINUE(scePadOpenExt, int(*)(int, int, int, OrbisPadExtParam *), userID, type, index, param);
     if (type == ORBIS_PAD_PORT_TYPE_SPECIAL && r >= 0) {
-        OIGHLOpenDevice *device = OIGHLGetDeviceByUserID(userID);
+        OIGHLOpenDevice *device = OIGHLClaimDeviceForUserID(userID);
         if (device != NULL) {
             device->scePadHandle = r;
+            OIRegistrySetKey(&device_registry, device - open_devices, OI_Registry_PadHandle, (uint32_t)r);
+            // there's a pad waiting for an instrument now, go and look for one
+            atomic_store(&discovery_kick, true);
+            WakeEventThread();
         } else {
             final_printf("Failed to get device handle for user ID %i!\n", userID);
         }
@@ -126,35 +280,215 @@ int scePadOpenExt_hook(int userID, int type, int index, OrbisPadExtParam *param)
     return r;
 }
 
-static uint8_t usb_rec_buf[2][27] = { 0 };
-static struct libusb_transfer *async;
+static void CancelDeviceTransfers(OIGHLOpenDevice *device, struct libusb_transfer *except) {
+    for (int i = 0; i < GHL_TRANSFERS_PER_DEVICE; i++) {
+        if (device->transfers[i].transfer != NULL && device->transfers[i].transfer != except)
+            sceUsbdCancelTransfer(device->transfers[i].transfer);
+    }
+    if (atomic_load(&device->outputInFlight) && device->output.transfer != except)
+        sceUsbdCancelTransfer(device->output.transfer);
+}
+
+// nothing of the device's can be in flight by now
+static void CloseDevice(OIGHLOpenDevice *device) {
+    for (int i = 0; i < GHL_TRANSFERS_PER_DEVICE; i++)
+        OITransferPoolRelease(&transfer_pool, &device->transfers[i]);
+    OITransferPoolRelease(&transfer_pool, &device->output);
+    OIRegistryClearKey(&device_registry, device - open_devices, OI_Registry_BusAddress);
+    sceUsbdClose(device->usbDevice);
+    device->usbDevice = NULL;
+    device->driver = NULL;
+    atomic_fetch_sub(&active_device_count, 1);
+    // it might still be plugged in, so it has to be picked up again by discovery
+    atomic_store(&discovery_kick, true);
+}
+
+// called as each transfer comes back for good, only closes the device once they all have
+static void ReleaseDeviceTransfer(OIGHLOpenDevice *device) {
+    if (atomic_fetch_sub(&device->transfersInFlight, 1) == 1)
+        CloseDevice(device);
+}
+
+// report timestamps are handed to the game in process time, the same as sceKernelGetProcessTime
+static OILatencyClock pad_clock;
+
+// only the bytes that actually arrived and fit in the transfer's buffer can be trusted
+static int ReceivedLength(struct libusb_transfer *transfer) {
+    return transfer->actual_length < transfer->length ? transfer->actual_length : transfer->length;
+}
+
 static void libusb_callback(struct libusb_transfer *transfer) {
-    if (transfer != NULL) {
-        if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-            sceUsbdFillInterruptTransfer(transfer, transfer->dev_handle, 0x81, transfer->buffer, 30, libusb_callback, transfer->user_data, 0);
-            sceUsbdSubmitTransfer(transfer);
-        } else {
-            final_printf("Transfer failed, disconnecting device!\n");
-            OIGHLOpenDevice *device = (OIGHLOpenDevice *)transfer->user_data;
-            if (device != NULL) {
-                sceUsbdClose(device->usbDevice);
-                device->usbDevice = NULL;
-                device->type = GHL_Type_None;
-            }
+    uint64_t completed = OILatencyNow();
+    OIGHLOpenDevice *device = (OIGHLOpenDevice *)transfer->user_data;
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED && !atomic_load(&device->closing)) {
+        const OIDriver *driver = device->driver;
+        int length = ReceivedLength(transfer);
+        OICaptureReport(driver->capture_source, device - open_devices, transfer->buffer, length, completed);
+        // only hand over input reports, 360 and Xbox One devices send other message types on this endpoint too
+        uint64_t time = OILatencyClockMicroseconds(&pad_clock, completed);
+        if (length > 0 && driver->decode(&device->driverState, transfer->buffer, length, time)) {
+            const OIDriverInput *input = &device->driverState.input;
+            OIPadState state = {
+                .buttons = input->translated,
+                .left_stick_y = input->strum,
+                .right_stick_x = input->tilt,
+                .right_stick_y = input->whammy,
+                .count = device->reportSequence++
+            };
+            OIReportBufferWrite(&device->reports, (const uint8_t *)&state, sizeof(state), completed);
+            OIPadHistoryWrite(&device->history, state, completed);
+            OILatencyRecord(&device->latency, OI_Latency_Parse, completed);
+        }
+        // the other transfers are still queued, so this one just goes to the back of the line
+        if (sceUsbdSubmitTransfer(transfer) == 0)
+            return;
+    }
+
+    // first failure cancels the rest of the ring, they'll come back through here
+    if (!atomic_exchange(&device->closing, true)) {
+        trace_printf("Transfer failed, disconnecting device!\n");
+        CancelDeviceTransfers(device, transfer);
+    }
+    ReleaseDeviceTransfer(device);
+}
+
+static bool StartDeviceTransfers(OIGHLOpenDevice *device) {
+    OIReportBufferInit(&device->reports);
+    OIPadHistoryInit(&device->history);
+    device->reportSequence = 0;
+    OIDriverStart(device->driver, &device->driverState);
+    atomic_store(&device->closing, false);
+    atomic_store(&device->keepaliveRequested, false);
+    atomic_store(&device->outputInFlight, false);
+    device->keepaliveLastSent = 0;
+    atomic_fetch_add(&active_device_count, 1);
+    // held until everything's been submitted, so a transfer failing straight away can't close the device under us
+    atomic_store(&device->transfersInFlight, 1);
+    if (device->driver->output != NULL)
+        OITransferPoolAcquire(&transfer_pool, &device->output);
+    int length = device->driver->report_size;
+    int submitted = 0;
+    for (int i = 0; i < GHL_TRANSFERS_PER_DEVICE && !atomic_load(&device->closing); i++) {
+        if (!OITransferPoolAcquire(&transfer_pool, &device->transfers[i]))
+            break;
+        sceUsbdFillInterruptTransfer(device->transfers[i].transfer, device->usbDevice, 0x81, device->transfers[i].buffer, length, libusb_callback, device, 0);
+        atomic_fetch_add(&device->transfersInFlight, 1);
+        if (sceUsbdSubmitTransfer(device->transfers[i].transfer) != 0) {
+            atomic_fetch_sub(&device->transfersInFlight, 1);
+            break;
+        }
+        submitted++;
+    }
+    if (submitted == 0) {
+        final_printf("Failed to submit any transfers!\n");
+        atomic_store(&device->transfersInFlight, 0);
+        CloseDevice(device);
+        WakeEventThread();
+        return false;
+    }
+    ReleaseDeviceTransfer(device);
+    WakeEventThread();
+    return true;
+}
+
+// cancels everything in flight, the event thread finishes closing the devices
+static void StopAllDeviceTransfers() {
+    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
+        OIGHLOpenDevice *device = &open_devices[i];
+        if (device->usbDevice == NULL || atomic_exchange(&device->closing, true))
+            continue;
+        CancelDeviceTransfers(device, NULL);
+    }
+}
+
+// PS3/Wii U and Xbox One dongles only need reminding every so often, the game asks far more than that
+#define GHL_KEEPALIVE_INTERVAL_USEC 1000000
+#define GHL_OUTPUT_TIMEOUT 100
+
+static void output_callback(struct libusb_transfer *transfer) {
+    OIGHLOpenDevice *device = (OIGHLOpenDevice *)transfer->user_data;
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED && transfer->status != LIBUSB_TRANSFER_CANCELLED)
+        trace_printf("Output to device failed with status %i\n", transfer->status);
+    atomic_store(&device->outputInFlight, false);
+    ReleaseDeviceTransfer(device);
+}
+
+// true if the game's asked for a keepalive and it's been long enough since the last one
+static bool KeepaliveDue(OIGHLOpenDevice *device, uint64_t now) {
+    if (!atomic_load(&device->keepaliveRequested))
+        return false;
+    return device->keepaliveLastSent == 0 || now - device->keepaliveLastSent >= GHL_KEEPALIVE_INTERVAL_USEC;
+}
+
+// sends whatever each device is owed next, at most one message in flight per device
+static void ServiceOutputs() {
+    uint64_t now = sceKernelGetProcessTime();
+    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
+        OIGHLOpenDevice *device = &open_devices[i];
+        if (atomic_load(&device->outputInFlight))
+            continue;
+        if (device->usbDevice == NULL || device->output.transfer == NULL || atomic_load(&device->closing))
+            continue;
+        const OIDriver *driver = device->driver;
+        bool due = KeepaliveDue(device, now);
+        bool keepalive = due;
+        int length = driver->output(&device->driverState, device->output.buffer, &keepalive);
+        if (due && !keepalive) {
+            atomic_store(&device->keepaliveRequested, false);
+            device->keepaliveLastSent = now;
+        }
+        if (length == 0)
+            continue;
+        if (driver->output_endpoint == 0)
+            sceUsbdFillControlTransfer(device->output.transfer, device->usbDevice, device->output.buffer, output_callback, device, GHL_OUTPUT_TIMEOUT);
+        else
+            sceUsbdFillInterruptTransfer(device->output.transfer, device->usbDevice, driver->output_endpoint, device->output.buffer,
+                length, output_callback, device, GHL_OUTPUT_TIMEOUT);
+
+        // counted with the interrupt transfers, so the device can't be closed out from under it
+        atomic_fetch_add(&device->transfersInFlight, 1);
+        atomic_store(&device->outputInFlight, true);
+        if (sceUsbdSubmitTransfer(device->output.transfer) != 0) {
+            atomic_store(&device->outputInFlight, false);
+            atomic_fetch_sub(&device->transfersInFlight, 1);
         }
     }
 }
 
-static void *scanThread(void *args) {
-    while (1) {
-        static int nothing[8] = { 0 }; // supposed to be a timeval or something
-        sceUsbdHandleEventsTimeout(nothing);
-        sceKernelUsleep(10);
+static void *eventThread(void *args) {
+    int drain_passes = 0;
+    while (!atomic_load(&event_thread_quit) || (atomic_load(&active_device_count) > 0 && drain_passes++ < USB_EVENT_DRAIN_PASSES)) {
+        bool wants_discovery = !atomic_load(&event_thread_quit) && WantsDiscovery();
+        if (wants_discovery && (atomic_load(&discovery_kick) || sceKernelGetProcessTime() >= discovery_next_time))
+            DiscoverDevices();
+        // with no devices open there's nothing for sceUsbd to deliver, so sleep until
+        // one gets opened, or until it's time to look for one again
+        if (atomic_load(&active_device_count) == 0) {
+            scePthreadMutexLock(&event_mutex);
+            // check again under the lock, so a wake from a pad being opened can't be missed
+            wants_discovery = !atomic_load(&event_thread_quit) && WantsDiscovery();
+            if (atomic_load(&active_device_count) == 0 && !atomic_load(&event_thread_quit) && !(wants_discovery && atomic_load(&discovery_kick))) {
+                if (wants_discovery) {
+                    uint64_t now = sceKernelGetProcessTime();
+                    if (now < discovery_next_time)
+                        scePthreadCondTimedwait(&event_cond, &event_mutex, (uint32_t)(discovery_next_time - now));
+                } else {
+                    scePthreadCondWait(&event_cond, &event_mutex);
+                }
+            }
+            scePthreadMutexUnlock(&event_mutex);
+            continue;
+        }
+        // blocks until a transfer completes (and its callback has run) or the timeout passes
+        struct timeval timeout = { 0, USB_EVENT_TIMEOUT_USEC };
+        sceUsbdHandleEventsTimeout(&timeout);
+        ServiceOutputs();
     }
     scePthreadExit(NULL);
     return NULL;
 }
 
+
 HOOK_INIT(scePadGetControllerInformation);
 int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info) {
     OIGHLOpenDevice *device = OIGHLGetDeviceByHandle(handle);
@@ -163,13 +497,9 @@ int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info) {
         return r;
         
     if (info->connected == 0 && device->usbDevice == NULL) {
-        if (SearchForNewDevices(device)) {
+        if (ClaimCandidate(device)) {
             final_printf("Found a device, starting transfers\n");
-            async = sceUsbdAllocTransfer(1);
-            async->buffer = device->reportBuffer;
-            async->dev_handle = device->usbDevice;
-            async->user_data = device;
-            libusb_callback(async);
+            StartDeviceTransfers(device);
         }
     }
 
@@ -183,90 +513,57 @@ int scePadGetControllerInformation_hook(int handle, OrbisPadInformation *info) {
     return 0;
 }
 
-static void ParseXInputToPadStruct(xinput_report_controls *report, OrbisPadData *pad) {
-    pad->buttons = 0;
-
-    // fret buttons
-    pad->buttons |= ((report->buttons2 & 0x10) != 0x00) ? ORBIS_PAD_BUTTON_CROSS : 0; // b1
-    pad->buttons |= ((report->buttons2 & 0x20) != 0x00) ? ORBIS_PAD_BUTTON_CIRCLE : 0; // b2
-    pad->buttons |= ((report->buttons2 & 0x80) != 0x00) ? ORBIS_PAD_BUTTON_TRIANGLE : 0; // b3
-    pad->buttons |= ((report->buttons2 & 0x40) != 0x00) ? ORBIS_PAD_BUTTON_SQUARE : 0; // w1
-    pad->buttons |= ((report->buttons2 & 0x01) != 0x00) ? ORBIS_PAD_BUTTON_L1 : 0; // w2
-    pad->buttons |= ((report->buttons2 & 0x02) != 0x00) ? ORBIS_PAD_BUTTON_R1 : 0; // w3
-
-    // strum bar, due to enable packet being required lets just use the dpad and lie
-    pad->leftStick.y = 0x80;
-    if (report->left_stick_y == 32767 || (report->buttons1 & 0x02) != 0x00)
-        pad->leftStick.y = 0xFF;
-    if (report->left_stick_y == -32768 || (report->buttons1 & 0x01) != 0x00)
-        pad->leftStick.y = 0x00;
-
-    // dpad (nav + strumming)
-    if ((report->buttons1 & 0x01) != 0x00)
-        pad->buttons |= ORBIS_PAD_BUTTON_UP;
-    if ((report->buttons1 & 0x04) != 0x00)
-        pad->buttons |= ORBIS_PAD_BUTTON_LEFT;
-    if ((report->buttons1 & 0x02) != 0x00)
-        pad->buttons |= ORBIS_PAD_BUTTON_DOWN;
-    if ((report->buttons1 & 0x08) != 0x00)
-        pad->buttons |= ORBIS_PAD_BUTTON_RIGHT;
-
-    // special buttons (start, ghtv)
-    pad->buttons |= ((report->buttons1 & 0x20) != 0x00) ? ORBIS_PAD_BUTTON_R3 : 0; // hero power/select button
-    pad->buttons |= ((report->buttons1 & 0x10) != 0x00) ? ORBIS_PAD_BUTTON_OPTIONS : 0; // pause/start button
-    pad->buttons |= ((report->buttons1 & 0x40) != 0x00) ? ORBIS_PAD_BUTTON_L3 : 0; // GHTV button
-
-    // whammy
-    pad->rightStick.y = (uint8_t)(report->right_stick_y / 0x100);
-    // tilt
-    pad->rightStick.x = (uint8_t)(report->right_stick_x / 0x100);
+// completed is when the report's transfer came back, so the game times the note and not our polling
+static void ApplyPadState(const OIPadState *state, uint64_t completed, OrbisPadData *pad) {
+    pad->buttons = state->buttons;
+    pad->leftStick.y = state->left_stick_y;
+    pad->rightStick.x = state->right_stick_x;
+    pad->rightStick.y = state->right_stick_y;
+    pad->count = state->count;
+    pad->timestamp = OILatencyClockMicroseconds(&pad_clock, completed);
 }
 
-static void ParseHIDToPadStruct(uint8_t *hid_report, OrbisPadData *pad) {
-    uint8_t frets = hid_report[0];
-    uint8_t buttons = hid_report[1];
-    uint8_t dpad = hid_report[2];
-    uint8_t strum = hid_report[4];
-    uint8_t whammy = hid_report[6];
-    uint8_t tilt = hid_report[19];
-    pad->buttons = 0;
-
-    // fret buttons
-    pad->buttons |= ((frets & 0x02) != 0x00) ? ORBIS_PAD_BUTTON_CROSS : 0; // b1
-    pad->buttons |= ((frets & 0x04) != 0x00) ? ORBIS_PAD_BUTTON_CIRCLE : 0; // b2
-    pad->buttons |= ((frets & 0x08) != 0x00) ? ORBIS_PAD_BUTTON_TRIANGLE : 0; // b3
-    pad->buttons |= ((frets & 0x01) != 0x00) ? ORBIS_PAD_BUTTON_SQUARE : 0; // w1
-    pad->buttons |= ((frets & 0x10) != 0x00) ? ORBIS_PAD_BUTTON_L1 : 0; // w2
-    pad->buttons |= ((frets & 0x20) != 0x00) ? ORBIS_PAD_BUTTON_R1 : 0; // w3
-
-    // strum bar
-    pad->leftStick.y = strum;
-
-    // dpad (nav + strumming)
-    if (dpad == 0x00)
-        pad->buttons |= ORBIS_PAD_BUTTON_UP;
-    if (dpad == 0x02)
-        pad->buttons |= ORBIS_PAD_BUTTON_LEFT;
-    if (dpad == 0x04)
-        pad->buttons |= ORBIS_PAD_BUTTON_DOWN;
-    if (dpad == 0x06)
-        pad->buttons |= ORBIS_PAD_BUTTON_RIGHT;
-
-    // special buttons (start, ghtv)
-    pad->buttons |= ((buttons & 0x01) != 0x00) ? ORBIS_PAD_BUTTON_R3 : 0; // hero power/select button
-    pad->buttons |= ((buttons & 0x02) != 0x00) ? ORBIS_PAD_BUTTON_OPTIONS : 0; // pause/start button
-    pad->buttons |= ((buttons & 0x04) != 0x00) ? ORBIS_PAD_BUTTON_L3 : 0; // GHTV button
-
-    pad->rightStick.y = whammy;
-    pad->rightStick.x = tilt;
+#define GHL_LATENCY_DUMP_CHORD (ORBIS_PAD_BUTTON_OPTIONS | ORBIS_PAD_BUTTON_R3 | ORBIS_PAD_BUTTON_L3)
+
+static void CheckDumpChord(OIGHLOpenDevice *device, const OrbisPadData *data) {
+    // holding start + hero power + GHTV dumps the latency stats to klog
+    bool chord = (data->buttons & GHL_LATENCY_DUMP_CHORD) == GHL_LATENCY_DUMP_CHORD;
+    if (chord && !device->dumpChordHeld) {
+        OILatencyLog("GHL", device - open_devices, &device->latency);
+        OITransferPoolLog(&transfer_pool, "GHL");
+    }
+    device->dumpChordHeld = chord;
+}
+
+// the pad's own state from scePadRead with the instrument's on top, false if it doesn't have one yet
+static bool ReadLatestState(OIGHLOpenDevice *device, OrbisPadData *data) {
+    if (device->driver == NULL)
+        return false;
+
+    // the read slot stays ours until the next read, the USB thread never writes to it
+    int length;
+    bool fresh;
+    uint64_t completed;
+    const uint8_t *slot = OIReportBufferRead(&device->reports, &length, &fresh, &completed);
+    // nothing's come in yet, so the pad keeps its own state
+    if (length == sizeof(OIPadState)) {
+        OIPadState state;
+        memcpy(&state, slot, sizeof(state));
+        ApplyPadState(&state, completed, data);
+    }
+    if (fresh)
+        OILatencyRecord(&device->latency, OI_Latency_Read, completed);
+    // the game's caught up, a batched read after this only wants what comes next
+    OIPadHistorySkip(&device->history);
+    CheckDumpChord(device, data);
+    return true;
 }
 
-int retry_cnt = 0;
-uint8_t count;
+HOOK_INIT(scePadRead);
 HOOK_INIT(scePadReadState);
 int scePadReadState_hook(int handle, OrbisPadData *data) {
     OIGHLOpenDevice *device = OIGHLGetDeviceByHandle(handle);
-    int r = scePadRead(handle, data, 1);
+    int r = HOOK_CONTINUE(scePadRead, int(*)(int, OrbisPadData *, int), handle, data, 1);
     if (device == NULL) // we arne't responsible for this at all, so ignore
         return 0;
     
@@ -276,16 +573,40 @@ int scePadReadState_hook(int handle, OrbisPadData *data) {
     if (device->usbDevice == NULL)
         return r;
 
-    data->count = count++;
+    return ReadLatestState(device, data) ? 0 : r;
+}
+
+// hands back every report since the last read in order, oldest first, so strums between frames aren't lost
+int scePadRead_hook(int handle, OrbisPadData *data, int num) {
+    OIGHLOpenDevice *device = OIGHLGetDeviceByHandle(handle);
+    if (device == NULL || data == NULL || num < 1)
+        return HOOK_CONTINUE(scePadRead, int(*)(int, OrbisPadData *, int), handle, data, num);
 
-    if (device->type == GHL_Type_HID)
-        ParseHIDToPadStruct(device->reportBuffer, data);
-    else if (device->type == GHL_Type_XInput) {
-        if (device->reportBuffer[0] == 0x00)
-            ParseXInputToPadStruct((xinput_report_controls *)device->reportBuffer, data);
-    } else
+    // only one state from the pad itself, everything past it is built from the history
+    int r = HOOK_CONTINUE(scePadRead, int(*)(int, OrbisPadData *, int), handle, data, 1);
+    if (data->connected == 0)
+        data->connected = 1;
+    if (device->usbDevice == NULL)
         return r;
-    return 0;
+    if (num == 1)
+        return ReadLatestState(device, data) ? 1 : r;
+
+    OIPadState states[OI_PAD_HISTORY_SIZE];
+    uint64_t completed[OI_PAD_HISTORY_SIZE];
+    int read = OIPadHistoryRead(&device->history, states, completed, num);
+    if (read == 0) // nothing new, the game still gets the current state
+        return ReadLatestState(device, data) ? 1 : r;
+
+    // keep the single-state path from counting the newest report a second time
+    OIReportBufferRead(&device->reports, NULL, NULL, NULL);
+    for (int i = 0; i < read; i++) {
+        if (i > 0)
+            data[i] = data[0];
+        ApplyPadState(&states[i], completed[i], &data[i]);
+        OILatencyRecord(&device->latency, OI_Latency_Read, completed[i]);
+    }
+    CheckDumpChord(device, &data[read - 1]);
+    return read;
 }
 
 
@@ -295,19 +616,24 @@ int scePadOutputReport_hook(int handle, int type, uint8_t *report, int length) {
     if (device == NULL || device->usbDevice == NULL) // if this isn't a device we're responsible for, ignore it
         return HOOK_CONTINUE(scePadOutputReport, int(*)(int, int, uint8_t *, int), handle, type, report, length);
 
-    if (device->type == GHL_Type_HID) {
-        // PS3/Wii U guitars require a constant keepalive packet to have strums work
-        // TODO: set the LED index in this packet
-        unsigned char keepalive[] = { 0x02, 0x08, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-        sceUsbdControlTransfer(device->usbDevice, 0x21, 0x09, 0x0201, 0x0000, keepalive, sizeof(keepalive), 6);
-    }
+    // the event thread sends it, so a slow dongle can't hold up the game's frame.
+    // the device could be closing under us, so the driver's only looked at once
+    const OIDriver *driver = device->driver;
+    if (driver != NULL && driver->output != NULL)
+        atomic_store(&device->keepaliveRequested, true);
     return 0;
 }
 
 void InitPadHooks() {
+    OIDriversInit();
+
     // make sure we have the USBD module loaded into memory
     sceSysmoduleLoadModule(ORBIS_SYSMODULE_USBD);
     sceUsbdInit();
+    if (!OITransferPoolInit(&transfer_pool, GHL_POOL_SIZE, "OrbisInstrumentGHLTransferPool"))
+        final_printf("Transfer pool came up short, some devices won't get every transfer\n");
+    OIRegistryInit(&device_registry, MAX_DEVICE_COUNT, "OrbisInstrumentGHLRegistry");
+    OILatencyClockInit(&pad_clock);
 
     // apply all the hooks to the pad library
     int pad = 0;
@@ -319,18 +645,47 @@ void InitPadHooks() {
     sys_dynlib_dlsym(pad, "scePadOutputReport", &scePadOutputReport);
     HOOK(scePadGetControllerInformation);
     HOOK(scePadReadState);
+    HOOK(scePadRead);
     HOOK(scePadOpenExt);
     HOOK(scePadOutputReport);
     
     // to try to be as fast as possible taking inputs, use async transfers and a thread
-    OrbisPthread thread;
-    scePthreadCreate(&thread, NULL, scanThread, NULL, "OrbisInstrumentGHLThread");
+    scePthreadMutexInit(&candidate_mutex, NULL, "OrbisInstrumentGHLCandidateMutex");
+    scePthreadMutexInit(&event_mutex, NULL, "OrbisInstrumentGHLMutex");
+    scePthreadCondInit(&event_cond, NULL, "OrbisInstrumentGHLCond");
+    atomic_store(&event_thread_quit, false);
+    scePthreadCreate(&event_thread, NULL, eventThread, NULL, "OrbisInstrumentGHLThread");
 }
 
 void DestroyPadHooks() {
     // unhook everything just in case
     UNHOOK(scePadGetControllerInformation);
     UNHOOK(scePadReadState);
+    UNHOOK(scePadRead);
     UNHOOK(scePadOpenExt);
     UNHOOK(scePadOutputReport);
+
+    // stop the event thread, it'll close the devices as their cancelled transfers come back
+    StopAllDeviceTransfers();
+    atomic_store(&event_thread_quit, true);
+    WakeEventThread();
+    scePthreadJoin(event_thread, NULL);
+    scePthreadCondDestroy(&event_cond);
+    scePthreadMutexDestroy(&event_mutex);
+    CloseCandidates();
+    scePthreadMutexDestroy(&candidate_mutex);
+    OIRegistryDestroy(&device_registry);
+    OITransferPoolLog(&transfer_pool, "GHL");
+    int leaked = OITransferPoolDestroy(&transfer_pool);
+    if (leaked != 0)
+        final_printf("GHL: %i transfers never came back and were leaked\n", leaked);
+
+    const OILatencyStats *latency[MAX_DEVICE_COUNT];
+    for (int i = 0; i < MAX_DEVICE_COUNT; i++)
+        latency[i] = &open_devices[i].latency;
+    OILatencyWriteFile(OI_LATENCY_FILE_PATH, latency, MAX_DEVICE_COUNT);
+    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
+        if (open_devices[i].history.dropped != 0)
+            final_printf("GHL device %i: %u states dropped before the game read them\n", i, open_devices[i].history.dropped);
+    }
 }
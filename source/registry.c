@@ -0,0 +1,140 @@
+/*
+    registry.c - OrbisInstrumentalizer
+    Device slot registry, indexed by the handles the game and sceUsbd know a device by.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OIRegistry.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+static void ClearBuckets(OIRegistry *registry, OIRegistryKey kind) {
+    for (int i = 0; i < OI_REGISTRY_BUCKETS; i++) {
+        atomic_store(&registry->buckets[kind][i].slot, -1);
+        atomic_store(&registry->buckets[kind][i].key, OI_REGISTRY_NO_KEY);
+    }
+}
+
+void OIRegistryInit(OIRegistry *registry, int capacity, const char *name) {
+    if (capacity > OI_REGISTRY_MAX_SLOTS) {
+        final_printf("%s wants %i device slots, only %i fit\n", name, capacity, OI_REGISTRY_MAX_SLOTS);
+        capacity = OI_REGISTRY_MAX_SLOTS;
+    }
+    registry->capacity = capacity;
+    scePthreadMutexInit(&registry->mutex, NULL, name);
+    for (int kind = 0; kind < OI_Registry_KeyCount; kind++) {
+        for (int i = 0; i < OI_REGISTRY_MAX_SLOTS; i++)
+            atomic_store(&registry->keys[kind][i], OI_REGISTRY_NO_KEY);
+        registry->live[kind] = 0;
+        ClearBuckets(registry, kind);
+    }
+    for (int i = 0; i < OI_REGISTRY_MAX_SLOTS; i++)
+        registry->used[i] = false;
+}
+
+void OIRegistryDestroy(OIRegistry *registry) {
+    scePthreadMutexDestroy(&registry->mutex);
+}
+
+static OIRegistryBucket *FindBucket(OIRegistry *registry, OIRegistryKey kind, uint64_t key) {
+    uint32_t index = OIRegistryHash(key);
+    for (int probes = 0; probes < OI_REGISTRY_BUCKETS; probes++) {
+        OIRegistryBucket *bucket = &registry->buckets[kind][index];
+        uint64_t bucket_key = atomic_load(&bucket->key);
+        if (bucket_key == OI_REGISTRY_NO_KEY)
+            return NULL;
+        if (bucket_key == key)
+            return bucket;
+        index = (index + 1) & (OI_REGISTRY_BUCKETS - 1);
+    }
+    return NULL;
+}
+
+// lock has to be held
+static void RemoveKey(OIRegistry *registry, OIRegistryKey kind, int slot) {
+    uint64_t key = atomic_load(&registry->keys[kind][slot]);
+    if (key == OI_REGISTRY_NO_KEY)
+        return;
+    atomic_store_explicit(&registry->keys[kind][slot], OI_REGISTRY_NO_KEY, memory_order_release);
+    OIRegistryBucket *bucket = FindBucket(registry, kind, key);
+    if (bucket != NULL) {
+        // a tombstone keeps the probe chain through here intact for other keys
+        atomic_store_explicit(&bucket->slot, -1, memory_order_release);
+        atomic_store_explicit(&bucket->key, OI_REGISTRY_TOMBSTONE, memory_order_release);
+    }
+    // nothing left to find, so all the tombstones can go
+    if (--registry->live[kind] == 0)
+        ClearBuckets(registry, kind);
+}
+
+// lock has to be held, and the key can't already be in the table
+static void InsertKey(OIRegistry *registry, OIRegistryKey kind, int slot, uint64_t key) {
+    uint32_t index = OIRegistryHash(key);
+    for (int probes = 0; probes < OI_REGISTRY_BUCKETS; probes++) {
+        OIRegistryBucket *bucket = &registry->buckets[kind][index];
+        uint64_t bucket_key = atomic_load(&bucket->key);
+        if (bucket_key == OI_REGISTRY_NO_KEY || bucket_key == OI_REGISTRY_TOMBSTONE) {
+            // the slot goes in before the key, so a lookup that finds the key finds the slot with it
+            atomic_store_explicit(&registry->keys[kind][slot], key, memory_order_release);
+            atomic_store_explicit(&bucket->slot, slot, memory_order_release);
+            atomic_store_explicit(&bucket->key, key, memory_order_release);
+            registry->live[kind]++;
+            return;
+        }
+        index = (index + 1) & (OI_REGISTRY_BUCKETS - 1);
+    }
+}
+
+int OIRegistryClaim(OIRegistry *registry) {
+    int slot = -1;
+    scePthreadMutexLock(&registry->mutex);
+    for (int i = 0; i < registry->capacity; i++) {
+        if (!registry->used[i]) {
+            registry->used[i] = true;
+            slot = i;
+            break;
+        }
+    }
+    scePthreadMutexUnlock(&registry->mutex);
+    return slot;
+}
+
+void OIRegistryRelease(OIRegistry *registry, int slot) {
+    if (slot < 0 || slot >= registry->capacity)
+        return;
+    scePthreadMutexLock(&registry->mutex);
+    for (int kind = 0; kind < OI_Registry_KeyCount; kind++)
+        RemoveKey(registry, kind, slot);
+    registry->used[slot] = false;
+    scePthreadMutexUnlock(&registry->mutex);
+}
+
+void OIRegistrySetKey(OIRegistry *registry, int slot, OIRegistryKey kind, uint64_t key) {
+    if (slot < 0 || slot >= registry->capacity || key == OI_REGISTRY_NO_KEY || key == OI_REGISTRY_TOMBSTONE)
+        return;
+    scePthreadMutexLock(&registry->mutex);
+    if (atomic_load(&registry->keys[kind][slot]) != key) {
+        RemoveKey(registry, kind, slot);
+        // handles get reused, whoever was given it most recently has it
+        OIRegistryBucket *bucket = FindBucket(registry, kind, key);
+        if (bucket != NULL)
+            RemoveKey(registry, kind, atomic_load(&bucket->slot));
+        InsertKey(registry, kind, slot, key);
+    }
+    scePthreadMutexUnlock(&registry->mutex);
+}
+
+void OIRegistryClearKey(OIRegistry *registry, int slot, OIRegistryKey kind) {
+    if (slot < 0 || slot >= registry->capacity)
+        return;
+    scePthreadMutexLock(&registry->mutex);
+    RemoveKey(registry, kind, slot);
+    scePthreadMutexUnlock(&registry->mutex);
+}
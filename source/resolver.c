@@ -0,0 +1,280 @@
+/*
+    resolver.c - OrbisInstrumentalizer
+    Finds a game's PLT stubs for library functions by scanning its loaded executable.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OIResolver.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+#define PROT_CPU_READ 0x01
+#define PROT_CPU_EXEC 0x04
+
+// FF 25 disp32 (jmp [rip+disp32]), 68 imm32 (push), E9 rel32 (jmp)
+#define PLT_JMP_0 0xFF
+#define PLT_JMP_1 0x25
+#define PLT_PUSH 0x68
+#define PLT_PUSH_OFFSET 6
+#define PLT_JMP_PLT0 0xE9
+#define PLT_JMP_PLT0_OFFSET 11
+
+bool OIResolverGetImage(int module, OIResolverImage *image) {
+    OrbisKernelModuleInfo info;
+    memset(&info, 0, sizeof(info));
+    info.size = sizeof(info);
+    int r = sceKernelGetModuleInfo(module, &info);
+    if (r != 0) {
+        final_printf("Failed to get module info for %i (%08x)\n", module, r);
+        return false;
+    }
+
+    memset(image, 0, sizeof(OIResolverImage));
+    image->base = UINTPTR_MAX;
+    for (uint32_t i = 0; i < info.segmentCount && i < 4; i++) {
+        OrbisKernelModuleSegmentInfo *segment = &info.segmentInfo[i];
+        if ((segment->prot & (PROT_CPU_READ | PROT_CPU_EXEC)) == 0)
+            continue;
+        image->segments[image->num_segments].address = segment->address;
+        image->segments[image->num_segments].size = segment->size;
+        image->segments[image->num_segments].executable = (segment->prot & PROT_CPU_EXEC) != 0;
+        image->num_segments++;
+        if ((uintptr_t)segment->address < image->base)
+            image->base = (uintptr_t)segment->address;
+    }
+    memcpy(image->fingerprint, info.fingerprint, sizeof(image->fingerprint));
+    return image->num_segments > 0;
+}
+
+static bool InImage(const OIResolverImage *image, uintptr_t address, size_t size, bool executable) {
+    for (int i = 0; i < image->num_segments; i++) {
+        uintptr_t start = (uintptr_t)image->segments[i].address;
+        if (executable && !image->segments[i].executable)
+            continue;
+        if (image->segments[i].size >= size && address >= start && address - start <= image->segments[i].size - size)
+            return true;
+    }
+    return false;
+}
+
+static bool IsStub(const uint8_t *stub) {
+    return stub[0] == PLT_JMP_0 && stub[1] == PLT_JMP_1 && stub[PLT_PUSH_OFFSET] == PLT_PUSH && stub[PLT_JMP_PLT0_OFFSET] == PLT_JMP_PLT0;
+}
+
+// where a PLT entry's GOT slot is, 0 if it doesn't look like one
+static uintptr_t StubSlot(const uint8_t *stub) {
+    if (!IsStub(stub))
+        return 0;
+    int32_t displacement;
+    memcpy(&displacement, stub + 2, sizeof(displacement));
+    uintptr_t slot = (uintptr_t)stub + PLT_PUSH_OFFSET + displacement;
+    return (slot & 7) == 0 ? slot : 0;
+}
+
+// what the GOT slot of a PLT entry holds, 0 if it doesn't look like one or the slot's outside the image
+static uintptr_t ReadStubSlot(const OIResolverImage *image, const uint8_t *stub) {
+    uintptr_t slot = StubSlot(stub);
+    if (slot == 0 || !InImage(image, slot, sizeof(uintptr_t), false))
+        return 0;
+    return *(const uintptr_t *)slot;
+}
+
+static int MatchFunction(uintptr_t function, const uint8_t *stub, OIResolverTarget *targets, int num_targets) {
+    int matched = 0;
+    for (int i = 0; i < num_targets; i++) {
+        if (targets[i].stub == 0 && targets[i].function == function) {
+            targets[i].stub = (uintptr_t)stub;
+            matched++;
+        }
+    }
+    return matched;
+}
+
+bool OIResolverCheckStub(const OIResolverImage *image, uintptr_t stub, uintptr_t function) {
+    if (function == 0 || !InImage(image, stub, OI_RESOLVER_PLT_ENTRY_SIZE, true))
+        return false;
+    return ReadStubSlot(image, (const uint8_t *)stub) == function;
+}
+
+// returns how many targets the candidate stub resolved
+static int MatchStub(const OIResolverImage *image, const uint8_t *stub, OIResolverTarget *targets, int num_targets) {
+    uintptr_t function = ReadStubSlot(image, stub);
+    if (function == 0)
+        return 0;
+    return MatchFunction(function, stub, targets, num_targets);
+}
+
+static int ScanSegment(const OIResolverImage *image, const uint8_t *start, size_t size, OIResolverTarget *targets, int num_targets, int remaining) {
+    if (size < OI_RESOLVER_PLT_ENTRY_SIZE)
+        return 0;
+    const uint8_t *end = start + size;
+    const uint8_t *p = start;
+    int found = 0;
+#ifdef __SSE2__
+    // test 16 positions at a time for all four fixed opcode bytes of an entry,
+    // the last load reads up to p + 26 so stop while a whole entry still fits after every position
+    const __m128i jmp_0 = _mm_set1_epi8((char)PLT_JMP_0);
+    const __m128i jmp_1 = _mm_set1_epi8((char)PLT_JMP_1);
+    const __m128i push = _mm_set1_epi8((char)PLT_PUSH);
+    const __m128i jmp_plt0 = _mm_set1_epi8((char)PLT_JMP_PLT0);
+    for (; end - p >= 16 + OI_RESOLVER_PLT_ENTRY_SIZE; p += 16) {
+        __m128i hits = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), jmp_0);
+        hits = _mm_and_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), jmp_1));
+        hits = _mm_and_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + PLT_PUSH_OFFSET)), push));
+        hits = _mm_and_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + PLT_JMP_PLT0_OFFSET)), jmp_plt0));
+        uint32_t mask = _mm_movemask_epi8(hits);
+        while (mask != 0) {
+            found += MatchStub(image, p + __builtin_ctz(mask), targets, num_targets);
+            if (found == remaining)
+                return found;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; end - p >= OI_RESOLVER_PLT_ENTRY_SIZE; p++) {
+        if (p[0] != PLT_JMP_0)
+            continue;
+        found += MatchStub(image, p, targets, num_targets);
+        if (found == remaining)
+            return found;
+    }
+    return found;
+}
+
+int OIResolverScan(const OIResolverImage *image, OIResolverTarget *targets, int num_targets) {
+    int remaining = 0;
+    for (int i = 0; i < num_targets; i++) {
+        targets[i].stub = 0;
+        if (targets[i].function != 0)
+            remaining++;
+    }
+    int found = 0;
+    for (int i = 0; i < image->num_segments && found < remaining; i++) {
+        if (image->segments[i].executable)
+            found += ScanSegment(image, image->segments[i].address, image->segments[i].size, targets, num_targets, remaining - found);
+    }
+    return found;
+}
+
+// the push index of a PLT entry, -1 if it doesn't look like one
+static int64_t StubIndex(const uint8_t *stub) {
+    if (!IsStub(stub))
+        return -1;
+    int32_t index;
+    memcpy(&index, stub + PLT_PUSH_OFFSET + 1, sizeof(index));
+    return index;
+}
+
+int OIResolverWalk(uintptr_t stub, OIResolverTarget *targets, int num_targets, int *unbound) {
+    for (int i = 0; i < num_targets; i++)
+        targets[i].stub = 0;
+    *unbound = 0;
+    const uint8_t *first = (const uint8_t *)stub;
+    int64_t index = StubIndex(first);
+    if (index < 0)
+        return 0;
+    // there's no image to check GOT slots against, so only entries numbered one after the other from stub
+    // are followed. PLT0 in front of the first one doesn't look like an entry
+    while (index > 0 && StubIndex(first - OI_RESOLVER_PLT_ENTRY_SIZE) == index - 1) {
+        first -= OI_RESOLVER_PLT_ENTRY_SIZE;
+        index--;
+    }
+    int found = 0;
+    for (const uint8_t *p = first; StubIndex(p) == index; p += OI_RESOLVER_PLT_ENTRY_SIZE, index++) {
+        uintptr_t slot = StubSlot(p);
+        if (slot == 0)
+            break;
+        uintptr_t function = *(const uintptr_t *)slot;
+        // until it's bound the slot points back at the entry's own push
+        if (function == (uintptr_t)p + PLT_PUSH_OFFSET)
+            (*unbound)++;
+        else
+            found += MatchFunction(function, p, targets, num_targets);
+    }
+    return found;
+}
+
+static bool LoadCache(const OIResolverImage *image, OIResolverTarget *targets, int num_targets, const char *cache_path) {
+    int fd = sceKernelOpen(cache_path, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    OIResolverCacheHeader header;
+    uint32_t offsets[OI_RESOLVER_MAX_TARGETS];
+    bool ok = sceKernelRead(fd, &header, sizeof(header)) == sizeof(header) &&
+        header.magic == OI_RESOLVER_CACHE_MAGIC && header.version == OI_RESOLVER_CACHE_VERSION &&
+        header.num_targets == (uint32_t)num_targets &&
+        memcmp(header.fingerprint, image->fingerprint, sizeof(header.fingerprint)) == 0 &&
+        sceKernelRead(fd, offsets, num_targets * sizeof(uint32_t)) == (ssize_t)(num_targets * sizeof(uint32_t));
+    sceKernelClose(fd);
+    if (!ok)
+        return false;
+    // don't trust it blindly, the same executable could've been loaded with different libraries.
+    // 0 is a target the scan didn't find, there's nothing to check for those
+    for (int i = 0; i < num_targets; i++) {
+        if (offsets[i] != 0 && !OIResolverCheckStub(image, image->base + offsets[i], targets[i].function))
+            return false;
+    }
+    for (int i = 0; i < num_targets; i++)
+        targets[i].stub = offsets[i] != 0 ? image->base + offsets[i] : 0;
+    return true;
+}
+
+static void SaveCache(const OIResolverImage *image, const OIResolverTarget *targets, int num_targets, const char *cache_path) {
+    OIResolverCacheHeader header = {
+        .magic = OI_RESOLVER_CACHE_MAGIC,
+        .version = OI_RESOLVER_CACHE_VERSION,
+        .num_targets = num_targets
+    };
+    memcpy(header.fingerprint, image->fingerprint, sizeof(header.fingerprint));
+    uint32_t offsets[OI_RESOLVER_MAX_TARGETS];
+    for (int i = 0; i < num_targets; i++)
+        offsets[i] = targets[i].stub != 0 ? targets[i].stub - image->base : 0;
+
+    int fd = sceKernelOpen(cache_path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (fd < 0) {
+        final_printf("Failed to open %s for the stub cache (%08x)\n", cache_path, fd);
+        return;
+    }
+    if (sceKernelWrite(fd, &header, sizeof(header)) != sizeof(header) ||
+        sceKernelWrite(fd, offsets, num_targets * sizeof(uint32_t)) != (ssize_t)(num_targets * sizeof(uint32_t)))
+        final_printf("Failed to write the stub cache\n");
+    sceKernelClose(fd);
+}
+
+int OIResolverResolve(const OIResolverImage *image, OIResolverTarget *targets, int num_targets, int num_required, const char *cache_path) {
+    if (num_targets > OI_RESOLVER_MAX_TARGETS)
+        return 0;
+    if (cache_path != NULL && LoadCache(image, targets, num_targets, cache_path)) {
+        int found = 0;
+        for (int i = 0; i < num_targets; i++)
+            found += targets[i].stub != 0;
+        final_printf("Found %i of %i stubs from the cache\n", found, num_targets);
+        return found;
+    }
+
+    uint64_t start = sceKernelGetProcessTime();
+    int found = OIResolverScan(image, targets, num_targets);
+    final_printf("Found %i of %i stubs in %luus\n", found, num_targets, sceKernelGetProcessTime() - start);
+    for (int i = 0; i < num_targets; i++) {
+        if (targets[i].stub == 0)
+            final_printf("Couldn't find a stub for %s\n", targets[i].name);
+    }
+    // the optional ones missing doesn't make the scan worth doing again next time
+    bool required_found = true;
+    for (int i = 0; i < num_required; i++)
+        required_found &= targets[i].stub != 0;
+    if (required_found && cache_path != NULL)
+        SaveCache(image, targets, num_targets, cache_path);
+    return found;
+}
@@ -0,0 +1,97 @@
+/*
+    transfer_pool.c - OrbisInstrumentalizer
+    Transfers and their buffers allocated once up front, lent to devices while they're connected.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <GoldHEN/Common.h>
+#include <orbis/libkernel.h>
+#include "OITransferPool.h"
+
+#define PLUGIN_NAME "OrbisInstrumentalizer"
+#define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
+
+bool OITransferPoolInit(OITransferPool *pool, int size, const char *name) {
+    if (size > OI_TRANSFER_POOL_MAX) {
+        final_printf("%s wants %i transfers, only %i fit\n", name, size, OI_TRANSFER_POOL_MAX);
+        size = OI_TRANSFER_POOL_MAX;
+    }
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    scePthreadMutexInit(&pool->mutex, NULL, name);
+    pool->free_count = 0;
+    for (int i = 0; i < size; i++) {
+        pool->transfers[i] = sceUsbdAllocTransfer(0);
+        if (pool->transfers[i] == NULL) {
+            final_printf("Only got %i of %i transfers for %s\n", i, size, name);
+            break;
+        }
+        pool->free_list[pool->free_count++] = i;
+    }
+    pool->stats.size = pool->free_count;
+    return pool->free_count == size;
+}
+
+int OITransferPoolDestroy(OITransferPool *pool) {
+    scePthreadMutexLock(&pool->mutex);
+    // anything still lent out could be in flight, so it's safer leaked than freed
+    for (int i = 0; i < pool->free_count; i++) {
+        sceUsbdFreeTransfer(pool->transfers[pool->free_list[i]]);
+        pool->transfers[pool->free_list[i]] = NULL;
+    }
+    pool->free_count = 0;
+    int leaked = pool->stats.in_use;
+    scePthreadMutexUnlock(&pool->mutex);
+    scePthreadMutexDestroy(&pool->mutex);
+    return leaked;
+}
+
+bool OITransferPoolAcquire(OITransferPool *pool, OIPooledTransfer *pooled) {
+    scePthreadMutexLock(&pool->mutex);
+    if (pool->free_count == 0) {
+        pool->stats.exhausted++;
+        scePthreadMutexUnlock(&pool->mutex);
+        pooled->transfer = NULL;
+        pooled->buffer = NULL;
+        pooled->index = -1;
+        return false;
+    }
+    int index = pool->free_list[--pool->free_count];
+    pool->stats.acquired++;
+    if (++pool->stats.in_use > pool->stats.peak)
+        pool->stats.peak = pool->stats.in_use;
+    scePthreadMutexUnlock(&pool->mutex);
+    pooled->transfer = pool->transfers[index];
+    pooled->buffer = pool->buffers[index];
+    pooled->index = index;
+    return true;
+}
+
+void OITransferPoolRelease(OITransferPool *pool, OIPooledTransfer *pooled) {
+    if (pooled->transfer == NULL)
+        return;
+    scePthreadMutexLock(&pool->mutex);
+    pool->free_list[pool->free_count++] = pooled->index;
+    pool->stats.released++;
+    pool->stats.in_use--;
+    scePthreadMutexUnlock(&pool->mutex);
+    pooled->transfer = NULL;
+    pooled->buffer = NULL;
+    pooled->index = -1;
+}
+
+void OITransferPoolGetStats(OITransferPool *pool, OITransferPoolStats *stats) {
+    scePthreadMutexLock(&pool->mutex);
+    *stats = pool->stats;
+    scePthreadMutexUnlock(&pool->mutex);
+}
+
+void OITransferPoolLog(OITransferPool *pool, const char *name) {
+    OITransferPoolStats stats;
+    OITransferPoolGetStats(pool, &stats);
+    final_printf("%s transfers: %i in use of %i (peak %i), %u lent, %u returned, %u times none were left\n",
+        name, stats.in_use, stats.size, stats.peak, stats.acquired, stats.released, stats.exhausted);
+}
@@ -0,0 +1,36 @@
+/*
+    translate.c - OrbisInstrumentalizer
+    Builds the lookup tables used to translate instrument reports.
+    Licensed under the GNU Lesser General Public License version 2.1, or later.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "OITranslate.h"
+
+static int GetSourceIndex(OITranslateTable *table, uint8_t offset) {
+    for (int i = 0; i < table->num_sources; i++) {
+        if (table->offsets[i] == offset)
+            return i;
+    }
+    if (table->num_sources >= OI_TRANSLATE_MAX_SOURCES)
+        return -1;
+    table->offsets[table->num_sources] = offset;
+    return table->num_sources++;
+}
+
+bool OITranslateCompile(OITranslateTable *table, const OITranslateMapping *mappings, int num_mappings) {
+    memset(table, 0, sizeof(OITranslateTable));
+    for (int i = 0; i < num_mappings; i++) {
+        int source = GetSourceIndex(table, mappings[i].offset);
+        if (source < 0)
+            return false;
+        for (int value = 0; value < 256; value++) {
+            if ((value & mappings[i].mask) == mappings[i].value)
+                table->lut[source][value] |= mappings[i].output;
+        }
+    }
+    return true;
+}
@@ -7,6 +7,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <string.h>
 
 #include <GoldHEN/Common.h>
 #include <orbis/Sysmodule.h>
@@ -14,98 +17,394 @@
 // uncomment when OpenOrbis merges #229
 //#include <orbis/Usbd.h>
 #include "OrbisUsbd.h"
+#include "OILatency.h"
+#include "OILog.h"
+#include "OICapture.h"
+#include "OIResolver.h"
+#include "OIRegistry.h"
+#include "OIDriver.h"
 #include "xinput.h"
 
 #define PLUGIN_NAME "OrbisInstrumentalizer"
 #define final_printf(a, args...) klog("[" PLUGIN_NAME "] " a, ##args)
 
-typedef enum _OIRB4DeviceType {
-    RB4_Type_None,
-    RB4_Type_XInputWireless,
-    RB4_Type_XInputGuitar,
-    RB4_Type_XInputDrums
-} OIRB4DeviceType;
-
 typedef struct _OIRB4OpenDevice {
-    bool is_open;
     libusb_device *device;
     libusb_device_handle *device_handle;
-    OIRB4DeviceType type;
-    uint8_t last_report[30];
+    libusb_device_handle *transfer_handle; // what its transfers are really filled with, the shared adapter handle for wireless slots
+    const OIDriver *driver;
+    libusb_transfer_cb_fn interrupt_callback; // the game's, called once the report's been rewritten
+    // the last good report's input stays in here, the wireless adapter's "nothing" packets repeat it.
+    // only touched by the transfer callbacks
+    OIDriverState driver_state;
+    OILatencyStats latency; // only written from the device's transfer callbacks
+    bool dump_chord_held;
 } OIRB4OpenDevice;
 
-#define MAX_DEVICE_COUNT 4
+#ifndef MAX_DEVICE_COUNT
+#define MAX_DEVICE_COUNT 8
+#endif
 static OIRB4OpenDevice open_devices[MAX_DEVICE_COUNT] = { 0 };
+// slots match open_devices, keyed by the device and the handle the game opened it with
+static OIRegistry device_registry;
 
 int(*TsceUsbdOpen)(int);
 int(*TsceUsbdClose)(int);
 int(*TsceUsbdGetConfigDescriptor)(int);
 int(*TsceUsbdGetDeviceDescriptor)(int);
 int(*TsceUsbdFillInterruptTransfer)(int);
+int(*TsceUsbdGetDeviceList)(int);
+int(*TsceUsbdFreeDeviceList)(int);
+int(*TsceUsbdClaimInterface)(int);
+int(*TsceUsbdReleaseInterface)(int);
 
 HOOK_INIT(TsceUsbdOpen);
 HOOK_INIT(TsceUsbdClose);
 HOOK_INIT(TsceUsbdGetConfigDescriptor);
 HOOK_INIT(TsceUsbdGetDeviceDescriptor);
 HOOK_INIT(TsceUsbdFillInterruptTransfer);
+HOOK_INIT(TsceUsbdGetDeviceList);
+HOOK_INIT(TsceUsbdFreeDeviceList);
+HOOK_INIT(TsceUsbdClaimInterface);
+HOOK_INIT(TsceUsbdReleaseInterface);
+
+typedef enum _OIRB4Stub {
+    RB4_Stub_Open,
+    RB4_Stub_Close,
+    RB4_Stub_GetConfigDescriptor,
+    RB4_Stub_GetDeviceDescriptor,
+    RB4_Stub_FillInterruptTransfer,
+    RB4_Stub_RequiredCount,
+    // only needed to split up the wireless adapter's slots, the plugin works without them
+    RB4_Stub_GetDeviceList = RB4_Stub_RequiredCount,
+    RB4_Stub_FreeDeviceList,
+    RB4_Stub_ClaimInterface,
+    RB4_Stub_ReleaseInterface,
+    // anything else that takes a device or handle would be given a wireless slot's made up one as it is,
+    // so the slots are only shown to a game that's been seen not to import any of these
+    RB4_Stub_Untranslated,
+    RB4_Stub_RefDevice = RB4_Stub_Untranslated,
+    RB4_Stub_UnrefDevice,
+    RB4_Stub_GetBusNumber,
+    RB4_Stub_GetDeviceAddress,
+    RB4_Stub_GetPortNumbers,
+    RB4_Stub_GetMaxPacketSize,
+    RB4_Stub_GetMaxIsoPacketSize,
+    RB4_Stub_GetDeviceSpeed,
+    RB4_Stub_GetActiveConfigDescriptor,
+    RB4_Stub_GetConfigDescriptorByValue,
+    RB4_Stub_GetDevice,
+    RB4_Stub_GetConfiguration,
+    RB4_Stub_SetConfiguration,
+    RB4_Stub_ResetDevice,
+    RB4_Stub_CheckConnected,
+    RB4_Stub_GetDescriptor,
+    RB4_Stub_GetStringDescriptor,
+    RB4_Stub_GetStringDescriptorAscii,
+    RB4_Stub_SetInterfaceAltSetting,
+    RB4_Stub_ClearHalt,
+    RB4_Stub_KernelDriverActive,
+    RB4_Stub_AttachKernelDriver,
+    RB4_Stub_DetachKernelDriver,
+    RB4_Stub_ControlTransfer,
+    RB4_Stub_BulkTransfer,
+    RB4_Stub_InterruptTransfer,
+    RB4_Stub_FillControlTransfer,
+    RB4_Stub_FillBulkTransfer,
+    RB4_Stub_FillIsoTransfer,
+    RB4_Stub_Count
+} OIRB4Stub;
+
+static OIResolverTarget usbd_stubs[RB4_Stub_Count] = {
+    [RB4_Stub_Open] = { "sceUsbdOpen" },
+    [RB4_Stub_Close] = { "sceUsbdClose" },
+    [RB4_Stub_GetConfigDescriptor] = { "sceUsbdGetConfigDescriptor" },
+    [RB4_Stub_GetDeviceDescriptor] = { "sceUsbdGetDeviceDescriptor" },
+    [RB4_Stub_FillInterruptTransfer] = { "sceUsbdFillInterruptTransfer" },
+    [RB4_Stub_GetDeviceList] = { "sceUsbdGetDeviceList" },
+    [RB4_Stub_FreeDeviceList] = { "sceUsbdFreeDeviceList" },
+    [RB4_Stub_ClaimInterface] = { "sceUsbdClaimInterface" },
+    [RB4_Stub_ReleaseInterface] = { "sceUsbdReleaseInterface" },
+    [RB4_Stub_RefDevice] = { "sceUsbdRefDevice" },
+    [RB4_Stub_UnrefDevice] = { "sceUsbdUnrefDevice" },
+    [RB4_Stub_GetBusNumber] = { "sceUsbdGetBusNumber" },
+    [RB4_Stub_GetDeviceAddress] = { "sceUsbdGetDeviceAddress" },
+    [RB4_Stub_GetPortNumbers] = { "sceUsbdGetPortNumbers" },
+    [RB4_Stub_GetMaxPacketSize] = { "sceUsbdGetMaxPacketSize" },
+    [RB4_Stub_GetMaxIsoPacketSize] = { "sceUsbdGetMaxIsoPacketSize" },
+    [RB4_Stub_GetDeviceSpeed] = { "sceUsbdGetDeviceSpeed" },
+    [RB4_Stub_GetActiveConfigDescriptor] = { "sceUsbdGetActiveConfigDescriptor" },
+    [RB4_Stub_GetConfigDescriptorByValue] = { "sceUsbdGetConfigDescriptorByValue" },
+    [RB4_Stub_GetDevice] = { "sceUsbdGetDevice" },
+    [RB4_Stub_GetConfiguration] = { "sceUsbdGetConfiguration" },
+    [RB4_Stub_SetConfiguration] = { "sceUsbdSetConfiguration" },
+    [RB4_Stub_ResetDevice] = { "sceUsbdResetDevice" },
+    [RB4_Stub_CheckConnected] = { "sceUsbdCheckConnected" },
+    [RB4_Stub_GetDescriptor] = { "sceUsbdGetDescriptor" },
+    [RB4_Stub_GetStringDescriptor] = { "sceUsbdGetStringDescriptor" },
+    [RB4_Stub_GetStringDescriptorAscii] = { "sceUsbdGetStringDescriptorAscii" },
+    [RB4_Stub_SetInterfaceAltSetting] = { "sceUsbdSetInterfaceAltSetting" },
+    [RB4_Stub_ClearHalt] = { "sceUsbdClearHalt" },
+    [RB4_Stub_KernelDriverActive] = { "sceUsbdKernelDriverActive" },
+    [RB4_Stub_AttachKernelDriver] = { "sceUsbdAttachKernelDriver" },
+    [RB4_Stub_DetachKernelDriver] = { "sceUsbdDetachKernelDriver" },
+    [RB4_Stub_ControlTransfer] = { "sceUsbdControlTransfer" },
+    [RB4_Stub_BulkTransfer] = { "sceUsbdBulkTransfer" },
+    [RB4_Stub_InterruptTransfer] = { "sceUsbdInterruptTransfer" },
+    [RB4_Stub_FillControlTransfer] = { "sceUsbdFillControlTransfer" },
+    [RB4_Stub_FillBulkTransfer] = { "sceUsbdFillBulkTransfer" },
+    [RB4_Stub_FillIsoTransfer] = { "sceUsbdFillIsoTransfer" },
+};
+
+_Static_assert(RB4_Stub_Count <= OI_RESOLVER_MAX_TARGETS, "more sceUsbd stubs than the resolver takes");
+
+// where the stubs are in version 02.21, for when the game's GOT can't be matched up.
+// the rest are found by walking the PLT these are in
+static const uint32_t usbd_stub_offsets_0221[RB4_Stub_RequiredCount] = {
+    [RB4_Stub_Open] = 0x01245260,
+    [RB4_Stub_Close] = 0x01245160,
+    [RB4_Stub_GetConfigDescriptor] = 0x012451e0,
+    [RB4_Stub_GetDeviceDescriptor] = 0x01245210,
+    [RB4_Stub_FillInterruptTransfer] = 0x01245190,
+};
 
 static OIRB4OpenDevice *GetOpenDeviceFromDevice(libusb_device *device) {
-    //final_printf("GetOpenDeviceFromDevice\n");
-    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
-        if (open_devices[i].device == device) {
-            return &open_devices[i];
-        } else if (open_devices[i].is_open == false) {
-            open_devices[i].is_open = true;
-            open_devices[i].device = device;
-            return &open_devices[i];
+    int slot = OIRegistryLookup(&device_registry, OI_Registry_USBDevice, (uintptr_t)device);
+    return slot >= 0 ? &open_devices[slot] : NULL;
+}
+
+// the slot the device already has, or a fresh one for it
+static OIRB4OpenDevice *ClaimOpenDevice(libusb_device *device) {
+    OIRB4OpenDevice *opendevice = GetOpenDeviceFromDevice(device);
+    if (opendevice != NULL)
+        return opendevice;
+    int slot = OIRegistryClaim(&device_registry);
+    if (slot < 0) {
+        final_printf("No free device slots, ignoring the instrument\n");
+        return NULL;
+    }
+    opendevice = &open_devices[slot];
+    opendevice->device = device;
+    OIRegistrySetKey(&device_registry, slot, OI_Registry_USBDevice, (uintptr_t)device);
+    return opendevice;
+}
+
+static void SetOpenDeviceHandle(OIRB4OpenDevice *opendevice, libusb_device_handle *device_handle) {
+    opendevice->device_handle = device_handle;
+    OIRegistrySetKey(&device_registry, opendevice - open_devices, OI_Registry_USBHandle, (uintptr_t)device_handle);
+}
+
+static OIRB4OpenDevice *GetOpenDeviceFromDeviceHandle(libusb_device_handle *device_handle) {
+    int slot = OIRegistryLookup(&device_registry, OI_Registry_USBHandle, (uintptr_t)device_handle);
+    return slot >= 0 ? &open_devices[slot] : NULL;
+}
+
+// the 360 wireless adapter, see below
+#define RB4_WIRELESS_SLOTS 4
+
+// RB4 re-reads descriptors for every device whenever it scans the bus, so remember
+// which driver each device identified as and the descriptor we handed back for it
+typedef struct _OIRB4DescriptorCacheEntry {
+    libusb_device *device;
+    uint16_t bus_address; // bus number << 8 | device address, in case the device pointer gets reused
+    const OIDriver *driver; // NULL if none of them wanted it
+    struct libusb_device_descriptor desc; // with the VID/PID already rewritten
+    uint8_t wireless_subtypes[RB4_WIRELESS_SLOTS]; // wireless adapters only, what was on each slot when it was identified
+} OIRB4DescriptorCacheEntry;
+
+#define DESCRIPTOR_CACHE_SIZE 16
+static OIRB4DescriptorCacheEntry descriptor_cache[DESCRIPTOR_CACHE_SIZE] = { 0 };
+static int descriptor_cache_next = 0;
+static uint32_t descriptor_cache_hits = 0;
+static uint32_t descriptor_cache_misses = 0;
+
+static uint16_t GetBusAddress(libusb_device *device) {
+    return (sceUsbdGetBusNumber(device) << 8) | sceUsbdGetDeviceAddress(device);
+}
+
+// for the plugin's own lookups, which shouldn't count towards the hit rate
+static OIRB4DescriptorCacheEntry *LookupCachedDescriptor(libusb_device *device) {
+    uint16_t bus_address = GetBusAddress(device);
+    for (int i = 0; i < DESCRIPTOR_CACHE_SIZE; i++) {
+        if (descriptor_cache[i].device == device && descriptor_cache[i].bus_address == bus_address)
+            return &descriptor_cache[i];
+    }
+    return NULL;
+}
+
+// for the game's sceUsbdGetDeviceDescriptor calls, counted so the hit rate says how much of its traffic is saved
+static OIRB4DescriptorCacheEntry *GetCachedDescriptor(libusb_device *device) {
+    OIRB4DescriptorCacheEntry *cached = LookupCachedDescriptor(device);
+    if (cached != NULL)
+        descriptor_cache_hits++;
+    else
+        descriptor_cache_misses++;
+    return cached;
+}
+
+static void CacheDescriptor(libusb_device *device, const OIDriver *driver, struct libusb_device_descriptor *desc, const uint8_t wireless_subtypes[RB4_WIRELESS_SLOTS]) {
+    // oldest entry gets replaced once the cache is full
+    OIRB4DescriptorCacheEntry *entry = &descriptor_cache[descriptor_cache_next];
+    descriptor_cache_next = (descriptor_cache_next + 1) % DESCRIPTOR_CACHE_SIZE;
+    entry->device = device;
+    entry->bus_address = GetBusAddress(device);
+    entry->driver = driver;
+    entry->desc = *desc;
+    memcpy(entry->wireless_subtypes, wireless_subtypes, RB4_WIRELESS_SLOTS);
+}
+
+static void InvalidateCachedDescriptor(libusb_device *device) {
+    for (int i = 0; i < DESCRIPTOR_CACHE_SIZE; i++) {
+        if (descriptor_cache[i].device == device)
+            descriptor_cache[i].device = NULL;
+    }
+}
+
+// The 360 wireless adapter is one USB device with a pair of interfaces for each of its 4 slots.
+// The game only ever talks to the first, so every other slot is handed to it as a device of its own.
+// Their libusb_device and libusb_device_handle pointers are just addresses in here, and get mapped
+// back onto the adapter's interfaces and endpoints whenever the game uses them.
+// Each slot is shown as whatever instrument was on it when the adapter was identified
+#define MAX_WIRELESS_ADAPTERS 2
+#define MAX_LISTED_DEVICES 64
+
+typedef struct _OIRB4WirelessAdapter OIRB4WirelessAdapter;
+
+typedef struct _OIRB4WirelessSlot {
+    uint8_t device_token; // its address is the slot's libusb_device
+    uint8_t handle_token; // and its libusb_device_handle
+    OIRB4WirelessAdapter *adapter;
+    int index; // 1 to 3, slot 0 is the adapter itself
+    uint8_t xinput_subtype; // of the controller on it, 0 if nothing answered
+    bool open;
+} OIRB4WirelessSlot;
+
+struct _OIRB4WirelessAdapter {
+    libusb_device *device; // NULL if unused
+    libusb_device_handle *handle; // our own, shared by every slot the game has open
+    int open_slots;
+    OIRB4WirelessSlot slots[RB4_WIRELESS_SLOTS - 1];
+};
+
+static bool wireless_slots_enabled = false;
+static OIRB4WirelessAdapter wireless_adapters[MAX_WIRELESS_ADAPTERS] = { 0 };
+
+// device lists that have had slots added, and the ones from the library they were made from.
+// an entry's taken by swapping its original in, so two threads listing devices at once never share one
+#define MAX_EXTENDED_LISTS 2
+static struct {
+    _Atomic(libusb_device **) original; // NULL if the entry's free
+    libusb_device *devices[MAX_LISTED_DEVICES + 1];
+} extended_lists[MAX_EXTENDED_LISTS] = { 0 };
+
+static bool IsWirelessSlotPointer(const void *pointer) {
+    return (const uint8_t *)pointer >= (const uint8_t *)wireless_adapters &&
+        (const uint8_t *)pointer < (const uint8_t *)wireless_adapters + sizeof(wireless_adapters);
+}
+
+static OIRB4WirelessSlot *GetWirelessSlotFromDevice(libusb_device *device) {
+    if (!IsWirelessSlotPointer(device))
+        return NULL;
+    for (int i = 0; i < MAX_WIRELESS_ADAPTERS; i++) {
+        for (int j = 0; j < RB4_WIRELESS_SLOTS - 1; j++) {
+            if ((libusb_device *)&wireless_adapters[i].slots[j].device_token == device)
+                return &wireless_adapters[i].slots[j];
         }
     }
     return NULL;
 }
 
-static OIRB4OpenDevice *GetOpenDeviceFromDeviceHandle(libusb_device_handle *device_handle) {
-    //final_printf("GetOpenDeviceFromDeviceHandle\n");
-    for (int i = 0; i < MAX_DEVICE_COUNT; i++) {
-        if (open_devices[i].is_open && open_devices[i].device_handle == device_handle)
-            return &open_devices[i];
+static OIRB4WirelessSlot *GetWirelessSlotFromDeviceHandle(libusb_device_handle *device_handle) {
+    if (!IsWirelessSlotPointer(device_handle))
+        return NULL;
+    for (int i = 0; i < MAX_WIRELESS_ADAPTERS; i++) {
+        for (int j = 0; j < RB4_WIRELESS_SLOTS - 1; j++) {
+            if ((libusb_device_handle *)&wireless_adapters[i].slots[j].handle_token == device_handle)
+                return &wireless_adapters[i].slots[j];
+        }
     }
     return NULL;
 }
 
-static OIRB4DeviceType IdentifyDevice(libusb_device *device) {
-    //final_printf("IdentifyDevice\n");
-    struct libusb_device_descriptor *desc;
-    struct libusb_config_descriptor *config;
-    int r = 0;
-    int type = RB4_Type_None;
-    r = sceUsbdGetConfigDescriptor(device, 0, &config);
-    if (r == 0) {
-        // the xinput devices have a class of 0xFF and subclass of 0x5D
-        // just in case whatever we messed with breaks, use subclass rather than class
-        if (config->interface[0].altsetting->bInterfaceSubClass == 0x5D) {
-            if (config->interface[0].altsetting->extra != NULL && config->interface[0].altsetting->extra_length > 6) {
-                // controller subtype is at the 5th byte
-                uint8_t subtype = config->interface[0].altsetting->extra[4];
-                if (subtype == XINPUT_SUBTYPE_GUITAR ||
-                    subtype == XINPUT_SUBTYPE_GUITAR_ALTERNATE ||
-                    subtype == XINPUT_SUBTYPE_GUITAR_BASS) {
-                    type = RB4_Type_XInputGuitar;
-                } else if (subtype == XINPUT_SUBTYPE_DRUM_KIT ||
-                           subtype == XINPUT_SUBTYPE_GAMEPAD) { // (for testing purposes)
-                    type = RB4_Type_XInputDrums;
-                } else {
-                    // if we're not a known subtype, assume that we're a wireless dongle (mine has 0x13 at this position)
-                    type = RB4_Type_XInputWireless;
+// a slot's reports all come through the adapter, its subtype only says which driver decodes them
+static const OIDriver *WirelessSlotDriver(uint8_t xinput_subtype) {
+    return &oi_drivers[xinput_subtype == XINPUT_SUBTYPE_DRUM_KIT ? OI_Driver_XInputWirelessDrums : OI_Driver_XInputWireless];
+}
+
+static bool IsWirelessAdapterDriver(const OIDriver *driver) {
+    return driver == &oi_drivers[OI_Driver_XInputWireless] || driver == &oi_drivers[OI_Driver_XInputWirelessDrums];
+}
+
+#define WIRELESS_PROBE_TIMEOUT_MS 20
+// a slot with a controller on it might still be sending input in front of the announce
+#define WIRELESS_PROBE_MAX_READS 8
+
+// asks the adapter what's on each of its slots, anything that doesn't say is left as 0
+static void ProbeWirelessAdapter(libusb_device *device, uint8_t subtypes[RB4_WIRELESS_SLOTS]) {
+    memset(subtypes, 0, RB4_WIRELESS_SLOTS);
+    libusb_device_handle *handle;
+    if (sceUsbdOpen(device, &handle) != 0)
+        return;
+    for (int i = 0; i < RB4_WIRELESS_SLOTS; i++) {
+        // slot i's interfaces and endpoints come after the ones of the slots before it, two each
+        if (sceUsbdClaimInterface(handle, i * 2) != 0)
+            continue;
+        uint8_t inquiry[XINPUT_WIRELESS_INQUIRY_LENGTH] = XINPUT_WIRELESS_INQUIRY;
+        int transferred;
+        if (sceUsbdInterruptTransfer(handle, 0x01 + i * 2, inquiry, sizeof(inquiry), &transferred, WIRELESS_PROBE_TIMEOUT_MS) == 0) {
+            for (int reads = 0; reads < WIRELESS_PROBE_MAX_READS; reads++) {
+                uint8_t report[OI_DRIVER_REPORT_MAX];
+                if (sceUsbdInterruptTransfer(handle, 0x81 + i * 2, report, sizeof(report), &transferred, WIRELESS_PROBE_TIMEOUT_MS) != 0)
+                    break;
+                if (transferred >= 2 && report[0] == XINPUT_WIRELESS_LINK && (report[1] & XINPUT_WIRELESS_LINK_CONTROLLER) == 0)
+                    break;
+                if (transferred > XINPUT_WIRELESS_ANNOUNCE_SUBTYPE && report[0] == 0x00 && report[1] == XINPUT_WIRELESS_ANNOUNCE) {
+                    subtypes[i] = report[XINPUT_WIRELESS_ANNOUNCE_SUBTYPE];
+                    break;
                 }
             }
         }
+        sceUsbdReleaseInterface(handle, i * 2);
     }
-    sceUsbdFreeConfigDescriptor(config);
-    return type;
+    sceUsbdClose(handle);
+}
+
+// present is which adapters are in the device list being handed out, they're never given to another device.
+// subtypes are from when the adapter was identified, its slots keep them for as long as it's plugged in
+static OIRB4WirelessAdapter *GetWirelessAdapter(libusb_device *device, const uint8_t subtypes[RB4_WIRELESS_SLOTS], bool present[MAX_WIRELESS_ADAPTERS]) {
+    OIRB4WirelessAdapter *unused = NULL;
+    for (int i = 0; i < MAX_WIRELESS_ADAPTERS; i++) {
+        if (wireless_adapters[i].device == device)
+            return &wireless_adapters[i];
+        // adapters that have gone away and have nothing open can be reused
+        if (unused == NULL && !present[i] && wireless_adapters[i].open_slots == 0)
+            unused = &wireless_adapters[i];
+    }
+    if (unused == NULL)
+        return NULL;
+    present[unused - wireless_adapters] = true;
+    unused->device = device;
+    unused->handle = NULL;
+    for (int j = 0; j < RB4_WIRELESS_SLOTS - 1; j++) {
+        unused->slots[j].adapter = unused;
+        unused->slots[j].index = j + 1;
+        unused->slots[j].xinput_subtype = subtypes[j + 1];
+        unused->slots[j].open = false;
+    }
+    return unused;
+}
+
+// each slot has the same layout as slot 0, shifted along by one interface pair
+static int WirelessSlotInterface(OIRB4WirelessSlot *slot, int interface_number) {
+    return slot->index * 2 + interface_number;
+}
+
+static unsigned char WirelessSlotEndpoint(OIRB4WirelessSlot *slot, unsigned char endpoint) {
+    return endpoint + slot->index * 2;
 }
 
 #define BIT(i) (1 << i)
-// TODO: this seems bad i dont even know if it do drum
+// drums use the same report, with velocities where a guitar has nothing
 typedef struct _ps3_rb_guitar_report {
     uint16_t buttons;
     uint8_t hat;
@@ -113,98 +412,213 @@ typedef struct _ps3_rb_guitar_report {
     uint8_t left_joy_y;
     uint8_t whammy;
     uint8_t mode_switch;
-    uint8_t padding[12];
+    uint8_t padding[4];
+    uint8_t velocity[OI_Drum_Count]; // (drums) in OIDrumPad order
+    uint8_t padding_2[4];
     uint8_t accel_x;
     uint8_t unk_1;
     uint16_t accel_z;
     uint8_t accel_y;
     uint8_t unk_2;
     uint16_t gyro;
-} ps3_rb_guitar_report;
-libusb_transfer_cb_fn interrupt_callback;
-void ParseXInputCallback(struct libusb_transfer *transfer) {
-    //final_printf("ParseXInputCallback\n");
+} __attribute__((packed)) ps3_rb_guitar_report;
+_Static_assert(sizeof(ps3_rb_guitar_report) == 27, "PS3 instrument reports are 27 bytes");
+
+// the hat value lives above the button bits in the translated word
+#define RB4_HAT_SHIFT 16
+
+// holding back + start dumps the latency stats to klog
+#define RB4_LATENCY_DUMP_CHORD (BIT(8) | BIT(9))
+
+// only the bytes that actually arrived and fit in the game's buffer can be trusted
+static int ReceivedLength(struct libusb_transfer *transfer) {
+    return transfer->actual_length < transfer->length ? transfer->actual_length : transfer->length;
+}
+
+// filter timing, set up once the hooks go in
+static OILatencyClock analog_clock;
+
+// writes the PS3 report straight over whatever came in, anything past it is zeroed
+static void WritePS3Report(uint8_t *buffer, int length, const OIDriverInput *input) {
+    ps3_rb_guitar_report report = {
+        .buttons = (uint16_t)input->translated,
+        .hat = (uint8_t)(input->translated >> RB4_HAT_SHIFT),
+        .whammy = input->whammy,
+        .velocity = { input->velocity[0], input->velocity[1], input->velocity[2], input->velocity[3] },
+        .accel_x = input->tilt
+    };
+    if (length >= (int)sizeof(ps3_rb_guitar_report)) {
+        *(ps3_rb_guitar_report *)buffer = report;
+        memset(buffer + sizeof(ps3_rb_guitar_report), 0, length - sizeof(ps3_rb_guitar_report));
+    } else if (length > 0) {
+        memcpy(buffer, &report, length);
+    }
+}
+
+// decodes the report with the device's driver, then hands the game what it decoded to
+static void Parse(OIRB4OpenDevice *device, struct libusb_transfer *transfer, uint64_t completed) {
+    trace_printf("Parse\n");
+    const OIDriverInput *input = &device->driver_state.input;
     if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-        ps3_rb_guitar_report parsed_report = { 0 };
-        xinput_report_controls *xparsed = (xinput_report_controls *)transfer->buffer;
-        
-        // fret buttons (todo: make sure this is right for drums)
-        if ((xparsed->buttons2 & XINPUT_BUTTON_A) != 0) parsed_report.buttons |= BIT(1); // green
-        if ((xparsed->buttons2 & XINPUT_BUTTON_B) != 0) parsed_report.buttons |= BIT(2); // red
-        if ((xparsed->buttons2 & XINPUT_BUTTON_Y) != 0) parsed_report.buttons |= BIT(3); // yellow
-        if ((xparsed->buttons2 & XINPUT_BUTTON_X) != 0) parsed_report.buttons |= BIT(0); // blue
-        if ((xparsed->buttons2 & XINPUT_BUTTON_LB) != 0) parsed_report.buttons |= BIT(4); // orange / (drums) kick
-        if ((xparsed->buttons2 & XINPUT_BUTTON_RB) != 0) parsed_report.buttons |= BIT(11); // (drums) cymbal
-        // special buttons
-        if ((xparsed->buttons1 & XINPUT_BUTTON_L3) != 0) parsed_report.buttons |= BIT(5); // (drums) kick 2
-        if ((xparsed->buttons1 & XINPUT_BUTTON_BACK) != 0) parsed_report.buttons |= BIT(8); // back
-        if ((xparsed->buttons1 & XINPUT_BUTTON_START) != 0) parsed_report.buttons |= BIT(9); // start
-        if ((xparsed->buttons1 & XINPUT_BUTTON_R3) != 0) parsed_report.buttons |= BIT(10); // (drums) pad
-        // dpad/strum bar
-        parsed_report.hat = 0x08;
-        if ((xparsed->buttons1 & XINPUT_BUTTON_UP) != 0) parsed_report.hat = 0x00;
-        if ((xparsed->buttons1 & XINPUT_BUTTON_DOWN) != 0) parsed_report.hat = 0x04;
-        if ((xparsed->buttons1 & XINPUT_BUTTON_LEFT) != 0) parsed_report.hat = 0x06;
-        if ((xparsed->buttons1 & XINPUT_BUTTON_RIGHT) != 0) parsed_report.hat = 0x02;
-        // whammy
-        parsed_report.whammy = (uint8_t)((uint16_t)xparsed->right_stick_x / 0x100);
-        // tilt
-        parsed_report.accel_x = (uint8_t)((uint16_t)xparsed->right_stick_y / 0x100);
-
-        // copy the new parsed report back into the buffer
-        memcpy(transfer->buffer, &parsed_report, transfer->length);
+        OICaptureReport(device->driver->capture_source, device - open_devices, transfer->buffer, ReceivedLength(transfer), completed);
+        device->driver->decode(&device->driver_state, transfer->buffer, ReceivedLength(transfer),
+            OILatencyClockMicroseconds(&analog_clock, completed));
+        WritePS3Report(transfer->buffer, transfer->length, input);
+
+        OILatencyRecord(&device->latency, OI_Latency_Parse, completed);
+        bool chord = (input->translated & RB4_LATENCY_DUMP_CHORD) == RB4_LATENCY_DUMP_CHORD;
+        if (chord && !device->dump_chord_held)
+            OILatencyLog("RB4", device - open_devices, &device->latency);
+        device->dump_chord_held = chord;
     }
-    interrupt_callback(transfer);
-}
-void ParseWirelessXInputCallback(struct libusb_transfer *transfer) {
-    // sometimes the wireless report will just be a silly nothingpacket
-    // so we have to log the last actual packet somewhere
-    // muh memory latencyerinos
-    //final_printf("ParseWirelessXInputCallback\n");
-    OIRB4OpenDevice *device = GetOpenDeviceFromDeviceHandle(transfer->dev_handle);
-    if (device != NULL) {
-        if (transfer->buffer[1] == 0x01) // new input data
-            memcpy(device->last_report, transfer->buffer, transfer->length);
-        // have this copy double as a way to fast-forward the input data by 4 bytes
-        memcpy(transfer->buffer, device->last_report + 4, transfer->length - 4);
+    device->interrupt_callback(transfer);
+    // the game has taken the report by the time its callback returns
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED)
+        OILatencyRecord(&device->latency, OI_Latency_Read, completed);
+}
+
+static void DeviceTransferCallback(OIRB4OpenDevice *device, struct libusb_transfer *transfer) {
+    uint64_t completed = OILatencyNow();
+    // a transfer filled for whatever had this slot before, nothing to parse it with
+    if (transfer->dev_handle != device->transfer_handle) {
+        device->interrupt_callback(transfer);
+        return;
+    }
+    Parse(device, transfer, completed);
+}
+
+// one callback per slot, so a completed transfer leads straight back to its device
+// without searching the open devices or touching the transfer's user_data
+#define DEVICE_TRANSFER_CALLBACK(i) \
+    static void DeviceTransferCallback##i(struct libusb_transfer *transfer) { DeviceTransferCallback(&open_devices[i], transfer); }
+#define DEVICE_TRANSFER_CALLBACK_ENTRY(i) DeviceTransferCallback##i,
+
+// REPEAT(n, m) expands to m(0) through m(n - 1), for as many slots as there can be callbacks for
+#define MAX_DEVICE_CALLBACKS 16
+#define REPEAT_0(m)
+#define REPEAT_1(m) REPEAT_0(m) m(0)
+#define REPEAT_2(m) REPEAT_1(m) m(1)
+#define REPEAT_3(m) REPEAT_2(m) m(2)
+#define REPEAT_4(m) REPEAT_3(m) m(3)
+#define REPEAT_5(m) REPEAT_4(m) m(4)
+#define REPEAT_6(m) REPEAT_5(m) m(5)
+#define REPEAT_7(m) REPEAT_6(m) m(6)
+#define REPEAT_8(m) REPEAT_7(m) m(7)
+#define REPEAT_9(m) REPEAT_8(m) m(8)
+#define REPEAT_10(m) REPEAT_9(m) m(9)
+#define REPEAT_11(m) REPEAT_10(m) m(10)
+#define REPEAT_12(m) REPEAT_11(m) m(11)
+#define REPEAT_13(m) REPEAT_12(m) m(12)
+#define REPEAT_14(m) REPEAT_13(m) m(13)
+#define REPEAT_15(m) REPEAT_14(m) m(14)
+#define REPEAT_16(m) REPEAT_15(m) m(15)
+#define REPEAT_N(n, m) REPEAT_##n(m)
+#define REPEAT(n, m) REPEAT_N(n, m)
+
+_Static_assert(MAX_DEVICE_COUNT <= MAX_DEVICE_CALLBACKS, "MAX_DEVICE_COUNT can be at most 16, one transfer callback each");
+_Static_assert(MAX_DEVICE_COUNT <= OI_REGISTRY_MAX_SLOTS, "MAX_DEVICE_COUNT is more than the registry has slots for");
+REPEAT(MAX_DEVICE_COUNT, DEVICE_TRANSFER_CALLBACK)
+static const libusb_transfer_cb_fn device_transfer_callbacks[] = {
+    REPEAT(MAX_DEVICE_COUNT, DEVICE_TRANSFER_CALLBACK_ENTRY)
+};
+
+static int OpenWirelessSlot(OIRB4WirelessSlot *slot, libusb_device_handle **dev_handle) {
+    OIRB4WirelessAdapter *adapter = slot->adapter;
+    if (dev_handle == NULL)
+        return sceUsbdOpen(adapter->device, dev_handle);
+    if (!slot->open) {
+        if (adapter->handle == NULL) {
+            int r = sceUsbdOpen(adapter->device, &adapter->handle);
+            if (r != 0) {
+                adapter->handle = NULL;
+                return r;
+            }
+        }
+        adapter->open_slots++;
+        slot->open = true;
+    }
+    *dev_handle = (libusb_device_handle *)&slot->handle_token;
+    OIRB4OpenDevice *opendevice = ClaimOpenDevice((libusb_device *)&slot->device_token);
+    if (opendevice != NULL) {
+        opendevice->driver = WirelessSlotDriver(slot->xinput_subtype);
+        SetOpenDeviceHandle(opendevice, *dev_handle);
+        opendevice->transfer_handle = adapter->handle;
+        OIDriverStart(opendevice->driver, &opendevice->driver_state);
+    }
+    return 0;
+}
+
+static void CloseWirelessSlot(OIRB4WirelessSlot *slot) {
+    OIRB4WirelessAdapter *adapter = slot->adapter;
+    if (!slot->open)
+        return;
+    slot->open = false;
+    // the adapter's handle goes once the game's done with every slot on it
+    if (--adapter->open_slots == 0) {
+        sceUsbdClose(adapter->handle);
+        adapter->handle = NULL;
     }
-    ParseXInputCallback(transfer);
 }
 
 int TsceUsbdOpen_hook(libusb_device *device, libusb_device_handle **dev_handle) {
-    //final_printf("sceUsbdOpen_hook\n");
+    trace_printf("sceUsbdOpen_hook\n");
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDevice(device);
+    if (slot != NULL)
+        return OpenWirelessSlot(slot, dev_handle);
     int r = sceUsbdOpen(device, dev_handle);
-    if (r == 0 && dev_handle != NULL && *dev_handle != NULL) {
-        OIRB4DeviceType type = IdentifyDevice(device);
-        if (type != RB4_Type_None) {
-            OIRB4OpenDevice *opendevice = GetOpenDeviceFromDevice(device);
+    if (r != 0) {
+        // the device has probably gone away, don't trust anything we know about it
+        InvalidateCachedDescriptor(device);
+    } else if (dev_handle != NULL && *dev_handle != NULL) {
+        OIRB4DescriptorCacheEntry *cached = LookupCachedDescriptor(device);
+        const OIDriver *driver = NULL;
+        OIDriverDescriptor desc;
+        if (cached != NULL)
+            driver = cached->driver;
+        else if (OIDriverDescribe(device, NULL, &desc))
+            driver = OIDriverIdentify(&desc, OI_FrontEnd_RB4);
+        // instruments the game already understands are left to it
+        if (driver != NULL && driver->decode != NULL) {
+            OIRB4OpenDevice *opendevice = ClaimOpenDevice(device);
             if (opendevice == NULL)
                 return r;
-            opendevice->type = type;
-            opendevice->device_handle = *dev_handle;
+            opendevice->driver = driver;
+            SetOpenDeviceHandle(opendevice, *dev_handle);
+            opendevice->transfer_handle = *dev_handle;
+            OIDriverStart(driver, &opendevice->driver_state);
         }
     }
     return r;
 }
 
 void TsceUsbdClose_hook(libusb_device_handle *dev_handle) {
-    //final_printf("sceUsbdClose_hook\n");
+    trace_printf("sceUsbdClose_hook\n");
     if (dev_handle == NULL)
         return;
-    sceUsbdClose(dev_handle);
-    if (dev_handle != NULL) {
-        OIRB4OpenDevice *opendevice = GetOpenDeviceFromDeviceHandle(dev_handle);
-        if (opendevice == NULL)
-            return;
-        opendevice->is_open = false;
-        opendevice->device_handle = NULL;
-        opendevice->device = NULL;
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDeviceHandle(dev_handle);
+    if (slot != NULL) {
+        CloseWirelessSlot(slot);
+    } else {
+        // it might not be the same device by the time it's opened again
+        InvalidateCachedDescriptor(sceUsbdGetDevice(dev_handle));
+        sceUsbdClose(dev_handle);
     }
-    return;
+    OIRB4OpenDevice *opendevice = GetOpenDeviceFromDeviceHandle(dev_handle);
+    if (opendevice == NULL)
+        return;
+    OIRegistryRelease(&device_registry, opendevice - open_devices);
+    opendevice->device_handle = NULL;
+    opendevice->transfer_handle = NULL;
+    opendevice->device = NULL;
+    opendevice->driver = NULL;
 }
 
 int TsceUsbdGetConfigDescriptor_hook(libusb_device *device, uint8_t config_index, struct libusb_config_descriptor **config) {
-    //final_printf("sceUsbdGetConfigDescriptor_hook\n");
+    trace_printf("sceUsbdGetConfigDescriptor_hook\n");
+    // slots look just like the adapter, their interfaces get shifted along when they're claimed
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDevice(device);
+    if (slot != NULL)
+        device = slot->adapter->device;
     int r = sceUsbdGetConfigDescriptor(device, config_index, config);
     // always set device class to HID - rb4 needs this to actually connect to the device
     if (r == 0 && config != NULL && *config != NULL)
@@ -213,92 +627,204 @@ int TsceUsbdGetConfigDescriptor_hook(libusb_device *device, uint8_t config_index
 }
 
 int TsceUsbdGetDeviceDescriptor_hook(libusb_device *device, struct libusb_device_descriptor *desc) {
-    //final_printf("sceUsbdGetDeviceDescriptor_hook\n");
+    trace_printf("sceUsbdGetDeviceDescriptor_hook\n");
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDevice(device);
+    if (slot != NULL) {
+        // the adapter's, shown as whatever's on this slot
+        int r = TsceUsbdGetDeviceDescriptor_hook(slot->adapter->device, desc);
+        if (r == 0 && desc != NULL)
+            OIDriverPresent(WirelessSlotDriver(slot->xinput_subtype), desc);
+        return r;
+    }
+    if (desc == NULL)
+        return sceUsbdGetDeviceDescriptor(device, desc);
+    OIRB4DescriptorCacheEntry *cached = GetCachedDescriptor(device);
+    if (cached != NULL) {
+        *desc = cached->desc;
+        return 0;
+    }
     int r = sceUsbdGetDeviceDescriptor(device, desc);
-    if (r == 0 && desc != NULL) {
-        // Wii instruments use Harmonix Music Systems vendor id
-        if (desc->idVendor == 0x1BAD) {
-            desc->idVendor = 0x12BA; // licensed by SCEA
-            switch(desc->idProduct) {
-                // TODO: Fill more of these in, because there is more, and we must support them.
-                case 0x0004:
-                    // guitar
-                    desc->idProduct = 0x0200;
-                    break;
-                case 0x0005:
-                case 0x3110:
-                case 0x3138:
-                    // drums
-                    desc->idProduct = 0x0210;
-                    break;
-            }
-        }
-
-        // detect XInput instruments using device class + interface descriptor
-        // so third party ones should work just fine
-        if (desc->bDeviceClass == 0xFF && desc->bDeviceSubClass == 0xFF && desc->bDeviceProtocol == 0xFF) {
-            // get the type of controller
-            switch (IdentifyDevice(device)) {
-                case RB4_Type_XInputGuitar:
-                    desc->idVendor = 0x12BA;
-                    desc->idProduct = 0x0200;
-                    break;
-                case RB4_Type_XInputDrums:
-                case RB4_Type_XInputWireless:
-                    desc->idVendor = 0x12BA;
-                    desc->idProduct = 0x0210;
-                    break;
-                default:
-                    break;
-            }
+    if (r == 0) {
+        // XInput instruments are found by device class + interface descriptor, so third party ones should work just fine
+        OIDriverDescriptor driver_desc;
+        const OIDriver *driver = NULL;
+        uint8_t wireless_subtypes[RB4_WIRELESS_SLOTS] = { 0 };
+        if (OIDriverDescribe(device, desc, &driver_desc))
+            driver = OIDriverIdentify(&driver_desc, OI_FrontEnd_RB4);
+        // the adapter itself is slot 0, and is shown as whatever's on it
+        if (driver == &oi_drivers[OI_Driver_XInputWireless]) {
+            ProbeWirelessAdapter(device, wireless_subtypes);
+            driver = WirelessSlotDriver(wireless_subtypes[0]);
         }
-        //final_printf("Descriptor: %04X %04X\n", desc->idVendor, desc->idProduct);
+        if (driver != NULL)
+            OIDriverPresent(driver, desc);
+        trace_printf("Descriptor: %04X %04X\n", desc->idVendor, desc->idProduct);
+        CacheDescriptor(device, driver, desc, wireless_subtypes);
     }
     return r;
 }
 
 void TsceUsbdFillInterruptTransfer_hook(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *buffer, int length, libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout) {
-    //final_printf("sceUsbdFillInterruptTransfer_hook\n");
+    trace_printf("sceUsbdFillInterruptTransfer_hook\n");
     OIRB4OpenDevice *device = GetOpenDeviceFromDeviceHandle(dev_handle);
     if (device != NULL) {
-        interrupt_callback = callback; // should always be the same
-        if (device->type == RB4_Type_XInputWireless)
-            callback = ParseWirelessXInputCallback;
-        else
-            callback = ParseXInputCallback;
+        device->interrupt_callback = callback;
+        callback = device_transfer_callbacks[device - open_devices];
+    }
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDeviceHandle(dev_handle);
+    if (slot != NULL) {
+        dev_handle = slot->adapter->handle;
+        endpoint = WirelessSlotEndpoint(slot, endpoint);
     }
     sceUsbdFillInterruptTransfer(transfer, dev_handle, endpoint, buffer, length, callback, user_data, timeout);
 }
 
+int TsceUsbdGetDeviceList_hook(libusb_device ***list) {
+    trace_printf("sceUsbdGetDeviceList_hook\n");
+    int count = sceUsbdGetDeviceList(list);
+    if (count <= 0 || count > MAX_LISTED_DEVICES || list == NULL || *list == NULL)
+        return count;
+
+    // adapters are only known once the game has read their descriptor, so their slots show up from the next scan.
+    // ones already seen keep their slots, so the pointers the game has for them don't change
+    libusb_device *adapters[MAX_WIRELESS_ADAPTERS];
+    uint8_t subtypes[MAX_WIRELESS_ADAPTERS][RB4_WIRELESS_SLOTS];
+    int num_adapters = 0;
+    bool present[MAX_WIRELESS_ADAPTERS] = { false };
+    for (int i = 0; i < count && num_adapters < MAX_WIRELESS_ADAPTERS; i++) {
+        OIRB4DescriptorCacheEntry *cached = LookupCachedDescriptor((*list)[i]);
+        if (cached == NULL || !IsWirelessAdapterDriver(cached->driver))
+            continue;
+        memcpy(subtypes[num_adapters], cached->wireless_subtypes, RB4_WIRELESS_SLOTS);
+        adapters[num_adapters++] = (*list)[i];
+        for (int j = 0; j < MAX_WIRELESS_ADAPTERS; j++) {
+            if (wireless_adapters[j].device == (*list)[i])
+                present[j] = true;
+        }
+    }
+    if (num_adapters == 0)
+        return count;
+
+    int extended = 0;
+    for (; extended < MAX_EXTENDED_LISTS; extended++) {
+        libusb_device **unused = NULL;
+        if (atomic_compare_exchange_strong(&extended_lists[extended].original, &unused, *list))
+            break;
+    }
+    if (extended == MAX_EXTENDED_LISTS)
+        return count;
+    libusb_device **devices = extended_lists[extended].devices;
+    int listed = 0;
+    for (int i = 0; i < count; i++)
+        devices[listed++] = (*list)[i];
+    for (int i = 0; i < num_adapters; i++) {
+        OIRB4WirelessAdapter *adapter = GetWirelessAdapter(adapters[i], subtypes[i], present);
+        if (adapter == NULL)
+            continue;
+        for (int j = 0; j < RB4_WIRELESS_SLOTS - 1 && listed < MAX_LISTED_DEVICES; j++)
+            devices[listed++] = (libusb_device *)&adapter->slots[j].device_token;
+    }
+    devices[listed] = NULL;
+    *list = devices;
+    return listed;
+}
+
+int TsceUsbdFreeDeviceList_hook(libusb_device **list) {
+    trace_printf("sceUsbdFreeDeviceList_hook\n");
+    for (int i = 0; i < MAX_EXTENDED_LISTS; i++) {
+        if (list != NULL && list == extended_lists[i].devices) {
+            list = atomic_exchange(&extended_lists[i].original, NULL);
+            break;
+        }
+    }
+    return sceUsbdFreeDeviceList(list);
+}
+
+int TsceUsbdClaimInterface_hook(libusb_device_handle *dev_handle, int interface_number) {
+    trace_printf("sceUsbdClaimInterface_hook\n");
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDeviceHandle(dev_handle);
+    if (slot != NULL)
+        return sceUsbdClaimInterface(slot->adapter->handle, WirelessSlotInterface(slot, interface_number));
+    return sceUsbdClaimInterface(dev_handle, interface_number);
+}
+
+int TsceUsbdReleaseInterface_hook(libusb_device_handle *dev_handle, int interface_number) {
+    trace_printf("sceUsbdReleaseInterface_hook\n");
+    OIRB4WirelessSlot *slot = GetWirelessSlotFromDeviceHandle(dev_handle);
+    if (slot != NULL)
+        return sceUsbdReleaseInterface(slot->adapter->handle, WirelessSlotInterface(slot, interface_number));
+    return sceUsbdReleaseInterface(dev_handle, interface_number);
+}
+
 #define ADDR_OFFSET 0x00400000
 void InitUsbdHooks() {
+    OIDriversInit();
+
     // make sure we have the USBD module loaded into memory
     sceSysmoduleLoadModule(ORBIS_SYSMODULE_USBD);
+    OIRegistryInit(&device_registry, MAX_DEVICE_COUNT, "OrbisInstrumentRB4Registry");
+    OILatencyClockInit(&analog_clock);
     struct proc_info procInfo;
     sys_sdk_proc_info(&procInfo);
 
-    if (strcmp(procInfo.version, "02.21") != 0) {
-        final_printf("This plugin is only compatible with version 02.21 of Rock Band 4.\n");
-        return;
-    }
-
-    /*int usbd = 0;
+    // TODO: Figure out why we can't just hook sceUsbd directly
+    // right now this is pretty bad form, to hook the game's own stubs.
+    // they're found by looking for the PLT entries that jump to the real functions
+    int usbd = 0;
     sys_dynlib_load_prx("libSceUsbd.sprx", &usbd);
-    sys_dynlib_dlsym(usbd, "sceUsbdGetConfigDescriptor", &TsceUsbdGetConfigDescriptor);
-    sys_dynlib_dlsym(usbd, "sceUsbdFreeConfigDescriptor", &TsceUsbdFreeConfigDescriptor);
-    sys_dynlib_dlsym(usbd, "sceUsbdGetDeviceDescriptor", &TsceUsbdGetDeviceDescriptor);
-    sys_dynlib_dlsym(usbd, "sceUsbdFillInterruptTransfer", &TsceUsbdFillInterruptTransfer);
-    sys_dynlib_dlsym(usbd, "sceUsbdOpen", &TsceUsbdOpen);
-    sys_dynlib_dlsym(usbd, "sceUsbdClose", &TsceUsbdClose);*/
+    for (int i = 0; i < RB4_Stub_Count; i++)
+        sys_dynlib_dlsym(usbd, usbd_stubs[i].name, &usbd_stubs[i].function);
+    OIResolverImage image;
+    if (OIResolverGetImage(0, &image))
+        OIResolverResolve(&image, usbd_stubs, RB4_Stub_Count, RB4_Stub_RequiredCount, OI_RESOLVER_CACHE_PATH);
+    int found = 0;
+    for (int i = 0; i < RB4_Stub_RequiredCount; i++) {
+        if (usbd_stubs[i].stub != 0)
+            found++;
+    }
+    // only a scan or walk that found the stubs it needed can say which functions the game doesn't import
+    bool scanned = found == RB4_Stub_RequiredCount;
+    if (!scanned) {
+        if (strcmp(procInfo.version, "02.21") != 0) {
+            final_printf("Couldn't find the sceUsbd stubs in version %s of Rock Band 4.\n", procInfo.version);
+            return;
+        }
+        final_printf("Using the known sceUsbd stubs for version 02.21.\n");
+        int unbound;
+        OIResolverWalk(procInfo.base_address + usbd_stub_offsets_0221[RB4_Stub_Open], usbd_stubs, RB4_Stub_Count, &unbound);
+        // the walk has to have come across every known one for anything else it found to be believed
+        scanned = unbound == 0;
+        for (int i = 0; i < RB4_Stub_RequiredCount; i++) {
+            if (usbd_stubs[i].stub != procInfo.base_address + usbd_stub_offsets_0221[i])
+                scanned = false;
+        }
+        if (!scanned) {
+            final_printf("Couldn't walk the sceUsbd stubs (%i not bound yet).\n", unbound);
+            for (int i = 0; i < RB4_Stub_Count; i++)
+                usbd_stubs[i].stub = i < RB4_Stub_RequiredCount ? procInfo.base_address + usbd_stub_offsets_0221[i] : 0;
+        }
+    }
 
-    // TODO: Figure out why we can't just hook sceUsbd directly
-    // right now this is pretty bad form, to hook the game's own stubs
-    // less game-agnostic (not that any other games use Usbd) and less version-agnostic
-    TsceUsbdOpen = (void*)(procInfo.base_address + 0x01245260);
-    TsceUsbdGetDeviceDescriptor = (void*)(procInfo.base_address + 0x01245210);
-    TsceUsbdGetConfigDescriptor = (void*)(procInfo.base_address + 0x012451e0);
-    TsceUsbdFillInterruptTransfer = (void*)(procInfo.base_address + 0x01245190);
-    TsceUsbdClose = (void*)(procInfo.base_address + 0x01245160);
+    TsceUsbdOpen = (void*)usbd_stubs[RB4_Stub_Open].stub;
+    TsceUsbdGetDeviceDescriptor = (void*)usbd_stubs[RB4_Stub_GetDeviceDescriptor].stub;
+    TsceUsbdGetConfigDescriptor = (void*)usbd_stubs[RB4_Stub_GetConfigDescriptor].stub;
+    TsceUsbdFillInterruptTransfer = (void*)usbd_stubs[RB4_Stub_FillInterruptTransfer].stub;
+    TsceUsbdClose = (void*)usbd_stubs[RB4_Stub_Close].stub;
+    TsceUsbdGetDeviceList = (void*)usbd_stubs[RB4_Stub_GetDeviceList].stub;
+    TsceUsbdFreeDeviceList = (void*)usbd_stubs[RB4_Stub_FreeDeviceList].stub;
+    TsceUsbdClaimInterface = (void*)usbd_stubs[RB4_Stub_ClaimInterface].stub;
+    TsceUsbdReleaseInterface = (void*)usbd_stubs[RB4_Stub_ReleaseInterface].stub;
+    wireless_slots_enabled = scanned && TsceUsbdGetDeviceList != NULL && TsceUsbdFreeDeviceList != NULL &&
+        TsceUsbdClaimInterface != NULL && TsceUsbdReleaseInterface != NULL;
+    for (int i = RB4_Stub_Untranslated; i < RB4_Stub_Count && wireless_slots_enabled; i++) {
+        // one that couldn't be looked up can't be ruled out either
+        if (usbd_stubs[i].function == 0 || usbd_stubs[i].stub != 0) {
+            final_printf("Can't rule out %s being given a wireless slot.\n", usbd_stubs[i].name);
+            wireless_slots_enabled = false;
+        }
+    }
+    if (!wireless_slots_enabled)
+        final_printf("Only the first instrument on each wireless adapter will work.\n");
 
     // apply all the hooks to the usbd library
     HOOK(TsceUsbdGetConfigDescriptor);
@@ -306,13 +832,36 @@ void InitUsbdHooks() {
     HOOK(TsceUsbdFillInterruptTransfer);
     HOOK(TsceUsbdOpen);
     HOOK(TsceUsbdClose);
+    if (wireless_slots_enabled) {
+        HOOK(TsceUsbdGetDeviceList);
+        HOOK(TsceUsbdFreeDeviceList);
+        HOOK(TsceUsbdClaimInterface);
+        HOOK(TsceUsbdReleaseInterface);
+    }
 }
 
 void DestroyUsbdHooks() {
+    // the game can still have transfers out with our per-slot callbacks after the stubs are unhooked below,
+    // so the device slots and registry are left as they are
+    const OILatencyStats *latency[MAX_DEVICE_COUNT];
+    for (int i = 0; i < MAX_DEVICE_COUNT; i++)
+        latency[i] = &open_devices[i].latency;
+    OILatencyWriteFile(OI_LATENCY_FILE_PATH, latency, MAX_DEVICE_COUNT);
+
+    uint32_t lookups = descriptor_cache_hits + descriptor_cache_misses;
+    final_printf("Descriptor cache: %u hits, %u misses (%u%% hit rate)\n", descriptor_cache_hits, descriptor_cache_misses,
+        lookups > 0 ? (descriptor_cache_hits * 100) / lookups : 0);
+
     // unhook everything just in case
     UNHOOK(TsceUsbdGetConfigDescriptor);
     UNHOOK(TsceUsbdGetDeviceDescriptor);
     UNHOOK(TsceUsbdFillInterruptTransfer);
     UNHOOK(TsceUsbdOpen);
     UNHOOK(TsceUsbdClose);
+    if (wireless_slots_enabled) {
+        UNHOOK(TsceUsbdGetDeviceList);
+        UNHOOK(TsceUsbdFreeDeviceList);
+        UNHOOK(TsceUsbdClaimInterface);
+        UNHOOK(TsceUsbdReleaseInterface);
+    }
 }
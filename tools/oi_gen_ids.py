@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# oi_gen_ids.py - OrbisInstrumentalizer
+# Turns data/instrument_ids.txt into the sorted, perfect hashed table source/instrument_ids.c looks devices up in.
+# Licensed under the GNU Lesser General Public License version 2.1, or later.
+
+import sys
+
+# the hash has to match OIInstrumentIdHash in source/instrument_ids.c
+MASK = 0xFFFFFFFF
+MAX_DISPLACEMENT = 0xFFFF
+EMPTY_SLOT = 0xFFFF
+
+
+def hash_key(key, seed):
+    h = (key ^ seed) & MASK
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK
+    h ^= h >> 16
+    return h
+
+
+def next_power_of_two(n):
+    p = 1
+    while p < n:
+        p *= 2
+    return p
+
+
+def parse_id(text, path, line_number):
+    value = int(text, 16)
+    if not 0 <= value <= 0xFFFF:
+        raise ValueError("%s:%i: %s isn't a 16 bit id" % (path, line_number, text))
+    return value
+
+
+def read_ids(path):
+    entries = {}
+    with open(path) as f:
+        for line_number, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split(None, 4)
+            if len(fields) != 5:
+                raise ValueError("%s:%i: expected vendor, product, driver, present as and name" % (path, line_number))
+            vendor = parse_id(fields[0], path, line_number)
+            product = parse_id(fields[1], path, line_number)
+            present = (0, 0)
+            if fields[3] != "-":
+                present_vendor, present_product = fields[3].split(":")
+                present = (parse_id(present_vendor, path, line_number), parse_id(present_product, path, line_number))
+            key = (vendor << 16) | product
+            if key in entries:
+                raise ValueError("%s:%i: %04X:%04X is listed twice" % (path, line_number, vendor, product))
+            entries[key] = (vendor, product, fields[2], present, fields[4].strip())
+    return [entries[key] for key in sorted(entries)]
+
+
+# hash and displace: each bucket gets the first seed that puts all of its keys in empty slots,
+# biggest buckets first while there's the most room
+def build_table(keys):
+    slot_count = next_power_of_two(max(2, len(keys) * 5 // 4 + 1))
+    bucket_count = next_power_of_two(max(1, len(keys) // 2))
+    buckets = [[] for _ in range(bucket_count)]
+    for index, key in enumerate(keys):
+        buckets[hash_key(key, 0) & (bucket_count - 1)].append((index, key))
+    displacements = [0] * bucket_count
+    slots = [EMPTY_SLOT] * slot_count
+    for bucket in sorted(range(bucket_count), key=lambda b: -len(buckets[b])):
+        if not buckets[bucket]:
+            break
+        for seed in range(1, MAX_DISPLACEMENT + 1):
+            placed = [hash_key(key, seed) & (slot_count - 1) for _, key in buckets[bucket]]
+            if len(set(placed)) == len(placed) and all(slots[slot] == EMPTY_SLOT for slot in placed):
+                break
+        else:
+            raise ValueError("couldn't find a displacement for bucket %i" % bucket)
+        displacements[bucket] = seed
+        for (index, _), slot in zip(buckets[bucket], placed):
+            slots[slot] = index
+    return displacements, slots
+
+
+def c_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def write_table(out, source, entries, displacements, slots):
+    out.write("// generated by tools/oi_gen_ids.py from %s, edit that instead\n\n" % source)
+    out.write("#define OI_INSTRUMENT_ID_COUNT %i\n" % len(entries))
+    out.write("#define OI_INSTRUMENT_ID_BUCKETS %i\n" % len(displacements))
+    out.write("#define OI_INSTRUMENT_ID_SLOTS %i\n" % len(slots))
+    out.write("#define OI_INSTRUMENT_ID_EMPTY 0x%04X\n\n" % EMPTY_SLOT)
+    out.write("// sorted by VID/PID\n")
+    out.write("static const OIInstrumentId instrument_ids[OI_INSTRUMENT_ID_COUNT] = {\n")
+    for vendor, product, driver, present, name in entries:
+        out.write("    { 0x%04X, 0x%04X, OI_Driver_%s, 0x%04X, 0x%04X, %s },\n" %
+                  (vendor, product, driver, present[0], present[1], c_string(name)))
+    out.write("};\n\n")
+    out.write("static const uint16_t instrument_id_displacements[OI_INSTRUMENT_ID_BUCKETS] = {\n")
+    for i in range(0, len(displacements), 8):
+        out.write("    " + ", ".join("%i" % d for d in displacements[i:i + 8]) + ",\n")
+    out.write("};\n\n")
+    out.write("static const uint16_t instrument_id_slots[OI_INSTRUMENT_ID_SLOTS] = {\n")
+    for i in range(0, len(slots), 8):
+        out.write("    " + ", ".join("0x%04X" % s for s in slots[i:i + 8]) + ",\n")
+    out.write("};\n")
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: %s instrument_ids.txt instrument_ids.gen.h" % sys.argv[0])
+        return 1
+    try:
+        entries = read_ids(sys.argv[1])
+    except ValueError as e:
+        print(e)
+        return 1
+    if len(entries) >= EMPTY_SLOT:
+        print("too many instruments for a 16 bit slot table")
+        return 1
+    keys = [(vendor << 16) | product for vendor, product, _, _, _ in entries]
+    displacements, slots = build_table(keys)
+    with open(sys.argv[2], "w") as out:
+        write_table(out, sys.argv[1], entries, displacements, slots)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# oi_latency.py - OrbisInstrumentalizer
+# Prints the latency histograms dumped to OrbisInstrumentalizer_latency.bin.
+# Licensed under the GNU Lesser General Public License version 2.1, or later.
+
+import struct
+import sys
+
+MAGIC = 0x544C494F  # 'OILT'
+HEADER = struct.Struct("<IHHIIQ")
+STAGE_NAMES = ["parse", "read"]
+
+
+def bucket_limit(bucket):
+    if bucket < 4:
+        return bucket
+    msb = (bucket + 4) // 4
+    step = 1 << (msb - 2)
+    return (4 + (bucket + 4) % 4) * step + step - 1
+
+
+def percentile(count, max_ticks, buckets, percent):
+    if count == 0:
+        return 0
+    target = (count * percent + 99) // 100
+    seen = 0
+    for i, n in enumerate(buckets):
+        seen += n
+        if seen >= target:
+            return min(bucket_limit(i), max_ticks)
+    return max_ticks
+
+
+def main():
+    if len(sys.argv) != 2:
+        print("usage: %s OrbisInstrumentalizer_latency.bin" % sys.argv[0])
+        return 1
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    magic, version, num_stages, num_devices, num_buckets, tsc_frequency = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != 1:
+        print("not a latency dump, or an unknown version")
+        return 1
+    histogram = struct.Struct("<QQ%dI" % num_buckets)
+
+    def us(ticks):
+        return ticks * 1000000 // tsc_frequency if tsc_frequency else 0
+
+    offset = HEADER.size
+    for device in range(num_devices):
+        for stage in range(num_stages):
+            values = histogram.unpack_from(data, offset)
+            offset += histogram.size
+            max_ticks, count, buckets = values[0], values[1], values[2:]
+            if count == 0:
+                continue
+            name = STAGE_NAMES[stage] if stage < len(STAGE_NAMES) else "stage %d" % stage
+            print("device %d %-5s %10d reports  p50 %6dus  p99 %6dus  max %6dus" % (device, name, count,
+                  us(percentile(count, max_ticks, buckets, 50)),
+                  us(percentile(count, max_ticks, buckets, 99)),
+                  us(max_ticks)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())